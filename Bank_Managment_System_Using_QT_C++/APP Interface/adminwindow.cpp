@@ -26,34 +26,33 @@ AdminWindow::~AdminWindow()
 
 void AdminWindow::readyRead()
 {
-    // read data from socket
-    responseData.append(socket->readAll());
+    // Buffer what arrived, a large response can span many reads
+    responseDecoder.append(socket->readAll());
 
-    // Check if we have a complete message (newline delimited) only happens when receiving a very large response
-    if (!responseData.endsWith('\n'))
+    QByteArray responseData;
+    while (responseDecoder.takeFrame(responseData))
     {
-        return;  // If not, return and wait for more data
-    }
-
-    // Try to parse the JSON document
-    QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
+        QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
 
-    // if we get here hooray :D its a kinda valid json after a ton of buffering maybe
-    responseData.clear();
+        // Check if the response is a valid JSON object
+        if (!jsonResponse.isObject())
+        {
+            qDebug() << "Invalid JSON response from the server.";
+            continue;
+        }
 
-    //qDebug() << "Raw Response Data:" << responseData;
+        handleResponse(jsonResponse.object());
+    }
 
-    // Check if the response is a valid JSON object
-    if (!jsonResponse.isObject())
+    if (responseDecoder.hasError())
     {
-        qDebug() << "Invalid JSON response from the server.";
-        return;
+        qDebug() << "Malformed frame from the server, closing the connection.";
+        socket->abort();
     }
+}
 
-    //qDebug() << "Raw Response Data:" << responseData;
-
-    // Handle the response based on the request ID
-    QJsonObject responseObject = jsonResponse.object();
+void AdminWindow::handleResponse(const QJsonObject &responseObject)
+{
     int responseId = responseObject["responseId"].toInt();
 
     switch (responseId)
@@ -83,7 +82,6 @@ void AdminWindow::readyRead()
         qDebug() << "Unknown responseId ID: " << responseId;
         break;
     }
-    // qDebug() << responseData;
 }
 
 
@@ -119,7 +117,7 @@ void AdminWindow::on_pushButton_get_account_number_clicked()
     QJsonDocument jsonRequest(requestObject);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
 }
 
 void AdminWindow::handleGetAccountNumberResponse(const QJsonObject &responseObject)
@@ -159,7 +157,7 @@ void AdminWindow::on_pbn_view_balance_clicked()
     QJsonDocument jsonRequest(requestObject);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
 }
 
 void AdminWindow::handleViewAccountBalanceResponse(const QJsonObject &responseObject)
@@ -243,7 +241,7 @@ void AdminWindow::on_pbn_create_new_account_clicked()
     QJsonDocument jsonRequest(requestObject);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
 
 }
 
@@ -289,7 +287,7 @@ void AdminWindow::on_pbn_delete_account_clicked()
         QJsonDocument jsonRequest(requestObject);
 
         // Send the request to the server
-        socket->write(jsonRequest.toJson());
+        socket->write(MessageFraming::encode(jsonRequest.toJson()));
     }
     else
     {
@@ -376,7 +374,7 @@ void AdminWindow::on_pbn_view_database_clicked()
     QJsonDocument jsonRequest(requestObject);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
 }
 
 void AdminWindow::on_pbn_view_transaction_history_clicked()
@@ -406,7 +404,7 @@ void AdminWindow::on_pbn_view_transaction_history_clicked()
     QJsonDocument jsonRequest(requestObject);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
 }
 
 void AdminWindow::handleViewTransactionHistoryResponse(const QJsonObject &responseObject)
@@ -502,7 +500,7 @@ void AdminWindow::on_pbn_update_account_clicked()
     QJsonDocument jsonRequest(requestObject);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
 }
 
 void AdminWindow::handleUpdateAccountResponse(const QJsonObject &responseObject)
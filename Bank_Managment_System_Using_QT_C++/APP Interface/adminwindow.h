@@ -42,12 +42,13 @@ private:
     Ui::AdminWindow *ui;
     QTcpSocket *socket;
     qint64 accountNumber;
-    QByteArray responseData;
+    FrameDecoder responseDecoder;
 
     // Regular expressions for username and password validation
     static const QRegularExpression usernameRegex;
     static const QRegularExpression passwordRegex;
 
+    void handleResponse(const QJsonObject &responseObject);
     void handleCreateNewAccountResponse(const QJsonObject &responseObject);
     void handleGetAccountNumberResponse(const QJsonObject &responseObject);
     void handleViewAccountBalanceResponse(const QJsonObject &responseObject);
@@ -3,6 +3,8 @@
 #include "adminwindow.h"
 #include "userwindow.h"
 
+#include <QScrollBar>
+
 // Regular expressions for username and password validation
 const QRegularExpression client::usernameRegex("^[a-zA-Z0-9_]*$");
 const QRegularExpression client::passwordRegex("\\s");
@@ -22,11 +24,32 @@ client::client(QWidget *parent)
     setWindowTitle("Bank APP");
     ui->pushButton_logout->hide();
 
-    // Attempt to connect to the server
-    socket->connectToHost("localhost", 54321);
+    // Negotiate the wire encoding as soon as the connection is up
+    connect(socket, &QTcpSocket::connected, this, &client::sendHello);
 
     // Connect the readyRead signal to the readyRead slot
     connect(socket, &QTcpSocket::readyRead, this, &client::readyRead);
+
+    // Load the next history page once a table is scrolled to its end
+    connect(ui->tbl_view_histroy_transaction_2->verticalScrollBar(), &QScrollBar::valueChanged, this,
+            [this](int value)
+            {
+                if (value == ui->tbl_view_histroy_transaction_2->verticalScrollBar()->maximum())
+                {
+                    requestUserHistoryPage();
+                }
+            });
+    connect(ui->tbl_transaction_history_2->verticalScrollBar(), &QScrollBar::valueChanged, this,
+            [this](int value)
+            {
+                if (value == ui->tbl_transaction_history_2->verticalScrollBar()->maximum())
+                {
+                    requestAdminHistoryPage();
+                }
+            });
+
+    // Attempt to connect to the server
+    socket->connectToHost("localhost", 54321);
 }
 
 // Destructor
@@ -41,65 +64,158 @@ client::~client()
 // Slot for handling incoming data from the server
 void client::readyRead()
 {
-    // Read the response from the server
-    QByteArray responseData = socket->readAll();
-    QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
+    // Buffer what arrived and handle every complete response frame
+    responseDecoder.append(socket->readAll());
 
-    // Check if the response is a valid JSON object
-    if (!jsonResponse.isObject())
+    QByteArray responseData;
+    while (responseDecoder.takeFrame(responseData))
     {
-        qDebug() << "Invalid JSON response from the server.";
-        return;
+        // Check if the response is a valid JSON or CBOR object
+        QJsonObject responseObject;
+        if (!MessageCodec::decode(responseData, responseObject))
+        {
+            qDebug() << "Invalid response from the server.";
+            continue;
+        }
+
+        handleResponse(responseObject);
     }
 
-    // Handle the response based on the request ID
-    QJsonObject responseObject = jsonResponse.object();
+    if (responseDecoder.hasError())
+    {
+        qDebug() << "Malformed frame from the server, closing the connection.";
+        socket->abort();
+    }
+}
+
+// Dispatch a single response based on its ID
+void client::handleResponse(const QJsonObject &responseObject)
+{
     int responseId = responseObject["responseId"].toInt();
 
-    switch (responseId)
+    switch (static_cast<BankProtocol::RequestId>(responseId))
     {
-    case 0:
+    case BankProtocol::RequestId::Login:
         handleLoginResponse(responseObject);
         break;
-    case 1:
+    case BankProtocol::RequestId::GetAccountNumber:
         handleGetAccountNumberResponse(responseObject);
         break;
-    case 2:
+    case BankProtocol::RequestId::GetBalance:
         handleViewAccountBalanceResponse(responseObject);
         break;
-    case 3:
+    case BankProtocol::RequestId::CreateAccount:
         handleCreateNewAccountResponse(responseObject);
         break;
-    case 5:
+    case BankProtocol::RequestId::FetchAllUserData:
         handleFetchAllUserDataResponse(responseObject);
         break;
-    case 6:
+    case BankProtocol::RequestId::MakeTransaction:
         handleMakeTransactionResponse(responseObject);
         break;
-    case 7:
+    case BankProtocol::RequestId::MakeTransfer:
         handleMakeTransferResponse(responseObject);
         break;
-    case 8:
+    case BankProtocol::RequestId::TransactionHistory:
         handleViewTransactionHistoryResponse(responseObject);
         break;
-    case 10:
+    case BankProtocol::RequestId::AdminGetBalance:
         adminHandleViewAccountBalanceResponse(responseObject);
         break;
-    case 11:
+    case BankProtocol::RequestId::AdminTransactionHistory:
         adminHandleViewTransactionHistoryResponse(responseObject);
         break;
+    case BankProtocol::RequestId::Hello:
+        handleHelloResponse(responseObject);
+        break;
+    case BankProtocol::RequestId::Subscribe:
+        handleAccountEvent(responseObject);
+        break;
+    case BankProtocol::RequestId::FetchUserDataChanges:
+        handleUserDataChangesResponse(responseObject);
+        break;
     default:
         qDebug() << "Unknown responseId ID: " << responseId;
         break;
     }
-    // qDebug() << responseData;
+}
+
+// Offer the encodings we understand, the server answers with the one it picked
+void client::sendHello()
+{
+    BankProtocol::HelloRequest request;
+    request.encodings = MessageCodec::supportedEncodings();
+    // Our FrameDecoder inflates compressed responses by itself
+    request.compression = {MessageFraming::CompressionName};
+
+    // Always JSON, an old server would not understand anything else
+    socket->write(MessageFraming::encode(MessageCodec::encode(BankProtocol::encode(request),
+                                                              MessageCodec::Encoding::Json)));
+}
+
+// Function to handle the hello response from the server
+void client::handleHelloResponse(const QJsonObject &responseObject)
+{
+    if (!responseObject["helloSuccess"].toBool())
+    {
+        qDebug() << "Encoding negotiation failed, staying with JSON.";
+        return;
+    }
+    MessageCodec::encodingFromName(responseObject["encoding"].toString(), requestEncoding);
+}
+
+// Ask the server to push changes of these accounts, an empty list stops them
+void client::subscribeToAccounts(const QList<qint64> &accountNumbers)
+{
+    BankProtocol::SubscribeRequest request;
+    request.accountNumbers = accountNumbers;
+    sendRequest(BankProtocol::encode(request));
+}
+
+// Function to handle the subscribe response and the events pushed after it
+void client::handleAccountEvent(const QJsonObject &responseObject)
+{
+    const QString event = responseObject["event"].toString();
+    if (event.isEmpty())
+    {
+        if (!responseObject["subscribeSuccess"].toBool())
+        {
+            qDebug() << "Subscribe failed: " << responseObject["errorMessage"].toString();
+        }
+        return;
+    }
+
+    if (responseObject["accountNumber"].toVariant().toLongLong() != accountNumber)
+    {
+        return;
+    }
+
+    // The balance in every event is absolute, missed events need no catching up
+    if (event == "transaction")
+    {
+        ui->label_view_balance_2->setText("Balance: $" + QString::number(responseObject["balance"].toDouble()));
+    }
+    else if (event == "accountDeleted")
+    {
+        ui->label_view_balance_2->setText("Account deleted");
+    }
+}
+
+// Encode a request in the negotiated encoding and send it to the server
+void client::sendRequest(const QJsonObject &requestObject)
+{
+    QByteArray frame = MessageFraming::encode(MessageCodec::encode(requestObject, requestEncoding));
+    if (frame.isEmpty())
+    {
+        qDebug() << "Request is too large to send.";
+        return;
+    }
+    socket->write(frame);
 }
 
 // Slot for handling login button click
 void client::on_pushButton_login_clicked()
 {
-    // Request ID for login
-    quint8 requestId = 0;
     // Get the username and password from the UI
     QString username = ui->lineEdit_Username->text();
     QString password = ui->lineEdit_Password->text();
@@ -128,17 +244,13 @@ void client::on_pushButton_login_clicked()
         return;
     }
 
-    // Construct the request JSON object
-    QJsonObject requestObject;
-    requestObject["requestId"] = static_cast<int>(requestId);
-    requestObject["username"] = username;
-    requestObject["password"] = password;
-
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
+    // Construct the login request
+    BankProtocol::LoginRequest request;
+    request.username = username;
+    request.password = password;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(request));
 }
 
 // Function to handle login response from the server
@@ -173,6 +285,8 @@ void client::handleLoginResponse(const QJsonObject &responseObject)
             ui->tabWidget->setTabEnabled(0, false); // Admin tab
             ui->tabWidget->setTabEnabled(1, true); // User tab
             ui->tabWidget->setCurrentIndex(1);
+            // Balance updates are pushed instead of polled
+            subscribeToAccounts({accountNumber});
         }
     }
     else
@@ -194,6 +308,13 @@ void client::on_pushButton_logout_clicked()
     ui->tabWidget->setTabEnabled(1, false); // Disable User tab
     ui->tabWidget->hide();
     ui->label_account_number_2->clear();
+    subscribeToAccounts({});
+    // The next admin starts from a fresh table
+    ui->tbl_view_database_2->clearContents();
+    ui->tbl_view_database_2->setRowCount(0);
+    userDataRows.clear();
+    userDataVersion = 0;
+    userDataAfterAccount = 0;
 }
 
 void client::on_pushButton_get_account_number_4_clicked()
@@ -204,19 +325,12 @@ void client::on_pushButton_get_account_number_4_clicked()
 
 void client::on_pbn_view_balance_4_clicked()
 {
-    // Request ID for View Account Balance
-    quint8 requestId = 2;
-
-    // Construct the request JSON object
-    QJsonObject requestObject;
-    requestObject["requestId"] = static_cast<int>(requestId);
-    requestObject["accountNumber"] = accountNumber;
-
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
+    // Construct the view balance request
+    BankProtocol::GetBalanceRequest request;
+    request.accountNumber = accountNumber;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(request));
 }
 
 void client::handleViewAccountBalanceResponse(const QJsonObject &responseObject)
@@ -252,20 +366,13 @@ void client::on_pbn_make_trasnaction_2_clicked()
     // Clear any previous error messages
     ui->lbl_transaction_error_2->clear();
 
-    // Request ID for Make Transaction
-    quint8 requestId = 6;
-
-    // Create a JSON object for the transaction request
-    QJsonObject transactionRequest;
-    transactionRequest["requestId"] = static_cast<int>(requestId);
-    transactionRequest["accountNumber"] = accountNumber;
-    transactionRequest["amount"] = amount;
-
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(transactionRequest);
+    // Construct the transaction request
+    BankProtocol::MakeTransactionRequest transactionRequest;
+    transactionRequest.accountNumber = accountNumber;
+    transactionRequest.amount = amount;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(transactionRequest));
     socket->flush();
 }
 
@@ -313,21 +420,14 @@ void client::on_pbn_mk_transfer_2_clicked()
     // Clear any previous error messages
     ui->lbl_mk_trnsf_err_2->clear();
 
-    // Request ID for Make Transfer
-    quint8 requestId = 7; // You can choose any unused ID
-
-    // Create a JSON object for the transfer request
-    QJsonObject transferRequest;
-    transferRequest["requestId"] = static_cast<int>(requestId);
-    transferRequest["fromAccountNumber"] = accountNumber;
-    transferRequest["toAccountNumber"] = toAccountNumber;
-    transferRequest["amount"] = amount;
-
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(transferRequest);
+    // Construct the transfer request
+    BankProtocol::MakeTransferRequest transferRequest;
+    transferRequest.fromAccountNumber = accountNumber;
+    transferRequest.toAccountNumber = toAccountNumber;
+    transferRequest.amount = amount;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(transferRequest));
     socket->flush();
 }
 
@@ -355,19 +455,31 @@ void client::handleMakeTransferResponse(const QJsonObject &responseObject)
 
 void client::on_pbn_view_transaction_histroy_2_clicked()
 {
-    // Request ID for View Transaction History
-    quint8 requestId = 8;
+    // Start over from the newest transaction
+    ui->tbl_view_histroy_transaction_2->clearContents();
+    ui->tbl_view_histroy_transaction_2->setRowCount(0);
+    userHistory = HistoryPaging();
+    userHistory.hasMore = true;
 
-    // Construct the request JSON object
-    QJsonObject requestObject;
-    requestObject["requestId"] = static_cast<int>(requestId);
-    requestObject["accountNumber"] = accountNumber;
+    requestUserHistoryPage();
+}
+
+void client::requestUserHistoryPage()
+{
+    if (!userHistory.hasMore || userHistory.loading)
+    {
+        return;
+    }
+    userHistory.loading = true;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
+    // Construct the transaction history request
+    BankProtocol::TransactionHistoryRequest request;
+    request.accountNumber = accountNumber;
+    request.pageSize = HistoryPageSize;
+    request.cursor = userHistory.cursor;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(request));
 }
 
 void client::handleViewTransactionHistoryResponse(const QJsonObject &responseObject)
@@ -376,11 +488,13 @@ void client::handleViewTransactionHistoryResponse(const QJsonObject &responseObj
 
     bool viewTransactionHistorySuccess = responseObject["viewTransactionHistorySuccess"].toBool();
 
+    // Remember where the next page starts
+    userHistory.loading = false;
+    userHistory.hasMore = viewTransactionHistorySuccess && responseObject["hasMore"].toBool();
+    userHistory.cursor = responseObject["nextCursor"].toString();
+
     if (viewTransactionHistorySuccess)
     {
-        // Clear existing data in tbl_transactionhistory
-        ui->tbl_view_histroy_transaction_2->clearContents();
-        ui->tbl_view_histroy_transaction_2->setRowCount(0);
 
         // Get the transaction history array from the response
         QJsonArray transactionHistoryArray = responseObject["transactionHistory"].toArray();
@@ -388,7 +502,7 @@ void client::handleViewTransactionHistoryResponse(const QJsonObject &responseObj
 
 
         // Populate tbl_transactionhistory with transaction history data
-        int row = 0;
+        int row = ui->tbl_view_histroy_transaction_2->rowCount();
         for (const auto &transactionDataValue : transactionHistoryArray)
         {
             QJsonObject transactionData = transactionDataValue.toObject();
@@ -414,8 +528,6 @@ void client::handleViewTransactionHistoryResponse(const QJsonObject &responseObj
 void client::on_pushButton_get_account_number_2_clicked()
 {
     ui->label_error_2->clear();
-    // Request ID for Get Account Number
-    quint8 requestId = 1;
     // Get the username from the UI
     QString username = ui->lineEdit_username_2->text();
     // Check if Username and Password fields are not empty
@@ -434,16 +546,12 @@ void client::on_pushButton_get_account_number_2_clicked()
         return;
     }
 
-    // Construct the request JSON object
-    QJsonObject requestObject;
-    requestObject["requestId"] = static_cast<int>(requestId);
-    requestObject["username"] = username;
-
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
+    // Construct the get account number request
+    BankProtocol::GetAccountNumberRequest request;
+    request.username = username;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(request));
 }
 
 void client::handleGetAccountNumberResponse(const QJsonObject &responseObject)
@@ -470,21 +578,15 @@ void client::handleGetAccountNumberResponse(const QJsonObject &responseObject)
 void client::on_pbn_view_balance_2_clicked()
 {
     ui->label_error_viewbalance_2->clear();
-    // Request ID for View Account Balance
-    quint8 requestId = 10;
     // Get the account number from the UI
     qint64 accountNumber = ui->lnedit_accountnumber_2->text().toLongLong();
 
-    // Construct the request JSON object
-    QJsonObject requestObject;
-    requestObject["requestId"] = static_cast<int>(requestId);
-    requestObject["accountNumber"] = accountNumber;
-
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
+    // Construct the view balance request
+    BankProtocol::AdminGetBalanceRequest request;
+    request.accountNumber = accountNumber;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(request));
 }
 
 void client::adminHandleViewAccountBalanceResponse(const QJsonObject &responseObject)
@@ -513,9 +615,6 @@ void client::on_pbn_create_new_account_2_clicked()
 {
     ui->lbl_error_create_2->clear();
 
-    // Request ID for Create Account
-    quint8 requestId = 3;
-
     // Get the necessary information from the UI
     QString username = ui->lnedit_username_input_2->text();
     QString password = ui->lnedit_password_input_2->text();
@@ -557,20 +656,16 @@ void client::on_pbn_create_new_account_2_clicked()
         return;
     }
 
-    // Construct the request JSON object
-    QJsonObject requestObject;
-    requestObject["requestId"] = static_cast<int>(requestId);
-    requestObject["username"] = username;
-    requestObject["password"] = password;
-    requestObject["name"] = name;
-    requestObject["age"] = age;
-    requestObject["isAdmin"] = isAdmin;
-
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
+    // Construct the create account request
+    BankProtocol::CreateAccountRequest request;
+    request.username = username;
+    request.password = password;
+    request.name = name;
+    request.age = age;
+    request.isAdmin = isAdmin;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(request));
 
 }
 
@@ -602,19 +697,18 @@ void client::handleCreateNewAccountResponse(const QJsonObject &responseObject)
 void client::on_pbn_view_database_2_clicked()
 {
     ui->lbl_view_database_error_2->clear();
+    requestUserDataChanges();
+}
 
-    // Request ID for Fetch All User Data
-    quint8 requestId = 5;
-
-    // Construct the request JSON object
-    QJsonObject requestObject;
-    requestObject["requestId"] = static_cast<int>(requestId);
-
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
+void client::requestUserDataChanges()
+{
+    // Only rows changed since the last load come back, the first load gets them all
+    BankProtocol::FetchUserDataChangesRequest request;
+    request.sinceVersion = userDataVersion;
+    request.afterAccountNumber = userDataAfterAccount;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(request));
 }
 
 void client::handleFetchAllUserDataResponse(const QJsonObject &responseObject)
@@ -625,25 +719,28 @@ void client::handleFetchAllUserDataResponse(const QJsonObject &responseObject)
 
     if (fetchUserDataSuccess)
     {
-        // Clear existing data in tbl_view_database
-        ui->tbl_view_database_2->clearContents();
-        ui->tbl_view_database_2->setRowCount(0);
+        // Clear existing data in tbl_view_database, later chunks only append
+        if (responseObject["chunk"].toInt() == 0)
+        {
+            ui->tbl_view_database_2->clearContents();
+            ui->tbl_view_database_2->setRowCount(0);
+            userDataRows.clear();
+            // A full load isn't tied to a change version
+            userDataVersion = 0;
+        }
 
         // Get the user data array from the response
         QJsonArray userDataArray = responseObject["userData"].toArray();
 
         // Populate tbl_view_database with user data
-        int row = 0;
+        int row = ui->tbl_view_database_2->rowCount();
         for (const auto &userDataValue : userDataArray)
         {
             QJsonObject userData = userDataValue.toObject();
 
             ui->tbl_view_database_2->insertRow(row);
-            ui->tbl_view_database_2->setItem(row, 0, new QTableWidgetItem(QString::number(userData["AccountNumber"].toInt())));
-            ui->tbl_view_database_2->setItem(row, 1, new QTableWidgetItem(userData["Username"].toString()));
-            ui->tbl_view_database_2->setItem(row, 2, new QTableWidgetItem(userData["Name"].toString()));
-            ui->tbl_view_database_2->setItem(row, 3, new QTableWidgetItem(QString::number(userData["Balance"].toDouble())));
-            ui->tbl_view_database_2->setItem(row, 4, new QTableWidgetItem(QString::number(userData["Age"].toInt())));
+            setUserDataRow(row, userData);
+            userDataRows.insert(userData["AccountNumber"].toVariant().toLongLong(), row);
 
             // Debugging statements
             qDebug() << "AccountNumber:" << QString::number(userData["AccountNumber"].toInt());
@@ -662,6 +759,114 @@ void client::handleFetchAllUserDataResponse(const QJsonObject &responseObject)
     }
 }
 
+// Function to apply the changed and deleted rows to the user data table
+void client::handleUserDataChangesResponse(const QJsonObject &responseObject)
+{
+    ui->label_error_2->clear();
+
+    if (!responseObject["fetchUserDataChangesSuccess"].toBool())
+    {
+        ui->label_error_2->setText("Failed to fetch user data.");
+        qDebug() << "Failed to fetch user data changes.";
+        return;
+    }
+
+    const QJsonArray userDataArray = responseObject["userData"].toArray();
+
+    // The first page of the first load replaces the rows in one go without
+    // looking any of them up
+    if (userDataVersion == 0 && userDataAfterAccount == 0)
+    {
+        ui->tbl_view_database_2->clearContents();
+        ui->tbl_view_database_2->setRowCount(userDataArray.size());
+        userDataRows.clear();
+        userDataRows.reserve(userDataArray.size());
+        for (int row = 0; row < userDataArray.size(); ++row)
+        {
+            const QJsonObject userData = userDataArray.at(row).toObject();
+            setUserDataRow(row, userData);
+            userDataRows.insert(userData["AccountNumber"].toVariant().toLongLong(), row);
+        }
+    }
+    else
+    {
+        applyUserDataChanges(responseObject["deleted"].toArray(), userDataArray);
+    }
+
+    userDataVersion = responseObject["version"].toVariant().toLongLong();
+    userDataAfterAccount = responseObject["afterAccountNumber"].toVariant().toLongLong();
+    if (responseObject["hasMore"].toBool())
+    {
+        requestUserDataChanges();
+    }
+}
+
+// Remove the deleted rows, then update the changed ones or add them
+void client::applyUserDataChanges(const QJsonArray &deletedArray, const QJsonArray &userDataArray)
+{
+    bool removed = false;
+    for (const auto &deletedValue : deletedArray)
+    {
+        int row = findUserDataRow(deletedValue.toVariant().toLongLong());
+        if (row >= 0)
+        {
+            ui->tbl_view_database_2->removeRow(row);
+            removed = true;
+        }
+    }
+    // The rows below a removed one moved up
+    if (removed)
+    {
+        indexUserDataRows();
+    }
+
+    for (const auto &userDataValue : userDataArray)
+    {
+        QJsonObject userData = userDataValue.toObject();
+        const qint64 rowAccountNumber = userData["AccountNumber"].toVariant().toLongLong();
+
+        // Update the row in place, or add it if the account is new
+        int row = findUserDataRow(rowAccountNumber);
+        if (row < 0)
+        {
+            row = ui->tbl_view_database_2->rowCount();
+            ui->tbl_view_database_2->insertRow(row);
+            userDataRows.insert(rowAccountNumber, row);
+        }
+        setUserDataRow(row, userData);
+    }
+}
+
+void client::setUserDataRow(int row, const QJsonObject &userData)
+{
+    ui->tbl_view_database_2->setItem(row, 0, new QTableWidgetItem(QString::number(userData["AccountNumber"].toVariant().toLongLong())));
+    ui->tbl_view_database_2->setItem(row, 1, new QTableWidgetItem(userData["Username"].toString()));
+    ui->tbl_view_database_2->setItem(row, 2, new QTableWidgetItem(userData["Name"].toString()));
+    ui->tbl_view_database_2->setItem(row, 3, new QTableWidgetItem(QString::number(userData["Balance"].toDouble())));
+    ui->tbl_view_database_2->setItem(row, 4, new QTableWidgetItem(QString::number(userData["Age"].toInt())));
+}
+
+// Row of an account in the user data table, -1 if it isn't shown
+int client::findUserDataRow(qint64 accountNumber) const
+{
+    return userDataRows.value(accountNumber, -1);
+}
+
+// Rebuild the account to row index from the table
+void client::indexUserDataRows()
+{
+    userDataRows.clear();
+    userDataRows.reserve(ui->tbl_view_database_2->rowCount());
+    for (int row = 0; row < ui->tbl_view_database_2->rowCount(); ++row)
+    {
+        QTableWidgetItem *item = ui->tbl_view_database_2->item(row, 0);
+        if (item != nullptr)
+        {
+            userDataRows.insert(item->text().toLongLong(), row);
+        }
+    }
+}
+
 void client::on_pbn_view_transaction_history_2_clicked()
 {
 
@@ -678,19 +883,32 @@ void client::on_pbn_view_transaction_history_2_clicked()
     // Clear any previous error messages
     ui->lbl_err_transaction_history_2->clear();
 
-    // Request ID for View Transaction History
-    quint8 requestId = 11;
+    // Start over from the newest transaction
+    ui->tbl_transaction_history_2->clearContents();
+    ui->tbl_transaction_history_2->setRowCount(0);
+    adminHistory = HistoryPaging();
+    adminHistory.accountNumber = accountNumber;
+    adminHistory.hasMore = true;
+
+    requestAdminHistoryPage();
+}
 
-    // Construct the request JSON object
-    QJsonObject requestObject;
-    requestObject["requestId"] = static_cast<int>(requestId);
-    requestObject["accountNumber"] = accountNumber;
+void client::requestAdminHistoryPage()
+{
+    if (!adminHistory.hasMore || adminHistory.loading)
+    {
+        return;
+    }
+    adminHistory.loading = true;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
+    // Construct the transaction history request
+    BankProtocol::AdminTransactionHistoryRequest request;
+    request.accountNumber = adminHistory.accountNumber;
+    request.pageSize = HistoryPageSize;
+    request.cursor = adminHistory.cursor;
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    sendRequest(BankProtocol::encode(request));
 }
 
 void client::adminHandleViewTransactionHistoryResponse(const QJsonObject &responseObject)
@@ -699,18 +917,20 @@ void client::adminHandleViewTransactionHistoryResponse(const QJsonObject &respon
 
     bool viewTransactionHistorySuccess = responseObject["viewTransactionHistorySuccess"].toBool();
 
+    // Remember where the next page starts
+    adminHistory.loading = false;
+    adminHistory.hasMore = viewTransactionHistorySuccess && responseObject["hasMore"].toBool();
+    adminHistory.cursor = responseObject["nextCursor"].toString();
+
     if (viewTransactionHistorySuccess)
     {
-        // Clear existing data in tbl_transaction_history
-        ui->tbl_transaction_history_2->clearContents();
-        ui->tbl_transaction_history_2->setRowCount(0);
 
         // Get the transaction history array from the response
         QJsonArray transactionHistoryArray = responseObject["transactionHistory"].toArray();
 
 
         // Populate tbl_transaction_history with transaction history data
-        int row = 0;
+        int row = ui->tbl_transaction_history_2->rowCount();
         for (const auto &transactionDataValue : transactionHistoryArray)
         {
             QJsonObject transactionData = transactionDataValue.toObject();
@@ -9,8 +9,13 @@
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonParseError>
+#include <QHash>
 #include <QDebug>
 
+#include "messageframing.h"
+#include "messagecodec.h"
+#include "bankprotocol.h"
+
 namespace Ui
 {
     class client;
@@ -26,6 +31,7 @@ public:
 
 public slots:
     void readyRead();
+    void sendHello();
 
 private slots:
     void on_pushButton_login_clicked();
@@ -55,11 +61,40 @@ private slots:
 private:
     Ui::client *ui;
     QTcpSocket *socket;
+    FrameDecoder responseDecoder;
+    // JSON until the server agreed to something else in its hello response
+    MessageCodec::Encoding requestEncoding = MessageCodec::Encoding::Json;
     qint64 accountNumber;
 
+    // Keyset paging state of a transaction history table
+    struct HistoryPaging
+    {
+        qint64 accountNumber = 0;
+        QString cursor;
+        bool hasMore = false;
+        bool loading = false;
+    };
+    static const int HistoryPageSize = 100;
+    HistoryPaging userHistory;
+    HistoryPaging adminHistory;
+    // Change version the admin user data table is up to date with, 0 before the first load
+    qint64 userDataVersion = 0;
+    // Set while the changes come in pages, the last account of the page before
+    qint64 userDataAfterAccount = 0;
+    // Row of each account in the user data table
+    QHash<qint64, int> userDataRows;
+
     static const QRegularExpression usernameRegex;
     static const QRegularExpression passwordRegex;
 
+    void sendRequest(const QJsonObject &requestObject);
+    void requestUserHistoryPage();
+    void requestAdminHistoryPage();
+    void requestUserDataChanges();
+    void subscribeToAccounts(const QList<qint64> &accountNumbers);
+    void handleResponse(const QJsonObject &responseObject);
+    void handleHelloResponse(const QJsonObject &responseObject);
+    void handleAccountEvent(const QJsonObject &responseObject);
     void handleLoginResponse(const QJsonObject &responseObject);
     void handleViewAccountBalanceResponse(const QJsonObject &responseObject);
     void handleMakeTransactionResponse(const QJsonObject &responseObject);
@@ -70,6 +105,11 @@ private:
     void handleCreateNewAccountResponse(const QJsonObject &responseObject);
     void handleDeleteAccountResponse(const QJsonObject &responseObject);
     void handleFetchAllUserDataResponse(const QJsonObject &responseObject);
+    void handleUserDataChangesResponse(const QJsonObject &responseObject);
+    void applyUserDataChanges(const QJsonArray &deletedArray, const QJsonArray &userDataArray);
+    void setUserDataRow(int row, const QJsonObject &userData);
+    int findUserDataRow(qint64 accountNumber) const;
+    void indexUserDataRows();
     void adminHandleViewTransactionHistoryResponse(const QJsonObject &responseObject);
     void handleUpdateAccountResponse(const QJsonObject &responseObject);
 };
@@ -4,15 +4,22 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++17 static
 
+INCLUDEPATH += ../Common
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    ../Common/messagecodec.cpp \
+    ../Common/messageframing.cpp \
     main.cpp \
     client.cpp
 
 HEADERS += \
+    ../Common/bankprotocol.h \
+    ../Common/messagecodec.h \
+    ../Common/messageframing.h \
     client.h
 
 FORMS += \
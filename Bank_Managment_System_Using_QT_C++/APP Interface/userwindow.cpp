@@ -21,33 +21,33 @@ UserWindow::~UserWindow()
 
 void UserWindow::readyRead()
 {
-    // read data from socket
-    responseData.append(socket->readAll());
+    // Buffer what arrived, a large response can span many reads
+    responseDecoder.append(socket->readAll());
 
-    // Check if we have a complete message (newline delimited) only happens when receiving a very large response
-    if (!responseData.endsWith('\n'))
+    QByteArray responseData;
+    while (responseDecoder.takeFrame(responseData))
     {
-        return;  // If not, return and wait for more data
-    }
-
-    // Try to parse the JSON document
-    QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
+        QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
 
-    // if we get here hooray :D its a kinda valid json after a ton of buffering maybe
-    responseData.clear();
+        // Check if the response is a valid JSON object
+        if (!jsonResponse.isObject())
+        {
+            qDebug() << "Invalid JSON response from the server.";
+            continue;
+        }
 
-    //qDebug() << "Raw Response Data:" << responseData;
+        handleResponse(jsonResponse.object());
+    }
 
-    // Check if the response is a valid JSON object
-    if (!jsonResponse.isObject())
+    if (responseDecoder.hasError())
     {
-        qDebug() << "Invalid JSON response from the server.";
-        return;
+        qDebug() << "Malformed frame from the server, closing the connection.";
+        socket->abort();
     }
+}
 
-     //qDebug() << "Raw Response Data:" << responseData;
-
-    QJsonObject responseObject = jsonResponse.object();
+void UserWindow::handleResponse(const QJsonObject &responseObject)
+{
     int responseId = responseObject["responseId"].toInt();
 
     switch (responseId)
@@ -70,7 +70,6 @@ void UserWindow::readyRead()
         qDebug() << "Unknown responseId ID: " << responseId;
         break;
     }
-    //qDebug() << responseData;
 }
 
 void UserWindow::on_pbn_view_balance_clicked()
@@ -87,7 +86,7 @@ void UserWindow::on_pbn_view_balance_clicked()
     QJsonDocument jsonRequest(requestObject);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
 }
 
 void UserWindow::handleViewAccountBalanceResponse(const QJsonObject &responseObject)
@@ -136,7 +135,7 @@ void UserWindow::on_pbn_make_trasnaction_clicked()
     QJsonDocument jsonRequest(transactionRequest);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
     socket->flush();
 }
 
@@ -197,7 +196,7 @@ void UserWindow::on_pbn_mk_transfer_clicked()
     QJsonDocument jsonRequest(transferRequest);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
     socket->flush();
 }
 
@@ -236,7 +235,7 @@ void UserWindow::on_pbn_view_transaction_histroy_clicked()
     QJsonDocument jsonRequest(requestObject);
 
     // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    socket->write(MessageFraming::encode(jsonRequest.toJson()));
 }
 
 void UserWindow::handleViewTransactionHistoryResponse(const QJsonObject &responseObject)
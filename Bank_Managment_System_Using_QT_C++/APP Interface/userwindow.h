@@ -38,8 +38,9 @@ private:
     Ui::UserWindow *ui;
     QTcpSocket *socket;
     qint64 accountNumber;
-    QByteArray responseData;
+    FrameDecoder responseDecoder;
 
+    void handleResponse(const QJsonObject &responseObject);
     void handleViewAccountBalanceResponse(const QJsonObject &responseObject);
     void handleMakeTransactionResponse(const QJsonObject &responseObject);
     void handleMakeTransferResponse(const QJsonObject &responseObject);
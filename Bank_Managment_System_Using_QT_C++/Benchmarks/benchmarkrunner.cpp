@@ -0,0 +1,134 @@
+#include "benchmarkrunner.h"
+#include "querytimer.h"
+#include "servermetrics.h"
+
+#include <QTextStream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Every heap allocation of the process goes through here
+static std::atomic<quint64> allocations{0};
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size == 0 ? 1 : size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+// Warmup runs at most this many times, enough to fill the caches and the statement cache
+static const int MaxWarmupIterations = 100;
+
+BenchmarkRunner::BenchmarkRunner(int iterations, const QString &filter)
+    : iterations(iterations), filter(filter)
+{}
+
+bool BenchmarkRunner::selected(const QString &name) const
+{
+    return filter.isEmpty() || name.contains(filter, Qt::CaseInsensitive);
+}
+
+quint64 BenchmarkRunner::allocationCount()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+quint64 BenchmarkRunner::statementCount()
+{
+    quint64 count = 0;
+    for (const QueryTimer::StatementStats &stats : QueryTimer::statementStats())
+    {
+        count += stats.count;
+    }
+    return count;
+}
+
+void BenchmarkRunner::run(const QString &name, const std::function<void(int)> &body, bool warmup)
+{
+    run(name, iterations, body, warmup);
+}
+
+void BenchmarkRunner::run(const QString &name, int count, const std::function<void(int)> &body, bool warmup)
+{
+    if (!selected(name) || count < 1)
+    {
+        return;
+    }
+
+    if (warmup)
+    {
+        const int warmupIterations = qMin(count, MaxWarmupIterations);
+        for (int i = 1; i <= warmupIterations; ++i)
+        {
+            body(-i);
+        }
+    }
+
+    // The counters are read outside the timed loop, their own cost isn't measured
+    const quint64 statementsBefore = statementCount();
+    const quint64 allocationsBefore = allocationCount();
+    const qint64 startNs = ServerMetrics::nowNs();
+    for (int i = 0; i < count; ++i)
+    {
+        body(i);
+    }
+    const qint64 elapsedNs = ServerMetrics::nowNs() - startNs;
+    const quint64 allocationsAfter = allocationCount();
+    const quint64 statementsAfter = statementCount();
+
+    Result result;
+    result.name = name;
+    result.iterations = count;
+    result.nsPerOp = static_cast<double>(elapsedNs) / count;
+    result.allocationsPerOp = static_cast<double>(allocationsAfter - allocationsBefore) / count;
+    result.statementsPerOp = static_cast<double>(statementsAfter - statementsBefore) / count;
+    measured.append(result);
+
+    QTextStream(stdout) << QString("%1 %2 %3 %4 %5")
+                               .arg(name, -40).arg(count, 10)
+                               .arg(result.nsPerOp, 12, 'f', 0)
+                               .arg(result.allocationsPerOp, 10, 'f', 1)
+                               .arg(result.statementsPerOp, 12, 'f', 2) << Qt::endl;
+}
+
+void BenchmarkRunner::printSection(const QString &title)
+{
+    QTextStream(stdout) << Qt::endl << title << Qt::endl
+                        << QString("%1 %2 %3 %4 %5")
+                               .arg("benchmark", -40).arg("iterations", 10).arg("ns/op", 12)
+                               .arg("allocs/op", 10).arg("stmts/op", 12) << Qt::endl;
+}
+
+const QVector<BenchmarkRunner::Result> &BenchmarkRunner::results() const
+{
+    return measured;
+}
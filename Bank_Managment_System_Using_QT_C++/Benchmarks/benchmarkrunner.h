@@ -0,0 +1,45 @@
+#ifndef BENCHMARKRUNNER_H
+#define BENCHMARKRUNNER_H
+
+#include <QString>
+#include <QVector>
+#include <functional>
+
+// Runs a benchmark body a fixed number of times and keeps per-operation
+// averages of wall time, heap allocations (every operator new of the
+// process, other threads included) and SQLite statements run by the
+// DatabaseManager, as counted by the QueryTimer.
+class BenchmarkRunner
+{
+public:
+    struct Result
+    {
+        QString name;
+        int iterations;
+        double nsPerOp;
+        double allocationsPerOp;
+        double statementsPerOp;
+    };
+
+    // Only benchmarks whose name contains filter run, all if it is empty
+    BenchmarkRunner(int iterations, const QString &filter);
+
+    bool selected(const QString &name) const;
+    // body gets the iteration index; warmup runs it with negative indexes first
+    void run(const QString &name, const std::function<void(int)> &body, bool warmup = true);
+    // Same with its own iteration count, for bodies that consume state
+    void run(const QString &name, int iterations, const std::function<void(int)> &body, bool warmup = true);
+    void printSection(const QString &title);
+    const QVector<Result> &results() const;
+
+    static quint64 allocationCount();
+
+private:
+    int iterations;
+    QString filter;
+    QVector<Result> measured;
+
+    static quint64 statementCount();
+};
+
+#endif // BENCHMARKRUNNER_H
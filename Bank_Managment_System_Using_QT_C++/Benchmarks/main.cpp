@@ -0,0 +1,120 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QFile>
+#include <QDir>
+#include "serverbench.h"
+#include "databaseconnectionpool.h"
+#include "ledgerwriter.h"
+#include "notificationhub.h"
+
+// Settings of the benchmark run, read by ServerConfig from the working directory
+static bool writeServerConfig()
+{
+    QFile file("server.ini");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        return false;
+    }
+    QTextStream(&file) << "[ledger]\n"
+                          "; One request at a time, waiting out the batch window would dominate every write\n"
+                          "batchWindowUs=0\n"
+                          "[log]\n"
+                          "console=false\n"
+                          "[sql]\n"
+                          "slowQueryMs=0\n"
+                          "[stats]\n"
+                          "intervalSeconds=0\n"
+                          "metricsPort=0\n";
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("serverbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("In-process benchmarks of the bank server against a temporary database. "
+                                     "Reports ns, heap allocations and SQLite statements per operation.");
+    parser.addHelpOption();
+
+    const BenchOptions defaults;
+    const QCommandLineOption accountsOption("accounts", "Accounts in the database.", "count",
+                                            QString::number(defaults.accounts));
+    const QCommandLineOption historyOption("history", "Transactions per account.", "count",
+                                           QString::number(defaults.historyPerAccount));
+    const QCommandLineOption iterationsOption({"n", "iterations"}, "Measured iterations per benchmark.", "count",
+                                              QString::number(defaults.iterations));
+    const QCommandLineOption historyRowsOption("history-rows", "Largest Transaction_History of the history "
+                                               "scaling benchmarks.", "count",
+                                               QString::number(defaults.historyTableRows));
+    const QCommandLineOption filterOption("filter", "Only benchmarks whose name contains this text.", "text");
+    parser.addOptions({accountsOption, historyOption, iterationsOption, historyRowsOption, filterOption});
+    parser.process(a);
+
+    BenchOptions options;
+    options.accounts = parser.value(accountsOption).toInt();
+    options.historyPerAccount = parser.value(historyOption).toInt();
+    options.iterations = parser.value(iterationsOption).toInt();
+    options.historyTableRows = parser.value(historyRowsOption).toInt();
+    options.filter = parser.value(filterOption);
+
+    QTextStream errors(stderr);
+    if (options.accounts < 2 || options.historyPerAccount < 1 || options.iterations < 1)
+    {
+        errors << "Invalid options, see --help" << Qt::endl;
+        return 2;
+    }
+
+    // The server keeps its database, log and settings in the working directory
+    QTemporaryDir directory;
+    if (!directory.isValid() || !QDir::setCurrent(directory.path()) || !writeServerConfig())
+    {
+        errors << "Failed to set up the temporary directory" << Qt::endl;
+        return 1;
+    }
+
+    {
+        DatabaseManager initializer("InitializeDatabase");
+        if (!initializer.initializeDatabase())
+        {
+            errors << "Failed to create the database" << Qt::endl;
+            return 1;
+        }
+    }
+
+    NotificationHub::instance().start();
+    LedgerWriter::instance().start();
+
+    int exitCode = 0;
+    {
+        ServerBench bench(options);
+        if (bench.seed())
+        {
+            bench.runDatabaseManager();
+            bench.runRequestHandler();
+            bench.runCodec();
+            bench.runLogger();
+            bench.runPragmas();
+            bench.runHistoryScaling();
+            if (!bench.allSucceeded())
+            {
+                exitCode = 1;
+            }
+        }
+        else
+        {
+            exitCode = 1;
+        }
+    }
+
+    LedgerWriter::instance().stop();
+    NotificationHub::instance().stop();
+    DatabaseConnectionPool::instance().releaseThreadConnection();
+
+    // Back out of the directory before it is removed
+    QDir::setCurrent(QCoreApplication::applicationDirPath());
+    return exitCode;
+}
@@ -0,0 +1,1009 @@
+#include "serverbench.h"
+#include "requesthandler.h"
+#include "messagecodec.h"
+#include "messageframing.h"
+#include "servermetrics.h"
+#include "serverconfig.h"
+#include "logger.h"
+#include "querytimer.h"
+#include "synccountingvfs.h"
+#include "resultstream.h"
+
+#include <QTextStream>
+#include <QThread>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+static const char *const accountPassword = "bench";
+static const double seedBalance = 1000000.0;
+static const int historyPageSize = 50;
+// Warmup iterations per benchmark, as in the BenchmarkRunner
+static const int warmupIterations = 100;
+
+// Names of the codec samples, indexed by request ID
+static const char *const requestNames[] =
+{
+    "login", "getAccountNumber", "getBalance", "createAccount", "deleteAccount", "fetchAllUserData",
+    "makeTransaction", "makeTransfer", "transactionHistory", "updateUserData", "adminGetBalance",
+    "adminTransactionHistory", "hello", "batch", "subscribe", "fetchUserDataChanges", "metrics", "traceDump"
+};
+static_assert(sizeof(requestNames) / sizeof(requestNames[0]) == BankProtocol::RequestCount,
+              "One name per request ID");
+
+// The [database] settings compared by runPragmas
+struct PragmaConfig
+{
+    const char *name;
+    const char *journalMode;
+    const char *synchronous;
+    int cacheSize;
+    qint64 mmapSize;
+};
+
+static const PragmaConfig pragmaConfigs[] =
+{
+    // SQLite's own defaults, what the server ran with before
+    {"DELETE,FULL", "DELETE", "FULL", -2000, 0},
+    {"WAL,FULL", "WAL", "FULL", -16000, 256LL * 1024 * 1024},
+    // The server's defaults
+    {"WAL,NORMAL", "WAL", "NORMAL", -16000, 256LL * 1024 * 1024},
+    {"WAL,NORMAL,no mmap", "WAL", "NORMAL", -16000, 0},
+    {"WAL,OFF", "WAL", "OFF", -16000, 256LL * 1024 * 1024}
+};
+
+ServerBench::ServerBench(const BenchOptions &options)
+    : options(options), runner(options.iterations, options.filter), databaseManager("Benchmark")
+{}
+
+ServerBench::~ServerBench()
+{
+    databaseManager.closeConnection();
+}
+
+bool ServerBench::seed()
+{
+    QTextStream out(stdout);
+    if (!databaseManager.openConnection() || !databaseManager.beginBatch())
+    {
+        out << "Failed to open the benchmark database" << Qt::endl;
+        return false;
+    }
+
+    const qint64 startNs = ServerMetrics::nowNs();
+    for (int i = 0; i < options.accounts; ++i)
+    {
+        BankProtocol::CreateAccountRequest request;
+        request.username = QString("bench_%1").arg(i);
+        request.password = accountPassword;
+        request.name = QString("Bench %1").arg(i);
+        request.age = 18 + i % 80;
+        const QJsonObject response = databaseManager.processRequest(BankProtocol::encode(request));
+        if (!response["createAccountSuccess"].toBool())
+        {
+            out << "Failed to create " << request.username << ": " << response["errorMessage"].toString() << Qt::endl;
+            databaseManager.rollbackBatch();
+            return false;
+        }
+        accounts.append({request.username, response["accountNumber"].toInteger()});
+    }
+
+    // A deposit to start from, then alternating withdrawals and deposits
+    for (const auto &seeded : accounts)
+    {
+        for (int i = 0; i < options.historyPerAccount; ++i)
+        {
+            BankProtocol::MakeTransactionRequest request;
+            request.accountNumber = seeded.second;
+            request.amount = i == 0 ? seedBalance : (i % 2 == 0 ? 5.0 : -5.0);
+            databaseManager.processRequest(BankProtocol::encode(request));
+        }
+    }
+
+    if (!databaseManager.commitBatch())
+    {
+        out << "Failed to commit the seeded accounts" << Qt::endl;
+        return false;
+    }
+    databaseManager.takeAccountEvents();
+
+    // Polling with the latest version is the common case of the delta sync
+    BankProtocol::FetchUserDataChangesRequest changes;
+    QJsonObject changesResponse;
+    do
+    {
+        changesResponse = databaseManager.processRequest(BankProtocol::encode(changes));
+        changes.sinceVersion = changesResponse["version"].toInteger();
+        changes.afterAccountNumber = changesResponse["afterAccountNumber"].toInteger();
+    } while (changesResponse["hasMore"].toBool());
+    userDataVersion = changes.sinceVersion;
+
+    out << "Seeded " << options.accounts << " accounts with " << options.historyPerAccount
+        << " transactions each in " << (ServerMetrics::nowNs() - startNs) / 1000000 << " ms" << Qt::endl;
+    return true;
+}
+
+const QPair<QString, qint64> &ServerBench::account(int iteration) const
+{
+    return accounts[iteration % accounts.size()];
+}
+
+QJsonObject ServerBench::buildRequest(BankProtocol::RequestId id, int iteration)
+{
+    using BankProtocol::RequestId;
+
+    switch (id)
+    {
+    case RequestId::Login:
+    {
+        BankProtocol::LoginRequest request;
+        request.username = account(iteration).first;
+        request.password = accountPassword;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::GetAccountNumber:
+    {
+        BankProtocol::GetAccountNumberRequest request;
+        request.username = account(iteration).first;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::GetBalance:
+    {
+        BankProtocol::GetBalanceRequest request;
+        request.accountNumber = account(iteration).second;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::CreateAccount:
+    {
+        BankProtocol::CreateAccountRequest request;
+        request.username = QString("bench_new_%1").arg(createdSerial++);
+        request.password = accountPassword;
+        request.name = "Bench new";
+        request.age = 30;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::DeleteAccount:
+    {
+        BankProtocol::DeleteAccountRequest request;
+        request.accountNumber = createdAccounts.value(iteration);
+        return BankProtocol::encode(request);
+    }
+    case RequestId::FetchAllUserData:
+        return BankProtocol::encode(BankProtocol::FetchAllUserDataRequest());
+    case RequestId::MakeTransaction:
+    {
+        // Deposits and withdrawals cancel out over the run
+        BankProtocol::MakeTransactionRequest request;
+        request.accountNumber = account(iteration).second;
+        request.amount = iteration % 2 == 0 ? 1.0 : -1.0;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::MakeTransfer:
+    {
+        BankProtocol::MakeTransferRequest request;
+        request.fromAccountNumber = account(iteration).second;
+        request.toAccountNumber = account(iteration + 1).second;
+        request.amount = 1.0;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::TransactionHistory:
+    case RequestId::AdminTransactionHistory:
+    {
+        BankProtocol::TransactionHistoryRequest request;
+        request.accountNumber = account(iteration).second;
+        request.pageSize = historyPageSize;
+        QJsonObject json = BankProtocol::encode(request);
+        json["requestId"] = static_cast<int>(id);
+        return json;
+    }
+    case RequestId::UpdateUserData:
+    {
+        BankProtocol::UpdateUserDataRequest request;
+        request.username = account(iteration).first;
+        request.name = QString("Bench %1").arg(iteration);
+        request.password = accountPassword;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::AdminGetBalance:
+    {
+        BankProtocol::AdminGetBalanceRequest request;
+        request.accountNumber = account(iteration).second;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::FetchUserDataChanges:
+    {
+        BankProtocol::FetchUserDataChangesRequest request;
+        request.sinceVersion = userDataVersion;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::Hello:
+    {
+        BankProtocol::HelloRequest request;
+        request.encodings = MessageCodec::supportedEncodings();
+        request.compression = QStringList{MessageFraming::CompressionName};
+        return BankProtocol::encode(request);
+    }
+    case RequestId::Batch:
+    {
+        BankProtocol::BatchRequest request;
+        request.requests.append(buildRequest(RequestId::MakeTransfer, iteration));
+        request.requests.append(buildRequest(RequestId::MakeTransfer, iteration + 1));
+        return BankProtocol::encode(request);
+    }
+    case RequestId::Subscribe:
+    {
+        BankProtocol::SubscribeRequest request;
+        request.accountNumbers = {account(iteration).second, account(iteration + 1).second};
+        return BankProtocol::encode(request);
+    }
+    case RequestId::Metrics:
+        return BankProtocol::encode(BankProtocol::MetricsRequest());
+    case RequestId::TraceDump:
+        return BankProtocol::encode(BankProtocol::TraceDumpRequest());
+    default:
+        break;
+    }
+    return QJsonObject();
+}
+
+int ServerBench::requestIndex(int iteration, int count)
+{
+    // Warmup iterations are numbered -1, -2, ... and come after the measured ones
+    return iteration >= 0 ? iteration : count - iteration - 1;
+}
+
+QVector<QJsonObject> ServerBench::prepareRequests(BankProtocol::RequestId id, int count, bool warmup,
+                                                  const std::function<void(QJsonObject &)> &adjust)
+{
+    const int total = count + (warmup ? qMin(count, warmupIterations) : 0);
+    QVector<QJsonObject> requests;
+    requests.reserve(total);
+    for (int i = 0; i < total; ++i)
+    {
+        QJsonObject request = buildRequest(id, i);
+        if (adjust)
+        {
+            adjust(request);
+        }
+        requests.append(request);
+    }
+    return requests;
+}
+
+void ServerBench::benchDatabase(const QString &name, BankProtocol::RequestId id,
+                                const std::function<void(QJsonObject &)> &adjust)
+{
+    const QString fullName = "db/" + name;
+    if (!runner.selected(fullName))
+    {
+        return;
+    }
+
+    // Creates and deletes change what later iterations can do, they aren't warmed up
+    const bool createsOrDeletes = id == BankProtocol::RequestId::CreateAccount
+                                  || id == BankProtocol::RequestId::DeleteAccount;
+    const int count = id == BankProtocol::RequestId::DeleteAccount ? createdAccounts.size() : options.iterations;
+    const QVector<QJsonObject> requests = prepareRequests(id, count, !createsOrDeletes, adjust);
+
+    QJsonObject lastResponse;
+    runner.run(fullName, count, [&](int iteration)
+    {
+        lastResponse = databaseManager.processRequest(requests[requestIndex(iteration, count)]);
+        sink += lastResponse.size();
+        if (id == BankProtocol::RequestId::CreateAccount)
+        {
+            createdAccounts.append(lastResponse["accountNumber"].toInteger());
+        }
+    }, !createsOrDeletes);
+
+    if (id == BankProtocol::RequestId::DeleteAccount)
+    {
+        createdAccounts.clear();
+    }
+    if (!requests.isEmpty())
+    {
+        checkSucceeded(fullName, id, lastResponse);
+    }
+    // Writes outside a batch leave their events behind, nobody publishes them here
+    databaseManager.takeAccountEvents();
+}
+
+void ServerBench::connectHandler(RequestHandler &handler)
+{
+    QObject::connect(&handler, &RequestHandler::responseReady, &handler,
+                     [this](quint64 requestSequence, QByteArray responseData)
+                     {
+                         if (requestSequence != awaitedSequence)
+                         {
+                             return;
+                         }
+                         handlerResponse = responseData;
+                         if (waitLoop != nullptr)
+                         {
+                             waitLoop->quit();
+                         }
+                     });
+}
+
+QByteArray ServerBench::handle(RequestHandler &handler, const QByteArray &requestData)
+{
+    awaitedSequence = nextSequence++;
+    handlerResponse.clear();
+    handler.handleRequest(awaitedSequence, requestData);
+
+    // Reads answer before handleRequest returns, writes once the ledger writer committed them
+    if (handlerResponse.isNull())
+    {
+        QEventLoop loop;
+        waitLoop = &loop;
+        loop.exec();
+        waitLoop = nullptr;
+    }
+    return handlerResponse;
+}
+
+void ServerBench::benchHandler(RequestHandler &handler, const QString &name, BankProtocol::RequestId id,
+                               const std::function<void(QJsonObject &)> &adjust)
+{
+    const QString fullName = "handler/" + name;
+    if (!runner.selected(fullName))
+    {
+        return;
+    }
+
+    const bool createsOrDeletes = id == BankProtocol::RequestId::CreateAccount
+                                  || id == BankProtocol::RequestId::DeleteAccount;
+    const int count = id == BankProtocol::RequestId::DeleteAccount ? createdAccounts.size() : options.iterations;
+
+    // The handler gets the bytes a client would send
+    QVector<QByteArray> payloads;
+    for (const QJsonObject &request : prepareRequests(id, count, !createsOrDeletes, adjust))
+    {
+        payloads.append(MessageCodec::encode(request, MessageCodec::Encoding::Json));
+    }
+
+    QByteArray lastResponseData;
+    runner.run(fullName, count, [&](int iteration)
+    {
+        const QByteArray responseData = handle(handler, payloads[requestIndex(iteration, count)]);
+        lastResponseData = responseData;
+        sink += responseData.size();
+        if (id == BankProtocol::RequestId::CreateAccount)
+        {
+            QJsonObject response;
+            MessageCodec::decode(responseData, response);
+            createdAccounts.append(response["accountNumber"].toInteger());
+        }
+    }, !createsOrDeletes);
+
+    if (id == BankProtocol::RequestId::DeleteAccount)
+    {
+        createdAccounts.clear();
+    }
+    if (!payloads.isEmpty())
+    {
+        QJsonObject response;
+        MessageCodec::decode(lastResponseData, response);
+        checkSucceeded(fullName, id, response);
+    }
+}
+
+void ServerBench::checkSucceeded(const QString &name, BankProtocol::RequestId id, const QJsonObject &response)
+{
+    // An error answer is usually far cheaper than the work, the timing would mean nothing
+    if (!response[BankProtocol::requests[static_cast<int>(id)].successKey].toBool())
+    {
+        failed = true;
+        QTextStream(stdout) << "FAILED: " << name << " answered \"" << response["errorMessage"].toString()
+                            << "\"" << Qt::endl;
+    }
+}
+
+bool ServerBench::allSucceeded() const
+{
+    return !failed;
+}
+
+void ServerBench::benchBatch(RequestHandler &handler, int size)
+{
+    const QString batchName = QString("handler/batch/%1 transfers in one batch").arg(size);
+    const QString singleName = QString("handler/batch/%1 transfers one by one").arg(size);
+    if (!runner.selected(batchName) && !runner.selected(singleName))
+    {
+        return;
+    }
+
+    // One operation is all size transfers, either way
+    const int count = qMax(1, options.iterations / size);
+    QVector<QByteArray> singles;
+    BankProtocol::BatchRequest batch;
+    for (int i = 0; i < size; ++i)
+    {
+        const QJsonObject transfer = buildRequest(BankProtocol::RequestId::MakeTransfer, i);
+        singles.append(MessageCodec::encode(transfer, MessageCodec::Encoding::Json));
+        batch.requests.append(transfer);
+    }
+    const QByteArray batchPayload = MessageCodec::encode(BankProtocol::encode(batch), MessageCodec::Encoding::Json);
+
+    bool batchFailed = false;
+    runner.run(singleName, count, [&](int)
+    {
+        for (const QByteArray &single : singles)
+        {
+            const QByteArray responseData = handle(handler, single);
+            QJsonObject response;
+            batchFailed |= !MessageCodec::decode(responseData, response) || !response["transferSuccess"].toBool();
+            sink += responseData.size();
+        }
+    });
+    runner.run(batchName, count, [&](int)
+    {
+        const QByteArray responseData = handle(handler, batchPayload);
+        QJsonObject response;
+        batchFailed |= !MessageCodec::decode(responseData, response) || !response["batchSuccess"].toBool();
+        sink += responseData.size();
+    });
+
+    if (batchFailed)
+    {
+        failed = true;
+        QTextStream(stdout) << "FAILED: a transfer of the batch benchmark didn't succeed" << Qt::endl;
+    }
+}
+
+void ServerBench::runDatabaseManager()
+{
+    using BankProtocol::RequestId;
+
+    runner.printSection("DatabaseManager::processRequest");
+    benchDatabase("login", RequestId::Login);
+    benchDatabase("getAccountNumber", RequestId::GetAccountNumber);
+    benchDatabase("getBalance", RequestId::GetBalance);
+    benchDatabase("adminGetBalance", RequestId::AdminGetBalance);
+    benchDatabase("fetchAllUserData", RequestId::FetchAllUserData);
+    benchDatabase("fetchAllUserData/filtered", RequestId::FetchAllUserData, [](QJsonObject &request)
+    {
+        request["minBalance"] = 1000.0;
+        request["columns"] = QJsonArray{"AccountNumber", "Name", "Balance"};
+        request["sortBy"] = "Balance";
+        request["descending"] = true;
+        request["limit"] = historyPageSize;
+    });
+    benchDatabase("fetchUserDataChanges", RequestId::FetchUserDataChanges);
+    benchDatabase("transactionHistory/page", RequestId::TransactionHistory);
+    benchDatabase("transactionHistory/full", RequestId::TransactionHistory, [](QJsonObject &request)
+    {
+        request["pageSize"] = 0;
+    });
+    benchDatabase("adminTransactionHistory/page", RequestId::AdminTransactionHistory);
+    benchDatabase("makeTransaction", RequestId::MakeTransaction);
+    benchDatabase("makeTransfer", RequestId::MakeTransfer);
+    benchDatabase("updateUserData", RequestId::UpdateUserData);
+    benchDatabase("createAccount", RequestId::CreateAccount);
+    benchDatabase("deleteAccount", RequestId::DeleteAccount);
+}
+
+void ServerBench::runRequestHandler()
+{
+    using BankProtocol::RequestId;
+
+    RequestHandler handler("BenchmarkHandler");
+    connectHandler(handler);
+
+    runner.printSection("RequestHandler::handleRequest, writes through the ledger writer");
+    benchHandler(handler, "login", RequestId::Login);
+    benchHandler(handler, "getAccountNumber", RequestId::GetAccountNumber);
+    benchHandler(handler, "getBalance", RequestId::GetBalance);
+    benchHandler(handler, "fetchAllUserData/cached", RequestId::FetchAllUserData);
+    benchHandler(handler, "fetchUserDataChanges", RequestId::FetchUserDataChanges);
+    benchHandler(handler, "transactionHistory/page", RequestId::TransactionHistory);
+    benchHandler(handler, "makeTransaction", RequestId::MakeTransaction);
+    benchHandler(handler, "makeTransfer", RequestId::MakeTransfer);
+    benchHandler(handler, "updateUserData", RequestId::UpdateUserData);
+    benchHandler(handler, "createAccount", RequestId::CreateAccount);
+    benchHandler(handler, "deleteAccount", RequestId::DeleteAccount);
+
+    // Without a batch window every single request pays for a commit of its own
+    for (int size : {10, 100})
+    {
+        benchBatch(handler, size);
+    }
+}
+
+void ServerBench::benchCodec(const QString &shape, const QJsonObject &message, bool isRequest)
+{
+    const QString prefix = QString("codec/%1/%2/").arg(isRequest ? "request" : "response", shape);
+    for (MessageCodec::Encoding encoding : {MessageCodec::Encoding::Json, MessageCodec::Encoding::Cbor})
+    {
+        const QString encodingName = MessageCodec::encodingName(encoding);
+        const QByteArray payload = MessageCodec::encode(message, encoding);
+
+        runner.run(prefix + encodingName + " encode", [&](int)
+        {
+            sink += MessageCodec::encode(message, encoding).size();
+        });
+        runner.run(prefix + encodingName + " decode", [&](int)
+        {
+            QJsonObject decoded;
+            MessageCodec::decode(payload, decoded);
+            sink += decoded.size();
+        });
+
+        // Bytes on the wire of the shape, to set JSON against CBOR
+        if (runner.selected(prefix + encodingName + " encode") || runner.selected(prefix + encodingName + " decode"))
+        {
+            QTextStream(stdout) << QString("%1 %2 bytes").arg("", -40).arg(payload.size(), 10) << Qt::endl;
+        }
+    }
+
+    // What the DatabaseManager's dispatch does with every request it gets
+    if (isRequest)
+    {
+        runner.run(prefix + "typed decode", [&](int)
+        {
+            sink += decodeTyped(message);
+        });
+    }
+}
+
+void ServerBench::collectCodecSamples()
+{
+    using BankProtocol::RequestId;
+
+    requestSamples.clear();
+    responseSamples.clear();
+
+    RequestHandler handler("CodecSampleHandler");
+    connectHandler(handler);
+
+    // Hello is only answered as the first request of a session, sequence 0
+    const QJsonObject helloRequest = buildRequest(RequestId::Hello, 0);
+    QJsonObject helloResponse;
+    awaitedSequence = 0;
+    handlerResponse.clear();
+    handler.handleRequest(0, MessageCodec::encode(helloRequest, MessageCodec::Encoding::Json));
+    MessageCodec::decode(handlerResponse, helloResponse);
+
+    // Metrics and TraceDump want an admin session
+    BankProtocol::LoginRequest adminLogin;
+    adminLogin.username = "admin";
+    adminLogin.password = "admin";
+    handle(handler, MessageCodec::encode(BankProtocol::encode(adminLogin), MessageCodec::Encoding::Json));
+
+    qint64 createdAccount = 0;
+    for (int id = 0; id < BankProtocol::RequestCount; ++id)
+    {
+        const RequestId requestId = static_cast<RequestId>(id);
+        const QString name = requestNames[id];
+        QJsonObject request = requestId == RequestId::Hello ? helloRequest : buildRequest(requestId, 0);
+        QJsonObject response;
+
+        switch (requestId)
+        {
+        case RequestId::Hello:
+            response = helloResponse;
+            break;
+        case RequestId::Subscribe:
+        case RequestId::Metrics:
+        case RequestId::TraceDump:
+            MessageCodec::decode(handle(handler, MessageCodec::encode(request, MessageCodec::Encoding::Json)),
+                                 response);
+            break;
+        case RequestId::DeleteAccount:
+            // The account the createAccount sample made
+            request["accountNumber"] = createdAccount;
+            response = databaseManager.processRequest(request);
+            break;
+        default:
+            response = databaseManager.processRequest(request);
+            break;
+        }
+
+        if (requestId == RequestId::CreateAccount)
+        {
+            createdAccount = response["accountNumber"].toInteger();
+        }
+        checkSucceeded("codec/" + name, requestId, response);
+        requestSamples.append({name, request});
+        responseSamples.append({name, response});
+    }
+
+    // What the writes above push to subscribers, one of each kind
+    QStringList eventKinds;
+    for (const AccountEvent &accountEvent : databaseManager.takeAccountEvents())
+    {
+        const QString kind = accountEvent.event["event"].toString();
+        if (!eventKinds.contains(kind))
+        {
+            eventKinds.append(kind);
+            responseSamples.append({"event/" + kind, accountEvent.event});
+        }
+    }
+
+    // Streamed reads answer in chunks rather than in one response
+    for (RequestId id : {RequestId::FetchAllUserData, RequestId::TransactionHistory})
+    {
+        // A history page is a single response, the whole history streams
+        QJsonObject request = buildRequest(id, 0);
+        request.remove("pageSize");
+        request["stream"] = true;
+        ResultStream *stream = databaseManager.openResultStream(request, MessageCodec::Encoding::Json);
+        QByteArray payload;
+        QJsonObject chunk;
+        if (stream != nullptr && stream->readChunk(payload) && MessageCodec::decode(payload, chunk))
+        {
+            responseSamples.append({QString("%1/chunk").arg(requestNames[static_cast<int>(id)]), chunk});
+        }
+        delete stream;
+    }
+}
+
+void ServerBench::runCodec()
+{
+    // Every shape, whichever of the other benchmarks the filter left out
+    collectCodecSamples();
+
+    runner.printSection("MessageCodec and BankProtocol, per request and response shape");
+    for (const auto &sample : requestSamples)
+    {
+        benchCodec(sample.first, sample.second, true);
+    }
+    for (const auto &sample : responseSamples)
+    {
+        benchCodec(sample.first, sample.second, false);
+    }
+
+    runner.printSection("MessageFraming::encode with compression, per response shape");
+    for (const auto &sample : responseSamples)
+    {
+        benchFraming(sample.first, sample.second);
+    }
+}
+
+void ServerBench::benchFraming(const QString &shape, const QJsonObject &response)
+{
+    // Compressed as the server would for a client that accepts it, whatever the size
+    const int level = ServerConfig::instance().compressLevel;
+    for (MessageCodec::Encoding encoding : {MessageCodec::Encoding::Json, MessageCodec::Encoding::Cbor})
+    {
+        const QString name = QString("frame/%1/%2 zlib").arg(shape, MessageCodec::encodingName(encoding));
+        if (!runner.selected(name))
+        {
+            continue;
+        }
+        const QByteArray payload = MessageCodec::encode(response, encoding);
+        runner.run(name, [&](int)
+        {
+            sink += MessageFraming::encode(payload, 1, level).size();
+        });
+
+        // encode() keeps the payload as it is when compressing doesn't make it smaller
+        const qsizetype plainSize = MessageFraming::HeaderSize + payload.size();
+        const qsizetype frameSize = MessageFraming::encode(payload, 1, level).size();
+        QTextStream(stdout) << QString("%1 %2 -> %3 bytes, ratio %4")
+                                   .arg("", -40).arg(plainSize, 10).arg(frameSize)
+                                   .arg(static_cast<double>(plainSize) / frameSize, 0, 'f', 2) << Qt::endl;
+    }
+}
+
+void ServerBench::runLogger()
+{
+    runner.printSection("Logger::log through the LogWriter, sustained lines/s = 1e9 / ns/op");
+
+    // Many times what the ring holds, so the rate is what the writer thread keeps up with
+    const int lines = qMax(options.iterations, ServerConfig::instance().logBufferSize * 8);
+    Logger logger("Benchmark", "bench_log.txt");
+    const QString message = "Processed request 7 for account 1000042 in 153 us, 2 statements";
+
+    runner.run("log/append", lines, [&](int)
+    {
+        logger.log(message);
+    }, false);
+
+    // Producers contend for the ring's enqueue position as worker threads do
+    for (int threads : {2, 4, 8})
+    {
+        const QString name = QString("log/append %1 threads").arg(threads);
+        if (!runner.selected(name))
+        {
+            continue;
+        }
+
+        const int linesPerThread = lines / threads;
+        QVector<QThread *> producers;
+        const qint64 startNs = ServerMetrics::nowNs();
+        for (int i = 0; i < threads; ++i)
+        {
+            producers.append(QThread::create([&logger, &message, linesPerThread]
+            {
+                for (int line = 0; line < linesPerThread; ++line)
+                {
+                    logger.log(message);
+                }
+            }));
+            producers.last()->start();
+        }
+        for (QThread *producer : producers)
+        {
+            producer->wait();
+            delete producer;
+        }
+        const qint64 elapsedNs = ServerMetrics::nowNs() - startNs;
+
+        QTextStream(stdout) << QString("%1 %2 %3")
+                                   .arg(name, -40).arg(linesPerThread * threads, 10)
+                                   .arg(static_cast<double>(elapsedNs) / (linesPerThread * threads), 12, 'f', 0)
+                            << Qt::endl;
+    }
+}
+
+static void removeDatabaseFiles(const QString &fileName)
+{
+    for (const QString &suffix : {"", "-wal", "-shm"})
+    {
+        QFile::remove(fileName + suffix);
+    }
+}
+
+// A consistent copy of the server's database, committed WAL content included
+static bool copyDatabase(const QString &copyName, QString &errorMessage)
+{
+    removeDatabaseFiles(copyName);
+    bool copied = false;
+    {
+        QSqlDatabase source = QSqlDatabase::addDatabase("QSQLITE", "PragmaBenchSource");
+        source.setDatabaseName("bankdatabase.db");
+        if (source.open())
+        {
+            QSqlQuery vacuum(source);
+            copied = vacuum.exec(QString("VACUUM INTO '%1'").arg(copyName));
+            errorMessage = vacuum.lastError().text();
+        }
+        else
+        {
+            errorMessage = source.lastError().text();
+        }
+        source.close();
+    }
+    QSqlDatabase::removeDatabase("PragmaBenchSource");
+    return copied;
+}
+
+void ServerBench::runPragmas()
+{
+    runner.printSection("SQLite pragmas, a transfer committed on its own with its syncs, and a balance read");
+
+    const QString copyName = "pragma_bench.db";
+    // Without it the transfers still run, only their syncs go uncounted
+    bool countSyncs = SyncCountingVfs::install();
+    for (const PragmaConfig &config : pragmaConfigs)
+    {
+        const QString prefix = QString("pragmas/%1/").arg(config.name);
+        if (!runner.selected(prefix + "transfer") && !runner.selected(prefix + "getBalance"))
+        {
+            continue;
+        }
+
+        // Every configuration starts from its own copy of the seeded database
+        QString errorMessage;
+        if (!copyDatabase(copyName, errorMessage))
+        {
+            QTextStream(stdout) << "Failed to copy the database: " << errorMessage << Qt::endl;
+            return;
+        }
+
+        {
+            QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", "PragmaBench");
+            if (countSyncs)
+            {
+                database.setConnectOptions("QSQLITE_OPEN_URI");
+                database.setDatabaseName(QString("file:%1?vfs=%2").arg(copyName, SyncCountingVfs::Name));
+            }
+            else
+            {
+                database.setDatabaseName(copyName);
+            }
+            bool opened = database.open();
+            if (!opened && countSyncs)
+            {
+                // Qt's driver has its own SQLite, which doesn't know the VFS
+                countSyncs = false;
+                database.setConnectOptions();
+                database.setDatabaseName(copyName);
+                opened = database.open();
+            }
+            if (!opened)
+            {
+                QTextStream(stdout) << "Failed to open the copy: " << database.lastError().text() << Qt::endl;
+                database = QSqlDatabase();
+                QSqlDatabase::removeDatabase("PragmaBench");
+                return;
+            }
+            QSqlQuery pragma(database);
+            pragma.exec(QString("PRAGMA journal_mode=%1").arg(config.journalMode));
+            pragma.exec(QString("PRAGMA synchronous=%1").arg(config.synchronous));
+            pragma.exec(QString("PRAGMA cache_size=%1").arg(config.cacheSize));
+            pragma.exec(QString("PRAGMA mmap_size=%1").arg(config.mmapSize));
+            pragma.exec("PRAGMA temp_store=MEMORY");
+            pragma.finish();
+
+            // The statements of DatabaseManager::makeTransfer and getAccountBalance
+            QSqlQuery applyAmount(database);
+            applyAmount.prepare("UPDATE Users_Personal_Data SET Balance = Balance + :amount "
+                                "WHERE AccountNumber = :accountNumber AND Balance + :checkAmount >= 0 "
+                                "RETURNING Balance");
+            QSqlQuery insertTransaction(database);
+            insertTransaction.prepare("INSERT INTO Transaction_History (AccountNumber, Timestamp, Amount) "
+                                      "VALUES (:accountNumber, :timestamp, :amount)");
+            QSqlQuery balance(database);
+            balance.prepare("SELECT Balance FROM Users_Personal_Data WHERE AccountNumber = :accountNumber");
+
+            auto applyTo = [&](qint64 accountNumber, double amount)
+            {
+                applyAmount.bindValue(":amount", amount);
+                applyAmount.bindValue(":checkAmount", amount);
+                applyAmount.bindValue(":accountNumber", accountNumber);
+                QueryTimer::exec(applyAmount, database);
+                sink += applyAmount.next();
+                applyAmount.finish();
+
+                insertTransaction.bindValue(":accountNumber", accountNumber);
+                insertTransaction.bindValue(":timestamp", ServerMetrics::nowNs() / 1000);
+                insertTransaction.bindValue(":amount", amount);
+                QueryTimer::exec(insertTransaction, database);
+            };
+
+            // Group commit off: every transfer pays for its own commit
+            quint64 transferSyncs = 0;
+            runner.run(prefix + "transfer", [&](int iteration)
+            {
+                const quint64 syncsBefore = SyncCountingVfs::syncCount();
+                const int index = qAbs(iteration);
+                database.transaction();
+                applyTo(account(index).second, -1.0);
+                applyTo(account(index + 1).second, 1.0);
+                database.commit();
+                if (iteration >= 0)
+                {
+                    transferSyncs += SyncCountingVfs::syncCount() - syncsBefore;
+                }
+            });
+            if (runner.selected(prefix + "transfer") && !runner.results().isEmpty())
+            {
+                const BenchmarkRunner::Result &result = runner.results().last();
+                QTextStream(stdout) << QString("%1 %2 commits/s, %3 syncs/op")
+                                           .arg("", -40)
+                                           .arg(1e9 / result.nsPerOp, 10, 'f', 0)
+                                           .arg(countSyncs ? QString::number(static_cast<double>(transferSyncs)
+                                                                             / result.iterations, 'f', 2)
+                                                           : QString("n/a")) << Qt::endl;
+            }
+            runner.run(prefix + "getBalance", [&](int iteration)
+            {
+                balance.bindValue(":accountNumber", account(qAbs(iteration)).second);
+                QueryTimer::exec(balance, database);
+                sink += balance.next();
+                balance.finish();
+            });
+
+            applyAmount = QSqlQuery();
+            insertTransaction = QSqlQuery();
+            balance = QSqlQuery();
+            pragma = QSqlQuery();
+            database.close();
+        }
+        QSqlDatabase::removeDatabase("PragmaBench");
+    }
+
+    removeDatabaseFiles(copyName);
+}
+
+void ServerBench::runHistoryScaling()
+{
+    using BankProtocol::RequestId;
+
+    runner.printSection("One account's history as Transaction_History grows around it");
+
+    // The measured account keeps its seeded history, the others get the filler rows
+    qint64 tableRows = static_cast<qint64>(options.accounts) * options.historyPerAccount;
+    for (qint64 targetRows = 10000; targetRows <= options.historyTableRows; targetRows *= 10)
+    {
+        const QString prefix = QString("history/%1 rows/").arg(targetRows);
+        if (!runner.selected(prefix + "page") && !runner.selected(prefix + "full"))
+        {
+            continue;
+        }
+
+        if (tableRows < targetRows)
+        {
+            const qint64 startNs = ServerMetrics::nowNs();
+            if (!databaseManager.beginBatch())
+            {
+                QTextStream(stdout) << "Failed to start the filler transaction" << Qt::endl;
+                return;
+            }
+            BankProtocol::MakeTransactionRequest filler;
+            filler.amount = 1.0;
+            for (qint64 row = tableRows; row < targetRows; ++row)
+            {
+                filler.accountNumber = accounts[1 + row % (accounts.size() - 1)].second;
+                databaseManager.processRequest(BankProtocol::encode(filler));
+            }
+            if (!databaseManager.commitBatch())
+            {
+                QTextStream(stdout) << "Failed to commit the filler rows" << Qt::endl;
+                return;
+            }
+            databaseManager.takeAccountEvents();
+            QTextStream(stdout) << "Grew Transaction_History to " << targetRows << " rows in "
+                                << (ServerMetrics::nowNs() - startNs) / 1000000 << " ms" << Qt::endl;
+            tableRows = targetRows;
+        }
+
+        const QVector<QJsonObject> pages = prepareRequests(RequestId::TransactionHistory, options.iterations, true,
+            [this](QJsonObject &request)
+            {
+                request["accountNumber"] = accounts.first().second;
+            });
+        runner.run(prefix + "page", [&](int iteration)
+        {
+            sink += databaseManager.processRequest(pages[requestIndex(iteration, options.iterations)]).size();
+        });
+        runner.run(prefix + "full", [&](int iteration)
+        {
+            QJsonObject request = pages[requestIndex(iteration, options.iterations)];
+            request["pageSize"] = 0;
+            sink += databaseManager.processRequest(request).size();
+        });
+    }
+}
+
+qsizetype ServerBench::decodeTyped(const QJsonObject &request)
+{
+    using namespace BankProtocol;
+
+    switch (static_cast<RequestId>(requestIdOf(request)))
+    {
+    case RequestId::Login:
+        return decode<LoginRequest>(request).username.size();
+    case RequestId::GetAccountNumber:
+        return decode<GetAccountNumberRequest>(request).username.size();
+    case RequestId::GetBalance:
+        return decode<GetBalanceRequest>(request).accountNumber;
+    case RequestId::CreateAccount:
+        return decode<CreateAccountRequest>(request).username.size();
+    case RequestId::DeleteAccount:
+        return decode<DeleteAccountRequest>(request).accountNumber;
+    case RequestId::FetchAllUserData:
+        return decode<FetchAllUserDataRequest>(request).columns.size();
+    case RequestId::MakeTransaction:
+        return decode<MakeTransactionRequest>(request).accountNumber;
+    case RequestId::MakeTransfer:
+        return decode<MakeTransferRequest>(request).toAccountNumber;
+    case RequestId::TransactionHistory:
+        return decode<TransactionHistoryRequest>(request).pageSize;
+    case RequestId::UpdateUserData:
+        return decode<UpdateUserDataRequest>(request).name.size();
+    case RequestId::AdminGetBalance:
+        return decode<AdminGetBalanceRequest>(request).accountNumber;
+    case RequestId::AdminTransactionHistory:
+        return decode<AdminTransactionHistoryRequest>(request).pageSize;
+    case RequestId::Hello:
+        return decode<HelloRequest>(request).encodings.size();
+    case RequestId::Batch:
+        return decode<BatchRequest>(request).requests.size();
+    case RequestId::Subscribe:
+        return decode<SubscribeRequest>(request).accountNumbers.size();
+    case RequestId::FetchUserDataChanges:
+        return decode<FetchUserDataChangesRequest>(request).sinceVersion;
+    case RequestId::Metrics:
+        decode<MetricsRequest>(request);
+        return 1;
+    case RequestId::TraceDump:
+        return decode<TraceDumpRequest>(request).clear;
+    default:
+        break;
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+#ifndef SERVERBENCH_H
+#define SERVERBENCH_H
+
+#include <QJsonObject>
+#include <QVector>
+#include <QPair>
+#include <QEventLoop>
+#include <functional>
+
+#include "benchmarkrunner.h"
+#include "databasemanager.h"
+#include "bankprotocol.h"
+
+class RequestHandler;
+
+struct BenchOptions
+{
+    int accounts = 1000;
+    // Transactions every seeded account starts with
+    int historyPerAccount = 20;
+    int iterations = 1000;
+    // Transaction_History grows tenfold up to this many rows for the history scaling benchmarks
+    int historyTableRows = 1000000;
+    QString filter;
+};
+
+// The benchmarks of the server, in process against the database in the
+// working directory: every DatabaseManager operation on its own, the same
+// requests through RequestHandler::handleRequest, the codec on every
+// request and response shape and the compressed frames of the responses,
+// the log writer's sustained line rate, and transfers and reads under each
+// set of SQLite pragmas, and one account's history as the transaction table
+// around it grows.
+class ServerBench
+{
+public:
+    explicit ServerBench(const BenchOptions &options);
+    ~ServerBench();
+
+    // Creates the accounts and their history in one transaction
+    bool seed();
+    void runDatabaseManager();
+    void runRequestHandler();
+    void runCodec();
+    void runLogger();
+    void runPragmas();
+    // Grows Transaction_History, run it last
+    void runHistoryScaling();
+    // False once a benchmark's requests were answered with an error
+    bool allSucceeded() const;
+
+private:
+    BenchOptions options;
+    BenchmarkRunner runner;
+    DatabaseManager databaseManager;
+    QVector<QPair<QString, qint64>> accounts;
+    qint64 userDataVersion = 0;
+    quint64 createdSerial = 0;
+    // Created by the createAccount benchmarks, removed by the deleteAccount ones
+    QVector<qint64> createdAccounts;
+
+    // One of every request and response shape, for the codec benchmarks
+    QVector<QPair<QString, QJsonObject>> requestSamples;
+    QVector<QPair<QString, QJsonObject>> responseSamples;
+
+    // Handler responses arrive through its signal, writes only after the ledger writer committed
+    quint64 nextSequence = 1;
+    quint64 awaitedSequence = 0;
+    QByteArray handlerResponse;
+    QEventLoop *waitLoop = nullptr;
+
+    // Keeps the results of the measured code observable
+    qsizetype sink = 0;
+    bool failed = false;
+
+    const QPair<QString, qint64> &account(int iteration) const;
+    QJsonObject buildRequest(BankProtocol::RequestId id, int iteration);
+    // Requests for the warmup and measured iterations, built before the timing starts
+    QVector<QJsonObject> prepareRequests(BankProtocol::RequestId id, int count, bool warmup,
+                                         const std::function<void(QJsonObject &)> &adjust);
+    static int requestIndex(int iteration, int count);
+    void benchDatabase(const QString &name, BankProtocol::RequestId id,
+                       const std::function<void(QJsonObject &)> &adjust = nullptr);
+    // Sends handler responses to handle(), which waits for them
+    void connectHandler(RequestHandler &handler);
+    void benchHandler(RequestHandler &handler, const QString &name, BankProtocol::RequestId id,
+                      const std::function<void(QJsonObject &)> &adjust = nullptr);
+    QByteArray handle(RequestHandler &handler, const QByteArray &requestData);
+    // Prints FAILED and fails the run if the response reports no success
+    void checkSucceeded(const QString &name, BankProtocol::RequestId id, const QJsonObject &response);
+    // size transfers in one Batch request against the same transfers one request each
+    void benchBatch(RequestHandler &handler, int size);
+    // Runs one request of every ID, then keeps the requests, their responses,
+    // the account events they pushed and the first chunk of each streamed read
+    void collectCodecSamples();
+    void benchCodec(const QString &shape, const QJsonObject &message, bool isRequest);
+    // ns/op and size ratio of a compressed response frame
+    void benchFraming(const QString &shape, const QJsonObject &response);
+    static qsizetype decodeTyped(const QJsonObject &request);
+};
+
+#endif // SERVERBENCH_H
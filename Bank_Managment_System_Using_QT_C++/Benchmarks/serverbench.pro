@@ -0,0 +1,63 @@
+QT = core network sql
+
+CONFIG += c++17 cmdline static
+
+# The server's sources are built in, all but its main.cpp
+INCLUDEPATH += ../Common ../Server
+
+# The sync counting VFS registers in this SQLite, the one Qt's driver has to use
+LIBS += -lsqlite3
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += \
+        ../Common/messagecodec.cpp \
+        ../Common/messageframing.cpp \
+        ../Server/clientrunnable.cpp \
+        ../Server/coarseclock.cpp \
+        ../Server/databaseconnectionpool.cpp \
+        ../Server/databasemanager.cpp \
+        ../Server/ledgerwriter.cpp \
+        ../Server/logger.cpp \
+        ../Server/logwriter.cpp \
+        ../Server/metricsserver.cpp \
+        ../Server/notificationhub.cpp \
+        ../Server/querytimer.cpp \
+        ../Server/requesthandler.cpp \
+        ../Server/requesttracer.cpp \
+        ../Server/resultstream.cpp \
+        ../Server/server.cpp \
+        ../Server/serverconfig.cpp \
+        ../Server/servermetrics.cpp \
+        ../Server/userdatacache.cpp \
+        benchmarkrunner.cpp \
+        main.cpp \
+        serverbench.cpp \
+        synccountingvfs.cpp
+
+HEADERS += \
+    ../Common/bankprotocol.h \
+    ../Common/messagecodec.h \
+    ../Common/messageframing.h \
+    ../Server/clientrunnable.h \
+    ../Server/coarseclock.h \
+    ../Server/databaseconnectionpool.h \
+    ../Server/databasemanager.h \
+    ../Server/ledgerwriter.h \
+    ../Server/logger.h \
+    ../Server/logwriter.h \
+    ../Server/metricsserver.h \
+    ../Server/notificationhub.h \
+    ../Server/querytimer.h \
+    ../Server/requesthandler.h \
+    ../Server/requesttracer.h \
+    ../Server/resultstream.h \
+    ../Server/server.h \
+    ../Server/serverconfig.h \
+    ../Server/servermetrics.h \
+    ../Server/userdatacache.h \
+    benchmarkrunner.h \
+    serverbench.h \
+    synccountingvfs.h
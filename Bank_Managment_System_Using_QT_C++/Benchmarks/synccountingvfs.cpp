@@ -0,0 +1,186 @@
+#include "synccountingvfs.h"
+
+#include <sqlite3.h>
+#include <atomic>
+
+static std::atomic<quint64> syncs{0};
+static sqlite3_vfs *realVfs = nullptr;
+static sqlite3_vfs countingVfs;
+
+// The file of the real VFS is kept right behind this one
+struct CountingFile
+{
+    sqlite3_file base;
+    sqlite3_file *real;
+};
+
+static sqlite3_file *realFile(sqlite3_file *file)
+{
+    return reinterpret_cast<CountingFile *>(file)->real;
+}
+
+static int countingClose(sqlite3_file *file)
+{
+    return realFile(file)->pMethods->xClose(realFile(file));
+}
+
+static int countingRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset)
+{
+    return realFile(file)->pMethods->xRead(realFile(file), buffer, amount, offset);
+}
+
+static int countingWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset)
+{
+    return realFile(file)->pMethods->xWrite(realFile(file), buffer, amount, offset);
+}
+
+static int countingTruncate(sqlite3_file *file, sqlite3_int64 size)
+{
+    return realFile(file)->pMethods->xTruncate(realFile(file), size);
+}
+
+static int countingSync(sqlite3_file *file, int flags)
+{
+    syncs.fetch_add(1, std::memory_order_relaxed);
+    return realFile(file)->pMethods->xSync(realFile(file), flags);
+}
+
+static int countingFileSize(sqlite3_file *file, sqlite3_int64 *size)
+{
+    return realFile(file)->pMethods->xFileSize(realFile(file), size);
+}
+
+static int countingLock(sqlite3_file *file, int lock)
+{
+    return realFile(file)->pMethods->xLock(realFile(file), lock);
+}
+
+static int countingUnlock(sqlite3_file *file, int lock)
+{
+    return realFile(file)->pMethods->xUnlock(realFile(file), lock);
+}
+
+static int countingCheckReservedLock(sqlite3_file *file, int *reserved)
+{
+    return realFile(file)->pMethods->xCheckReservedLock(realFile(file), reserved);
+}
+
+static int countingFileControl(sqlite3_file *file, int operation, void *argument)
+{
+    return realFile(file)->pMethods->xFileControl(realFile(file), operation, argument);
+}
+
+static int countingSectorSize(sqlite3_file *file)
+{
+    return realFile(file)->pMethods->xSectorSize(realFile(file));
+}
+
+static int countingDeviceCharacteristics(sqlite3_file *file)
+{
+    return realFile(file)->pMethods->xDeviceCharacteristics(realFile(file));
+}
+
+// Shared memory and memory mapping exist from version 2 and 3 of the file methods
+static int countingShmMap(sqlite3_file *file, int region, int size, int extend, void volatile **address)
+{
+    sqlite3_file *real = realFile(file);
+    return real->pMethods->iVersion >= 2 ? real->pMethods->xShmMap(real, region, size, extend, address)
+                                         : SQLITE_IOERR_SHMMAP;
+}
+
+static int countingShmLock(sqlite3_file *file, int offset, int count, int flags)
+{
+    sqlite3_file *real = realFile(file);
+    return real->pMethods->iVersion >= 2 ? real->pMethods->xShmLock(real, offset, count, flags)
+                                         : SQLITE_IOERR_SHMLOCK;
+}
+
+static void countingShmBarrier(sqlite3_file *file)
+{
+    sqlite3_file *real = realFile(file);
+    if (real->pMethods->iVersion >= 2)
+    {
+        real->pMethods->xShmBarrier(real);
+    }
+}
+
+static int countingShmUnmap(sqlite3_file *file, int deleteFlag)
+{
+    sqlite3_file *real = realFile(file);
+    return real->pMethods->iVersion >= 2 ? real->pMethods->xShmUnmap(real, deleteFlag) : SQLITE_OK;
+}
+
+static int countingFetch(sqlite3_file *file, sqlite3_int64 offset, int amount, void **pointer)
+{
+    sqlite3_file *real = realFile(file);
+    if (real->pMethods->iVersion >= 3)
+    {
+        return real->pMethods->xFetch(real, offset, amount, pointer);
+    }
+    *pointer = nullptr;
+    return SQLITE_OK;
+}
+
+static int countingUnfetch(sqlite3_file *file, sqlite3_int64 offset, void *pointer)
+{
+    sqlite3_file *real = realFile(file);
+    return real->pMethods->iVersion >= 3 ? real->pMethods->xUnfetch(real, offset, pointer) : SQLITE_OK;
+}
+
+static const sqlite3_io_methods countingMethods =
+{
+    3,
+    countingClose,
+    countingRead,
+    countingWrite,
+    countingTruncate,
+    countingSync,
+    countingFileSize,
+    countingLock,
+    countingUnlock,
+    countingCheckReservedLock,
+    countingFileControl,
+    countingSectorSize,
+    countingDeviceCharacteristics,
+    countingShmMap,
+    countingShmLock,
+    countingShmBarrier,
+    countingShmUnmap,
+    countingFetch,
+    countingUnfetch
+};
+
+static int countingOpen(sqlite3_vfs *, sqlite3_filename name, sqlite3_file *file, int flags, int *outFlags)
+{
+    CountingFile *countingFile = reinterpret_cast<CountingFile *>(file);
+    countingFile->real = reinterpret_cast<sqlite3_file *>(countingFile + 1);
+    const int result = realVfs->xOpen(realVfs, name, countingFile->real, flags, outFlags);
+    // SQLite only closes a file whose methods are set
+    file->pMethods = countingFile->real->pMethods != nullptr ? &countingMethods : nullptr;
+    return result;
+}
+
+bool SyncCountingVfs::install()
+{
+    static const bool installed = []
+    {
+        realVfs = sqlite3_vfs_find(nullptr);
+        if (realVfs == nullptr)
+        {
+            return false;
+        }
+        // Everything but opening a file goes straight to the real VFS
+        countingVfs = *realVfs;
+        countingVfs.pNext = nullptr;
+        countingVfs.zName = Name;
+        countingVfs.szOsFile = static_cast<int>(sizeof(CountingFile)) + realVfs->szOsFile;
+        countingVfs.xOpen = countingOpen;
+        return sqlite3_vfs_register(&countingVfs, 0) == SQLITE_OK;
+    }();
+    return installed;
+}
+
+quint64 SyncCountingVfs::syncCount()
+{
+    return syncs.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,21 @@
+#ifndef SYNCCOUNTINGVFS_H
+#define SYNCCOUNTINGVFS_H
+
+#include <QtGlobal>
+
+// A pass-through SQLite VFS around the default one that counts the xSync
+// calls of every file opened through it, the fsyncs a commit costs. A
+// connection uses it when opened with the URI file:<name>?vfs=<Name>.
+// Registered in the SQLite library the benchmark links against, which has to
+// be the one the Qt SQLite driver uses (a Qt built with -system-sqlite).
+class SyncCountingVfs
+{
+public:
+    static constexpr const char *Name = "synccounting";
+
+    // Registers the VFS once, false if SQLite has no default VFS to wrap
+    static bool install();
+    static quint64 syncCount();
+};
+
+#endif // SYNCCOUNTINGVFS_H
@@ -0,0 +1,483 @@
+#ifndef BANKPROTOCOL_H
+#define BANKPROTOCOL_H
+
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <optional>
+#include <tuple>
+
+// Requests shared by the server and the client. Every request ID is defined
+// once here, together with a struct holding its fields; decode() and encode()
+// are generated from each struct's field list.
+namespace BankProtocol
+{
+
+enum class RequestId : int
+{
+    Login = 0,
+    GetAccountNumber = 1,
+    GetBalance = 2,
+    CreateAccount = 3,
+    DeleteAccount = 4,
+    FetchAllUserData = 5,
+    MakeTransaction = 6,
+    MakeTransfer = 7,
+    TransactionHistory = 8,
+    UpdateUserData = 9,
+    AdminGetBalance = 10,
+    AdminTransactionHistory = 11,
+    Hello = 12,
+    Batch = 13,
+    Subscribe = 14,
+    FetchUserDataChanges = 15,
+    Metrics = 16,
+    TraceDump = 17
+};
+
+struct RequestInfo
+{
+    RequestId id;
+    // Changes data, so it is committed by the server's ledger writer
+    bool mutating;
+    // Response key telling whether the request succeeded
+    const char *successKey;
+};
+
+// Indexed by request ID
+inline constexpr RequestInfo requests[] =
+{
+    {RequestId::Login, false, "loginSuccess"},
+    {RequestId::GetAccountNumber, false, "userFound"},
+    {RequestId::GetBalance, false, "accountFound"},
+    {RequestId::CreateAccount, true, "createAccountSuccess"},
+    {RequestId::DeleteAccount, true, "deleteAccountSuccess"},
+    {RequestId::FetchAllUserData, false, "fetchUserDataSuccess"},
+    {RequestId::MakeTransaction, true, "transactionSuccess"},
+    {RequestId::MakeTransfer, true, "transferSuccess"},
+    {RequestId::TransactionHistory, false, "viewTransactionHistorySuccess"},
+    {RequestId::UpdateUserData, true, "updateSuccess"},
+    {RequestId::AdminGetBalance, false, "accountFound"},
+    {RequestId::AdminTransactionHistory, false, "viewTransactionHistorySuccess"},
+    {RequestId::Hello, false, "helloSuccess"},
+    {RequestId::Batch, true, "batchSuccess"},
+    {RequestId::Subscribe, false, "subscribeSuccess"},
+    {RequestId::FetchUserDataChanges, false, "fetchUserDataChangesSuccess"},
+    {RequestId::Metrics, false, "metricsSuccess"},
+    {RequestId::TraceDump, false, "traceDumpSuccess"}
+};
+
+inline constexpr int RequestCount = sizeof(requests) / sizeof(requests[0]);
+
+constexpr bool requestsInIdOrder()
+{
+    for (int i = 0; i < RequestCount; ++i)
+    {
+        if (static_cast<int>(requests[i].id) != i)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(requestsInIdOrder(), "BankProtocol::requests must be indexed by request ID");
+
+// Table entry of a request ID, nullptr if the ID is unknown
+constexpr const RequestInfo *requestInfo(int requestId)
+{
+    return (requestId >= 0 && requestId < RequestCount) ? &requests[requestId] : nullptr;
+}
+
+// One JSON key of a request struct
+template <typename Request, typename Value>
+struct Field
+{
+    const char *key;
+    Value Request::*member;
+};
+
+template <typename Request, typename Value>
+constexpr Field<Request, Value> field(const char *key, Value Request::*member)
+{
+    return {key, member};
+}
+
+struct LoginRequest
+{
+    static constexpr RequestId id = RequestId::Login;
+    QString username;
+    QString password;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("username", &LoginRequest::username),
+                               field("password", &LoginRequest::password));
+    }
+};
+
+struct GetAccountNumberRequest
+{
+    static constexpr RequestId id = RequestId::GetAccountNumber;
+    QString username;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("username", &GetAccountNumberRequest::username));
+    }
+};
+
+struct GetBalanceRequest
+{
+    static constexpr RequestId id = RequestId::GetBalance;
+    qint64 accountNumber = 0;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("accountNumber", &GetBalanceRequest::accountNumber));
+    }
+};
+
+struct CreateAccountRequest
+{
+    static constexpr RequestId id = RequestId::CreateAccount;
+    QString username;
+    QString password;
+    QString name;
+    int age = 0;
+    bool isAdmin = false;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("username", &CreateAccountRequest::username),
+                               field("password", &CreateAccountRequest::password),
+                               field("name", &CreateAccountRequest::name),
+                               field("age", &CreateAccountRequest::age),
+                               field("isAdmin", &CreateAccountRequest::isAdmin));
+    }
+};
+
+struct DeleteAccountRequest
+{
+    static constexpr RequestId id = RequestId::DeleteAccount;
+    qint64 accountNumber = 0;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("accountNumber", &DeleteAccountRequest::accountNumber));
+    }
+};
+
+// Every filter is optional and runs in SQL. The prefixes match from the
+// start, the username one ignores case like the username itself does.
+// columns picks the keys of each row, sortBy one of them; limit 0 is no limit.
+// The plain listing carries a "version"; sending it back as knownVersion
+// answers with just "notModified": true while the data is unchanged.
+struct FetchAllUserDataRequest
+{
+    static constexpr RequestId id = RequestId::FetchAllUserData;
+    // Answer in chunks as the rows are read instead of one response
+    bool stream = false;
+    qint64 knownVersion = 0;
+    std::optional<double> minBalance;
+    std::optional<double> maxBalance;
+    std::optional<int> minAge;
+    std::optional<int> maxAge;
+    QString usernamePrefix;
+    QString namePrefix;
+    QStringList columns;
+    QString sortBy;
+    bool descending = false;
+    int limit = 0;
+
+    // Anything beyond the plain full listing
+    bool hasOptions() const
+    {
+        return minBalance || maxBalance || minAge || maxAge || !usernamePrefix.isEmpty()
+               || !namePrefix.isEmpty() || !columns.isEmpty() || !sortBy.isEmpty() || limit != 0;
+    }
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("stream", &FetchAllUserDataRequest::stream),
+                               field("knownVersion", &FetchAllUserDataRequest::knownVersion),
+                               field("minBalance", &FetchAllUserDataRequest::minBalance),
+                               field("maxBalance", &FetchAllUserDataRequest::maxBalance),
+                               field("minAge", &FetchAllUserDataRequest::minAge),
+                               field("maxAge", &FetchAllUserDataRequest::maxAge),
+                               field("usernamePrefix", &FetchAllUserDataRequest::usernamePrefix),
+                               field("namePrefix", &FetchAllUserDataRequest::namePrefix),
+                               field("columns", &FetchAllUserDataRequest::columns),
+                               field("sortBy", &FetchAllUserDataRequest::sortBy),
+                               field("descending", &FetchAllUserDataRequest::descending),
+                               field("limit", &FetchAllUserDataRequest::limit));
+    }
+};
+
+struct MakeTransactionRequest
+{
+    static constexpr RequestId id = RequestId::MakeTransaction;
+    qint64 accountNumber = 0;
+    double amount = 0.0;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("accountNumber", &MakeTransactionRequest::accountNumber),
+                               field("amount", &MakeTransactionRequest::amount));
+    }
+};
+
+struct MakeTransferRequest
+{
+    static constexpr RequestId id = RequestId::MakeTransfer;
+    qint64 fromAccountNumber = 0;
+    qint64 toAccountNumber = 0;
+    double amount = 0.0;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("fromAccountNumber", &MakeTransferRequest::fromAccountNumber),
+                               field("toAccountNumber", &MakeTransferRequest::toAccountNumber),
+                               field("amount", &MakeTransferRequest::amount));
+    }
+};
+
+struct TransactionHistoryRequest
+{
+    static constexpr RequestId id = RequestId::TransactionHistory;
+    static constexpr int MaxPageSize = 1000;
+    qint64 accountNumber = 0;
+    bool stream = false;
+    // Newest first, pageSize rows at a time; 0 returns the whole history.
+    // cursor is the nextCursor of the previous page, empty for the first one.
+    int pageSize = 0;
+    QString cursor;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("accountNumber", &TransactionHistoryRequest::accountNumber),
+                               field("stream", &TransactionHistoryRequest::stream),
+                               field("pageSize", &TransactionHistoryRequest::pageSize),
+                               field("cursor", &TransactionHistoryRequest::cursor));
+    }
+};
+
+struct UpdateUserDataRequest
+{
+    static constexpr RequestId id = RequestId::UpdateUserData;
+    QString username;
+    QString name;
+    QString password;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("username", &UpdateUserDataRequest::username),
+                               field("name", &UpdateUserDataRequest::name),
+                               field("password", &UpdateUserDataRequest::password));
+    }
+};
+
+// The admin variants carry the same fields under their own ID
+struct AdminGetBalanceRequest : GetBalanceRequest
+{
+    static constexpr RequestId id = RequestId::AdminGetBalance;
+};
+
+struct AdminTransactionHistoryRequest : TransactionHistoryRequest
+{
+    static constexpr RequestId id = RequestId::AdminTransactionHistory;
+};
+
+struct HelloRequest
+{
+    static constexpr RequestId id = RequestId::Hello;
+    // Encodings the client accepts, most preferred first
+    QStringList encodings;
+    // Frame compressions the client can inflate, "zlib" is the only one so far
+    QStringList compression;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("encodings", &HelloRequest::encodings),
+                               field("compression", &HelloRequest::compression));
+    }
+};
+
+// Sub-requests run in order inside one transaction of the ledger writer.
+// "atomic" commits all of them or none, "bestEffort" keeps every one that succeeded.
+// Only writes are allowed in a batch, any other request fails with "Not allowed in a batch".
+struct BatchRequest
+{
+    static constexpr RequestId id = RequestId::Batch;
+    static constexpr int MaxRequests = 1000;
+    QString mode = "atomic";
+    QJsonArray requests;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("mode", &BatchRequest::mode),
+                               field("requests", &BatchRequest::requests));
+    }
+};
+
+// Rows of the user data table changed after sinceVersion, in "userData",
+// and the account numbers removed since then, in "deleted". "version" is the
+// sinceVersion of the next call; 0 fetches the whole table. At most MaxRows
+// changes come back at once: with "hasMore" the next page is asked for with
+// the returned version and afterAccountNumber.
+struct FetchUserDataChangesRequest
+{
+    static constexpr RequestId id = RequestId::FetchUserDataChanges;
+    static constexpr int MaxRows = 5000;
+    qint64 sinceVersion = 0;
+    // Last account of the previous page, 0 when not paging
+    qint64 afterAccountNumber = 0;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("sinceVersion", &FetchUserDataChangesRequest::sinceVersion),
+                               field("afterAccountNumber", &FetchUserDataChangesRequest::afterAccountNumber));
+    }
+};
+
+// Replaces the accounts this connection gets events for, an empty list stops them.
+// Events arrive unasked with responseId 14 and an "event" key:
+// "transaction" with accountNumber, amount, balance and timestamp, or
+// "accountDeleted" with accountNumber. "missedEvents" counts the ones dropped
+// before it because the connection did not keep up.
+struct SubscribeRequest
+{
+    static constexpr RequestId id = RequestId::Subscribe;
+    static constexpr int MaxAccounts = 1000;
+    QList<qint64> accountNumbers;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("accountNumbers", &SubscribeRequest::accountNumbers));
+    }
+};
+
+// Server latency histograms and counters, in "metrics"; only for a session
+// that logged in as an admin
+struct MetricsRequest
+{
+    static constexpr RequestId id = RequestId::Metrics;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple();
+    }
+};
+
+// Buffered request spans as Chrome trace-event JSON, in "trace". Optionally
+// changes the sampling (every Nth request, 0 is off) and empties the buffers
+// after the dump. Admin sessions only.
+struct TraceDumpRequest
+{
+    static constexpr RequestId id = RequestId::TraceDump;
+    std::optional<int> sampleEvery;
+    bool clear = false;
+
+    static constexpr auto fields()
+    {
+        return std::make_tuple(field("sampleEvery", &TraceDumpRequest::sampleEvery),
+                               field("clear", &TraceDumpRequest::clear));
+    }
+};
+
+// Conversions of a single field; a missing or mistyped key leaves the default
+inline void readValue(const QJsonValue &value, QString &out) { out = value.toString(out); }
+inline void readValue(const QJsonValue &value, qint64 &out) { out = value.toInteger(out); }
+inline void readValue(const QJsonValue &value, int &out) { out = value.toInt(out); }
+inline void readValue(const QJsonValue &value, double &out) { out = value.toDouble(out); }
+inline void readValue(const QJsonValue &value, bool &out) { out = value.toBool(out); }
+inline void readValue(const QJsonValue &value, QJsonArray &out) { out = value.toArray(); }
+inline void readValue(const QJsonValue &value, QStringList &out)
+{
+    out.clear();
+    const QJsonArray array = value.toArray();
+    for (const QJsonValue &item : array)
+    {
+        out.append(item.toString());
+    }
+}
+// A missing key leaves an optional field empty
+template <typename Value>
+void readValue(const QJsonValue &value, std::optional<Value> &out)
+{
+    if (value.isUndefined() || value.isNull())
+    {
+        out.reset();
+        return;
+    }
+    Value read{};
+    readValue(value, read);
+    out = read;
+}
+inline void readValue(const QJsonValue &value, QList<qint64> &out)
+{
+    out.clear();
+    const QJsonArray array = value.toArray();
+    for (const QJsonValue &item : array)
+    {
+        out.append(item.toInteger());
+    }
+}
+
+inline QJsonValue writeValue(const QString &value) { return value; }
+inline QJsonValue writeValue(qint64 value) { return value; }
+inline QJsonValue writeValue(int value) { return value; }
+inline QJsonValue writeValue(double value) { return value; }
+inline QJsonValue writeValue(bool value) { return value; }
+inline QJsonValue writeValue(const QJsonArray &value) { return value; }
+inline QJsonValue writeValue(const QStringList &value) { return QJsonArray::fromStringList(value); }
+inline QJsonValue writeValue(const QList<qint64> &value)
+{
+    QJsonArray array;
+    for (qint64 item : value)
+    {
+        array.append(item);
+    }
+    return array;
+}
+
+// Undefined leaves the key out of the message
+template <typename Value>
+QJsonValue writeValue(const std::optional<Value> &value)
+{
+    return value ? writeValue(*value) : QJsonValue(QJsonValue::Undefined);
+}
+
+// Request ID of a decoded message, -1 if it has none
+inline int requestIdOf(const QJsonObject &message)
+{
+    return message.value(QLatin1String("requestId")).toInt(-1);
+}
+
+// Every key is looked up once here; handlers only see the typed struct
+template <typename Request>
+Request decode(const QJsonObject &message)
+{
+    Request request;
+    std::apply([&](auto... fields)
+               { (readValue(message.value(QLatin1String(fields.key)), request.*(fields.member)), ...); },
+               Request::fields());
+    return request;
+}
+
+template <typename Request>
+QJsonObject encode(const Request &request)
+{
+    QJsonObject message;
+    message.insert(QLatin1String("requestId"), static_cast<int>(Request::id));
+    std::apply([&](auto... fields)
+               { (message.insert(QLatin1String(fields.key), writeValue(request.*(fields.member))), ...); },
+               Request::fields());
+    return message;
+}
+
+} // namespace BankProtocol
+
+#endif // BANKPROTOCOL_H
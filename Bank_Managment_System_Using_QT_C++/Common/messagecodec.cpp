@@ -0,0 +1,70 @@
+#include "messagecodec.h"
+
+#include <QJsonDocument>
+#include <QCborValue>
+#include <QCborMap>
+
+QByteArray MessageCodec::encode(const QJsonObject &message, Encoding encoding)
+{
+    if (encoding == Encoding::Cbor)
+    {
+        return QCborMap::fromJsonObject(message).toCborValue().toCbor();
+    }
+    return QJsonDocument(message).toJson(QJsonDocument::Compact);
+}
+
+bool MessageCodec::decode(const QByteArray &payload, QJsonObject &message)
+{
+    if (payload.isEmpty())
+    {
+        return false;
+    }
+
+    // A JSON object starts with '{' or whitespace, a CBOR map with major type 5
+    const uchar first = static_cast<uchar>(payload.at(0));
+    if ((first & 0xE0) == 0xA0)
+    {
+        QCborParserError error;
+        QCborValue value = QCborValue::fromCbor(payload, &error);
+        if (error.error != QCborError::NoError || !value.isMap())
+        {
+            return false;
+        }
+        message = value.toMap().toJsonObject();
+        return true;
+    }
+
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(payload, &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject())
+    {
+        return false;
+    }
+    message = document.object();
+    return true;
+}
+
+QString MessageCodec::encodingName(Encoding encoding)
+{
+    return encoding == Encoding::Cbor ? "cbor" : "json";
+}
+
+bool MessageCodec::encodingFromName(const QString &name, Encoding &encoding)
+{
+    if (name.compare("cbor", Qt::CaseInsensitive) == 0)
+    {
+        encoding = Encoding::Cbor;
+        return true;
+    }
+    if (name.compare("json", Qt::CaseInsensitive) == 0)
+    {
+        encoding = Encoding::Json;
+        return true;
+    }
+    return false;
+}
+
+QStringList MessageCodec::supportedEncodings()
+{
+    return {"cbor", "json"};
+}
@@ -0,0 +1,36 @@
+#ifndef MESSAGECODEC_H
+#define MESSAGECODEC_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+
+#include "bankprotocol.h"
+
+// Payload encodings of a frame. Every connection starts out with compact JSON;
+// the hello request (requestId 12) lets the client switch the server's
+// responses to CBOR. Requests are decoded by their first byte, so either side
+// may send CBOR as soon as it knows the peer understands it.
+class MessageCodec
+{
+public:
+    enum class Encoding
+    {
+        Json,
+        Cbor
+    };
+
+    static constexpr int HelloRequestId = static_cast<int>(BankProtocol::RequestId::Hello);
+
+    static QByteArray encode(const QJsonObject &message, Encoding encoding);
+    // False if the payload is neither a JSON object nor a CBOR map
+    static bool decode(const QByteArray &payload, QJsonObject &message);
+
+    static QString encodingName(Encoding encoding);
+    static bool encodingFromName(const QString &name, Encoding &encoding);
+    // Names in order of preference, as sent in the hello request
+    static QStringList supportedEncodings();
+};
+
+#endif // MESSAGECODEC_H
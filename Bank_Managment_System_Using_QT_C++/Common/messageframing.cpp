@@ -0,0 +1,135 @@
+#include "messageframing.h"
+
+#include <QtEndian>
+
+static QByteArray frameWithHeader(const QByteArray &payload, quint32 flags)
+{
+    QByteArray frame;
+    frame.reserve(MessageFraming::HeaderSize + payload.size());
+
+    uchar header[MessageFraming::HeaderSize];
+    qToBigEndian<quint32>(static_cast<quint32>(payload.size()) | flags, header);
+    frame.append(reinterpret_cast<const char *>(header), MessageFraming::HeaderSize);
+    frame.append(payload);
+
+    return frame;
+}
+
+QByteArray MessageFraming::encode(const QByteArray &payload)
+{
+    if (payload.size() > MaxPayloadSize)
+    {
+        return QByteArray();
+    }
+    return frameWithHeader(payload, 0);
+}
+
+QByteArray MessageFraming::encode(const QByteArray &payload, int compressThreshold, int level)
+{
+    // Too large even if it compressed well, the peer won't inflate more than this
+    if (payload.size() > MaxPayloadSize)
+    {
+        return QByteArray();
+    }
+
+    // Small replies aren't worth the CPU, and stay readable on the wire
+    if (compressThreshold <= 0 || payload.size() < compressThreshold)
+    {
+        return frameWithHeader(payload, 0);
+    }
+
+    QByteArray compressed = qCompress(payload, level);
+    if (compressed.isEmpty() || compressed.size() >= payload.size())
+    {
+        return frameWithHeader(payload, 0);
+    }
+    return frameWithHeader(compressed, CompressedFlag);
+}
+
+bool MessageFraming::decompress(QByteArray &payload)
+{
+    // qCompress starts with the uncompressed size, check it before inflating
+    if (payload.size() < HeaderSize)
+    {
+        return false;
+    }
+    quint32 expectedSize = qFromBigEndian<quint32>(payload.constData());
+    if (expectedSize > MaxPayloadSize)
+    {
+        return false;
+    }
+
+    QByteArray uncompressed = qUncompress(payload);
+    if (uncompressed.size() != static_cast<qsizetype>(expectedSize))
+    {
+        return false;
+    }
+    payload = uncompressed;
+    return true;
+}
+
+void FrameDecoder::append(const QByteArray &data)
+{
+    // Drop the frames already handed out before growing the buffer
+    if (readOffset > 0)
+    {
+        buffer.remove(0, readOffset);
+        readOffset = 0;
+    }
+    buffer.append(data);
+}
+
+bool FrameDecoder::takeFrame(QByteArray &frame)
+{
+    if (error)
+    {
+        return false;
+    }
+
+    qsizetype available = buffer.size() - readOffset;
+    if (available < MessageFraming::HeaderSize)
+    {
+        return false;
+    }
+
+    quint32 header = qFromBigEndian<quint32>(buffer.constData() + readOffset);
+    const bool compressed = (header & MessageFraming::CompressedFlag) != 0;
+    quint32 payloadSize = header & ~MessageFraming::CompressedFlag;
+    if (payloadSize > MessageFraming::MaxPayloadSize)
+    {
+        // Garbage or a hostile peer, the stream can't be resynchronised
+        error = true;
+        return false;
+    }
+
+    if (available < MessageFraming::HeaderSize + static_cast<qsizetype>(payloadSize))
+    {
+        return false;  // Wait for the rest of the frame
+    }
+
+    frame = buffer.mid(readOffset + MessageFraming::HeaderSize, payloadSize);
+    readOffset += MessageFraming::HeaderSize + payloadSize;
+
+    if (readOffset == buffer.size())
+    {
+        buffer.clear();
+        readOffset = 0;
+    }
+
+    if (compressed && !MessageFraming::decompress(frame))
+    {
+        error = true;
+        return false;
+    }
+    return true;
+}
+
+bool FrameDecoder::hasError() const
+{
+    return error;
+}
+
+qsizetype FrameDecoder::bufferedBytes() const
+{
+    return buffer.size() - readOffset;
+}
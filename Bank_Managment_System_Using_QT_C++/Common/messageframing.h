@@ -0,0 +1,45 @@
+#ifndef MESSAGEFRAMING_H
+#define MESSAGEFRAMING_H
+
+#include <QByteArray>
+
+// Wire format shared by the server and the client:
+// every message is a 4 byte big-endian payload length followed by the payload.
+// The top bit of the length marks a zlib compressed payload (qCompress format);
+// a peer only sends those after the hello said the other side accepts them.
+class MessageFraming
+{
+public:
+    static const int HeaderSize = 4;
+    static const quint32 MaxPayloadSize = 64 * 1024 * 1024;
+    static const quint32 CompressedFlag = 0x80000000;
+    static constexpr const char *CompressionName = "zlib";
+
+    // Prefix the payload with its length header. A payload over MaxPayloadSize
+    // gives an empty frame, the peer's decoder would reject it and the rest of the stream.
+    static QByteArray encode(const QByteArray &payload);
+    // Compresses payloads of at least compressThreshold bytes (0 never does)
+    // when that makes them smaller; level is qCompress's, -1 for the default
+    static QByteArray encode(const QByteArray &payload, int compressThreshold, int level = -1);
+
+    // Undo the compression of a flagged payload, false if it is corrupt or too large
+    static bool decompress(QByteArray &payload);
+};
+
+// Incremental decoder kept per connection. Feed it whatever the socket
+// delivered, then pull out every complete frame; partial frames stay buffered.
+class FrameDecoder
+{
+public:
+    void append(const QByteArray &data);
+    bool takeFrame(QByteArray &frame);
+    bool hasError() const;
+    qsizetype bufferedBytes() const;
+
+private:
+    QByteArray buffer;
+    qsizetype readOffset = 0;
+    bool error = false;
+};
+
+#endif // MESSAGEFRAMING_H
@@ -0,0 +1,162 @@
+#include "connectionchurn.h"
+
+#include <QTextStream>
+
+static const int drainTimeoutMs = 10000;
+
+ConnectionChurn::ConnectionChurn(const LoadOptions &options, QObject *parent)
+    : QObject(parent), options(options)
+{
+    openTimer.setTimerType(Qt::PreciseTimer);
+    connect(&openTimer, &QTimer::timeout, this, &ConnectionChurn::openDueConnections);
+    drainTimer.setSingleShot(true);
+    connect(&drainTimer, &QTimer::timeout, this, &ConnectionChurn::drainTimedOut);
+}
+
+void ConnectionChurn::start()
+{
+    intervalNs = static_cast<qint64>(1e9 / options.rate);
+    nextDueNs = LoadConnection::nowNs();
+    measureStartNs = nextDueNs + options.warmupSeconds * 1000000000LL;
+    endNs = measureStartNs + options.durationSeconds * 1000000000LL;
+
+    QTextStream(stdout) << "Opening " << options.rate << " connections/s for " << options.warmupSeconds
+                        << " s warmup and " << options.durationSeconds << " s measured" << Qt::endl;
+    openTimer.start(0);
+}
+
+void ConnectionChurn::openDueConnections()
+{
+    const qint64 nowNs = LoadConnection::nowNs();
+    while (nextDueNs <= nowNs && nextDueNs < endNs)
+    {
+        if (nowNs - nextDueNs > 1000000)
+        {
+            ++lateOpens;
+        }
+        LoadConnection *connection =
+            new LoadConnection(options.host, options.port, options.encoding, options.compression, this);
+        connect(connection, &LoadConnection::ready, this, &ConnectionChurn::connectionReady);
+        connect(connection, &LoadConnection::failed, this, &ConnectionChurn::connectionFailed);
+        opening.insert(connection, nextDueNs);
+        connection->open();
+        ++opened;
+        nextDueNs += intervalNs;
+    }
+
+    if (nextDueNs >= endNs)
+    {
+        openTimer.stop();
+        if (opening.isEmpty())
+        {
+            finishRun();
+        }
+        else
+        {
+            drainTimer.start(drainTimeoutMs);
+        }
+    }
+}
+
+void ConnectionChurn::connectionReady()
+{
+    LoadConnection *connection = qobject_cast<LoadConnection *>(sender());
+    record(opening.value(connection), LoadConnection::nowNs(), true);
+    close(connection);
+}
+
+void ConnectionChurn::connectionFailed(QString errorMessage)
+{
+    LoadConnection *connection = qobject_cast<LoadConnection *>(sender());
+    if (!opening.contains(connection))
+    {
+        return;
+    }
+    if (errors == 0)
+    {
+        QTextStream(stderr) << "Connection failed: " << errorMessage << Qt::endl;
+    }
+    record(opening.value(connection), LoadConnection::nowNs(), false);
+    close(connection);
+}
+
+void ConnectionChurn::drainTimedOut()
+{
+    // Still unanswered, counted as failed at the latency they reached so far
+    const qint64 nowNs = LoadConnection::nowNs();
+    QTextStream(stderr) << opening.size() << " connections were still waiting for their hello "
+                        << drainTimeoutMs / 1000 << " s after the last was opened" << Qt::endl;
+    const QList<LoadConnection *> waiting = opening.keys();
+    for (LoadConnection *connection : waiting)
+    {
+        record(opening.value(connection), nowNs, false);
+        close(connection);
+    }
+}
+
+void ConnectionChurn::record(qint64 scheduledNs, qint64 endedNs, bool succeeded)
+{
+    // Only what was due after the warmup counts
+    if (scheduledNs < measureStartNs)
+    {
+        return;
+    }
+    latency.record(static_cast<quint64>(endedNs - scheduledNs) / 1000);
+    if (!succeeded)
+    {
+        ++errors;
+    }
+}
+
+void ConnectionChurn::close(LoadConnection *connection)
+{
+    opening.remove(connection);
+    // Closes the socket; the server sees the disconnect and frees the worker slot
+    connection->deleteLater();
+    if (opening.isEmpty() && !openTimer.isActive() && nextDueNs >= endNs)
+    {
+        finishRun();
+    }
+}
+
+// Milliseconds with microsecond resolution
+static QString milliseconds(quint64 microseconds)
+{
+    return QString::number(microseconds / 1000.0, 'f', 3);
+}
+
+void ConnectionChurn::finishRun()
+{
+    if (done)
+    {
+        return;
+    }
+    done = true;
+    drainTimer.stop();
+
+    QTextStream out(stdout);
+    const double seconds = options.durationSeconds;
+    out << Qt::endl << "Opened " << opened << "; measured " << latency.count() << " over " << seconds << " s"
+        << Qt::endl;
+    if (lateOpens > 0)
+    {
+        out << "Warning: " << lateOpens << " connections were opened over 1 ms late, "
+            << "the generator could not keep up with the rate" << Qt::endl;
+    }
+
+    out << Qt::endl << "Connect to hello answered, from when each connection was due:" << Qt::endl;
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9")
+               .arg("count", 8).arg("errors", 7).arg("conn/s", 9).arg("mean ms", 9).arg("p50 ms", 9)
+               .arg("p90 ms", 9).arg("p99 ms", 9).arg("p99.9 ms", 9).arg("max ms", 9) << Qt::endl;
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9")
+               .arg(latency.count(), 8).arg(errors, 7)
+               .arg((latency.count() - errors) / seconds, 9, 'f', 1)
+               .arg(QString::number(latency.meanUs() / 1000.0, 'f', 3), 9)
+               .arg(milliseconds(latency.percentileUs(0.5)), 9)
+               .arg(milliseconds(latency.percentileUs(0.9)), 9)
+               .arg(milliseconds(latency.percentileUs(0.99)), 9)
+               .arg(milliseconds(latency.percentileUs(0.999)), 9)
+               .arg(milliseconds(latency.maxUs()), 9) << Qt::endl;
+
+    emit finished(errors == 0 ? 0 : 1);
+}
@@ -0,0 +1,52 @@
+#ifndef CONNECTIONCHURN_H
+#define CONNECTIONCHURN_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+
+#include "loadgenerator.h"
+
+// Open-loop connection churn: new connections are due at the given rate,
+// each one is closed as soon as its hello was answered. Measures how fast
+// the server accepts, hands a socket to a worker and answers, from when
+// the connection was due to the hello response.
+class ConnectionChurn : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConnectionChurn(const LoadOptions &options, QObject *parent = nullptr);
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void openDueConnections();
+    void connectionReady();
+    void connectionFailed(QString errorMessage);
+    void drainTimedOut();
+
+private:
+    LoadOptions options;
+    QTimer openTimer;
+    QTimer drainTimer;
+    qint64 intervalNs = 0;
+    qint64 nextDueNs = 0;
+    qint64 measureStartNs = 0;
+    qint64 endNs = 0;
+    // When each connection still waiting for its hello was due
+    QHash<LoadConnection *, qint64> opening;
+    quint64 opened = 0;
+    quint64 lateOpens = 0;
+    LatencyHistogram latency;
+    quint64 errors = 0;
+    bool done = false;
+
+    void record(qint64 scheduledNs, qint64 endedNs, bool succeeded);
+    void close(LoadConnection *connection);
+    void finishRun();
+};
+
+#endif // CONNECTIONCHURN_H
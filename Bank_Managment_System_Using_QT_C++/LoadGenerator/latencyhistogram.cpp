@@ -0,0 +1,75 @@
+#include "latencyhistogram.h"
+
+#include <QtAlgorithms>
+
+LatencyHistogram::LatencyHistogram()
+    : buckets(BucketCount, 0)
+{}
+
+void LatencyHistogram::record(quint64 microseconds)
+{
+    ++buckets[bucketOf(microseconds)];
+    ++samples;
+    sumUs += microseconds;
+    largestUs = qMax(largestUs, microseconds);
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return samples;
+}
+
+quint64 LatencyHistogram::maxUs() const
+{
+    return largestUs;
+}
+
+double LatencyHistogram::meanUs() const
+{
+    return samples == 0 ? 0.0 : static_cast<double>(sumUs) / samples;
+}
+
+quint64 LatencyHistogram::percentileUs(double quantile) const
+{
+    if (samples == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the sample at this quantile, at least the first one
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(quantile * samples + 0.5));
+    quint64 seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        seen += buckets[bucket];
+        if (seen >= rank)
+        {
+            // Never report more than was actually seen
+            return qMin(bucketUpperBound(bucket), largestUs);
+        }
+    }
+    return largestUs;
+}
+
+int LatencyHistogram::bucketOf(quint64 microseconds)
+{
+    if (microseconds < SubBuckets)
+    {
+        return static_cast<int>(microseconds);
+    }
+    const int highestBit = 63 - qCountLeadingZeroBits(microseconds);
+    const int shift = highestBit - SubBucketBits;
+    const int bucket = (shift + 1) * SubBuckets + static_cast<int>((microseconds >> shift) & (SubBuckets - 1));
+    return qMin(bucket, BucketCount - 1);
+}
+
+quint64 LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < SubBuckets)
+    {
+        return bucket;
+    }
+    const int shift = bucket / SubBuckets - 1;
+    const quint64 subBucket = bucket % SubBuckets;
+    return ((SubBuckets + subBucket + 1) << shift) - 1;
+}
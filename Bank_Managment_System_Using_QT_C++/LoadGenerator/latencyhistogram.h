@@ -0,0 +1,35 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+#include <vector>
+
+// Latencies in microseconds, in log-linear buckets like the server's metrics
+// but finer: exact below 32, then 32 per power of two (about 3% precision).
+class LatencyHistogram
+{
+public:
+    static const int SubBucketBits = 5;
+    static const int SubBuckets = 1 << SubBucketBits;
+    static const int BucketCount = SubBuckets * (40 - SubBucketBits + 2);
+
+    LatencyHistogram();
+
+    void record(quint64 microseconds);
+    quint64 count() const;
+    quint64 maxUs() const;
+    double meanUs() const;
+    // Upper bound of the bucket holding the quantile, 0 without samples
+    quint64 percentileUs(double quantile) const;
+
+private:
+    std::vector<quint64> buckets;
+    quint64 samples = 0;
+    quint64 sumUs = 0;
+    quint64 largestUs = 0;
+
+    static int bucketOf(quint64 microseconds);
+    static quint64 bucketUpperBound(int bucket);
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,101 @@
+#include "loadconnection.h"
+#include "bankprotocol.h"
+
+#include <chrono>
+
+LoadConnection::LoadConnection(const QString &host, quint16 port, MessageCodec::Encoding encoding,
+                               bool acceptCompression, QObject *parent)
+    : QObject(parent), socket(new QTcpSocket(this)), host(host), port(port),
+      wantedEncoding(encoding), acceptCompression(acceptCompression)
+{
+    connect(socket, &QTcpSocket::connected, this, &LoadConnection::connected);
+    connect(socket, &QTcpSocket::readyRead, this, &LoadConnection::readyRead);
+    connect(socket, &QTcpSocket::errorOccurred, this, &LoadConnection::socketError);
+}
+
+qint64 LoadConnection::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LoadConnection::open()
+{
+    // Small pipelined requests would otherwise wait for Nagle
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    socket->connectToHost(host, port);
+}
+
+void LoadConnection::connected()
+{
+    BankProtocol::HelloRequest hello;
+    hello.encodings = {MessageCodec::encodingName(wantedEncoding)};
+    if (acceptCompression)
+    {
+        hello.compression = {MessageFraming::CompressionName};
+    }
+    send(BankProtocol::encode(hello), nowNs());
+}
+
+void LoadConnection::send(const QJsonObject &request, qint64 scheduledNs)
+{
+    const qint64 sentNs = nowNs();
+    pending.enqueue({BankProtocol::requestIdOf(request), scheduledNs, sentNs});
+    socket->write(MessageFraming::encode(MessageCodec::encode(request, requestEncoding)));
+}
+
+int LoadConnection::outstanding() const
+{
+    return pending.size();
+}
+
+const QQueue<LoadConnection::PendingRequest> &LoadConnection::unanswered() const
+{
+    return pending;
+}
+
+void LoadConnection::readyRead()
+{
+    decoder.append(socket->readAll());
+
+    QByteArray responseData;
+    while (decoder.takeFrame(responseData))
+    {
+        const qint64 receivedNs = nowNs();
+        QJsonObject response;
+        if (!MessageCodec::decode(responseData, response) || pending.isEmpty())
+        {
+            emit failed("Unexpected response from the server");
+            socket->abort();
+            return;
+        }
+        const PendingRequest request = pending.dequeue();
+
+        if (!helloAnswered)
+        {
+            helloAnswered = true;
+            if (!response["helloSuccess"].toBool()
+                || !MessageCodec::encodingFromName(response["encoding"].toString(), requestEncoding))
+            {
+                emit failed("Hello failed: " + response["errorMessage"].toString());
+                socket->abort();
+                return;
+            }
+            emit ready();
+            continue;
+        }
+
+        emit responseReceived(request.requestId, response, request.scheduledNs, request.sentNs, receivedNs);
+    }
+
+    if (decoder.hasError())
+    {
+        emit failed("Malformed frame from the server");
+        socket->abort();
+    }
+}
+
+void LoadConnection::socketError()
+{
+    emit failed(socket->errorString());
+}
@@ -0,0 +1,64 @@
+#ifndef LOADCONNECTION_H
+#define LOADCONNECTION_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QJsonObject>
+#include <QQueue>
+
+#include "messagecodec.h"
+#include "messageframing.h"
+
+// One pipelined connection to the server. Requests go out as soon as they are
+// sent; the server answers a connection's requests in order, so each response
+// is matched to the oldest request still waiting.
+class LoadConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadConnection(const QString &host, quint16 port, MessageCodec::Encoding encoding,
+                   bool acceptCompression, QObject *parent = nullptr);
+
+    // Connects and sends the hello, ready() follows its answer
+    void open();
+    // scheduledNs is when the request was due, which may be before now
+    void send(const QJsonObject &request, qint64 scheduledNs);
+    int outstanding() const;
+
+    struct PendingRequest
+    {
+        int requestId;
+        qint64 scheduledNs;
+        qint64 sentNs;
+    };
+    // Sent and not answered yet, oldest first
+    const QQueue<PendingRequest> &unanswered() const;
+
+    // Steady clock every timestamp of the load generator is taken from
+    static qint64 nowNs();
+
+signals:
+    void ready();
+    void failed(QString errorMessage);
+    void responseReceived(int requestId, QJsonObject response, qint64 scheduledNs, qint64 sentNs, qint64 receivedNs);
+
+private slots:
+    void connected();
+    void readyRead();
+    void socketError();
+
+private:
+    QTcpSocket *socket;
+    QString host;
+    quint16 port;
+    FrameDecoder decoder;
+    // Asked for in the hello; requests use it once the server agreed
+    MessageCodec::Encoding wantedEncoding;
+    MessageCodec::Encoding requestEncoding = MessageCodec::Encoding::Json;
+    bool acceptCompression;
+    bool helloAnswered = false;
+    QQueue<PendingRequest> pending;
+};
+
+#endif // LOADCONNECTION_H
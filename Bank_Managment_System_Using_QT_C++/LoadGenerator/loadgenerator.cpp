@@ -0,0 +1,526 @@
+#include "loadgenerator.h"
+#include "bankprotocol.h"
+
+#include <QDateTime>
+#include <QStringList>
+#include <QTextStream>
+
+static const char *const requestNames[LoadGenerator::MixRequestCount] =
+{
+    "login",
+    "getAccountNumber",
+    "getBalance",
+    "createAccount",
+    "deleteAccount",
+    "fetchAllUserData",
+    "makeTransaction",
+    "makeTransfer",
+    "transactionHistory",
+    "updateUserData",
+    "adminGetBalance",
+    "adminTransactionHistory"
+};
+
+// Every account the generator creates gets this password
+static const char *const accountPassword = "load";
+static const double seedBalance = 1000000.0;
+static const int historyPageSize = 50;
+static const int drainTimeoutMs = 10000;
+
+LoadGenerator::LoadGenerator(const LoadOptions &options, QObject *parent)
+    : QObject(parent), options(options), random(options.seed)
+{
+    sendTimer.setTimerType(Qt::PreciseTimer);
+    connect(&sendTimer, &QTimer::timeout, this, &LoadGenerator::sendDueRequests);
+    drainTimer.setSingleShot(true);
+    connect(&drainTimer, &QTimer::timeout, this, &LoadGenerator::drainTimedOut);
+}
+
+QVector<int> LoadGenerator::defaultMix()
+{
+    // Mostly balance checks and money movement, like the client's user view
+    return {10, 5, 25, 2, 2, 1, 20, 15, 10, 3, 5, 2};
+}
+
+bool LoadGenerator::parseMix(const QString &text, QVector<int> &mix)
+{
+    mix = QVector<int>(MixRequestCount, 0);
+    int total = 0;
+    for (const QString &entry : text.split(',', Qt::SkipEmptyParts))
+    {
+        const QStringList parts = entry.split(':');
+        bool idValid = false;
+        bool weightValid = false;
+        const int requestId = parts.value(0).trimmed().toInt(&idValid);
+        const int weight = parts.value(1).trimmed().toInt(&weightValid);
+        if (parts.size() != 2 || !idValid || !weightValid
+            || requestId < 0 || requestId >= MixRequestCount || weight < 0)
+        {
+            return false;
+        }
+        mix[requestId] = weight;
+        total += weight;
+    }
+    return total > 0;
+}
+
+void LoadGenerator::start()
+{
+    int total = 0;
+    for (int weight : options.mix)
+    {
+        total += weight;
+        cumulativeMix.append(total);
+    }
+
+    // Usernames of this run can't collide with an earlier one
+    runTag = "lg_" + QString::number(QDateTime::currentMSecsSinceEpoch(), 36);
+
+    setupConnection = new LoadConnection(options.host, options.port, options.encoding, options.compression, this);
+    connections.append(setupConnection);
+    for (int i = 0; i < options.connections; ++i)
+    {
+        connections.append(new LoadConnection(options.host, options.port, options.encoding, options.compression, this));
+    }
+    for (LoadConnection *connection : connections)
+    {
+        connect(connection, &LoadConnection::ready, this, &LoadGenerator::connectionReady);
+        connect(connection, &LoadConnection::failed, this, &LoadGenerator::connectionFailed);
+        connect(connection, &LoadConnection::responseReceived, this, &LoadGenerator::responseReceived);
+        connection->open();
+    }
+    // The load goes only to the others
+    connections.removeFirst();
+}
+
+void LoadGenerator::connectionReady()
+{
+    if (++readyConnections == connections.size() + 1)
+    {
+        seedAccounts();
+    }
+}
+
+void LoadGenerator::connectionFailed(QString errorMessage)
+{
+    if (phase == Phase::Done)
+    {
+        return;
+    }
+    QTextStream(stderr) << "Connection failed: " << errorMessage << Qt::endl;
+    finish(1);
+}
+
+void LoadGenerator::sendSetupRequest(const QJsonObject &request)
+{
+    ++setupOutstanding;
+    setupConnection->send(request, LoadConnection::nowNs());
+}
+
+void LoadGenerator::seedAccounts()
+{
+    phase = Phase::Seeding;
+    QTextStream(stdout) << "Creating " << options.accounts << " accounts as " << runTag << "_*" << Qt::endl;
+    for (int i = 0; i < options.accounts; ++i)
+    {
+        BankProtocol::CreateAccountRequest request;
+        request.username = QString("%1_%2").arg(runTag).arg(i);
+        request.password = accountPassword;
+        request.name = QString("Load %1").arg(i);
+        request.age = 30;
+        seededAccounts.append({request.username, 0});
+        sendSetupRequest(BankProtocol::encode(request));
+    }
+}
+
+void LoadGenerator::fundAccounts()
+{
+    // Withdrawals and transfers of the run then never hit an empty account
+    phase = Phase::Funding;
+    for (const SeededAccount &account : seededAccounts)
+    {
+        BankProtocol::MakeTransactionRequest request;
+        request.accountNumber = account.accountNumber;
+        request.amount = seedBalance;
+        sendSetupRequest(BankProtocol::encode(request));
+    }
+}
+
+void LoadGenerator::handleSetupResponse(int requestId, const QJsonObject &response)
+{
+    const BankProtocol::RequestInfo *info = BankProtocol::requestInfo(requestId);
+    const bool succeeded = info != nullptr && response[info->successKey].toBool();
+    const int index = setupOutstanding > 0 ? seededAccounts.size() - setupOutstanding : 0;
+    --setupOutstanding;
+
+    if (phase == Phase::CleaningUp)
+    {
+        // A failed delete leaves the account behind, nothing to stop for
+        if (setupOutstanding == 0)
+        {
+            QTextStream(stdout) << "Deleted the accounts of " << runTag << Qt::endl;
+            finish(0);
+        }
+        return;
+    }
+
+    if (!succeeded)
+    {
+        QTextStream(stderr) << "Setting up the accounts failed: " << response["errorMessage"].toString() << Qt::endl;
+        finish(1);
+        return;
+    }
+
+    if (phase == Phase::Seeding)
+    {
+        // Answered in the order they were sent
+        seededAccounts[index].accountNumber = response["accountNumber"].toInteger();
+    }
+
+    if (setupOutstanding == 0)
+    {
+        if (phase == Phase::Seeding)
+        {
+            fundAccounts();
+        }
+        else
+        {
+            startRun();
+        }
+    }
+}
+
+void LoadGenerator::startRun()
+{
+    phase = Phase::Running;
+    intervalNs = static_cast<qint64>(1e9 / options.rate);
+    nextDueNs = LoadConnection::nowNs();
+    measureStartNs = nextDueNs + options.warmupSeconds * 1000000000LL;
+    endNs = measureStartNs + options.durationSeconds * 1000000000LL;
+
+    QTextStream(stdout) << "Sending " << options.rate << " requests/s on " << options.connections
+                        << " connections for " << options.warmupSeconds << " s warmup and "
+                        << options.durationSeconds << " s measured" << Qt::endl;
+
+    // A zero timer runs on every event loop pass; a 1 ms timer would send
+    // everything up to a millisecond late and count that against the server
+    sendTimer.start(0);
+}
+
+void LoadGenerator::sendDueRequests()
+{
+    const qint64 nowNs = LoadConnection::nowNs();
+    while (nextDueNs <= nowNs && nextDueNs < endNs)
+    {
+        if (nowNs - nextDueNs > 1000000)
+        {
+            ++lateSends;
+        }
+        const int requestId = pickRequestId();
+        connections[nextConnection]->send(buildRequest(requestId), nextDueNs);
+        nextConnection = (nextConnection + 1) % connections.size();
+        ++sent;
+        nextDueNs += intervalNs;
+    }
+
+    if (nextDueNs >= endNs)
+    {
+        sendTimer.stop();
+        phase = Phase::Draining;
+        if (answered == sent)
+        {
+            finishRun();
+        }
+        else
+        {
+            drainTimer.start(drainTimeoutMs);
+        }
+    }
+}
+
+void LoadGenerator::responseReceived(int requestId, QJsonObject response, qint64 scheduledNs,
+                                     qint64 sentNs, qint64 receivedNs)
+{
+    if (sender() == setupConnection)
+    {
+        if (setupOutstanding > 0)
+        {
+            handleSetupResponse(requestId, response);
+        }
+        return;
+    }
+    if (phase != Phase::Running && phase != Phase::Draining)
+    {
+        return;
+    }
+
+    ++answered;
+    if (requestId >= 0 && requestId < MixRequestCount)
+    {
+        const bool succeeded = response[BankProtocol::requests[requestId].successKey].toBool();
+        if (requestId == static_cast<int>(BankProtocol::RequestId::CreateAccount) && succeeded)
+        {
+            createdAccounts.append(response["accountNumber"].toInteger());
+        }
+        recordResult(requestId, scheduledNs, sentNs, receivedNs, succeeded);
+    }
+
+    if (phase == Phase::Draining && answered == sent)
+    {
+        finishRun();
+    }
+}
+
+void LoadGenerator::drainTimedOut()
+{
+    QTextStream(stderr) << sent - answered << " requests were still unanswered "
+                        << drainTimeoutMs / 1000 << " s after the last was sent" << Qt::endl;
+
+    // Counted as failed at the latency they reached so far, leaving them out
+    // would hide the slowest requests of the run
+    const qint64 nowNs = LoadConnection::nowNs();
+    for (LoadConnection *connection : connections)
+    {
+        for (const LoadConnection::PendingRequest &request : connection->unanswered())
+        {
+            recordResult(request.requestId, request.scheduledNs, request.sentNs, nowNs, false);
+        }
+    }
+    finishRun();
+}
+
+void LoadGenerator::recordResult(int requestId, qint64 scheduledNs, qint64 sentNs, qint64 endedNs, bool succeeded)
+{
+    // Only what was due after the warmup counts
+    if (requestId < 0 || requestId >= MixRequestCount || scheduledNs < measureStartNs)
+    {
+        return;
+    }
+    for (RequestStats *requestStats : {&stats[requestId], &overall})
+    {
+        requestStats->responseTime.record(static_cast<quint64>(endedNs - scheduledNs) / 1000);
+        requestStats->serviceTime.record(static_cast<quint64>(endedNs - sentNs) / 1000);
+        if (!succeeded)
+        {
+            ++requestStats->errors;
+        }
+    }
+}
+
+void LoadGenerator::finishRun()
+{
+    drainTimer.stop();
+    printReport();
+    if (options.keepAccounts)
+    {
+        finish(0);
+        return;
+    }
+    cleanUp();
+}
+
+void LoadGenerator::cleanUp()
+{
+    phase = Phase::CleaningUp;
+    QVector<qint64> accountNumbers = createdAccounts;
+    for (const SeededAccount &account : seededAccounts)
+    {
+        accountNumbers.append(account.accountNumber);
+    }
+    if (accountNumbers.isEmpty())
+    {
+        finish(0);
+        return;
+    }
+    for (qint64 accountNumber : accountNumbers)
+    {
+        BankProtocol::DeleteAccountRequest request;
+        request.accountNumber = accountNumber;
+        sendSetupRequest(BankProtocol::encode(request));
+    }
+}
+
+void LoadGenerator::finish(int exitCode)
+{
+    if (phase == Phase::Done)
+    {
+        return;
+    }
+    phase = Phase::Done;
+    sendTimer.stop();
+    drainTimer.stop();
+    emit finished(exitCode);
+}
+
+int LoadGenerator::pickRequestId()
+{
+    const int value = random.bounded(cumulativeMix.last());
+    for (int requestId = 0; requestId < cumulativeMix.size(); ++requestId)
+    {
+        if (value < cumulativeMix[requestId])
+        {
+            return requestId;
+        }
+    }
+    return 0;
+}
+
+const LoadGenerator::SeededAccount &LoadGenerator::randomAccount()
+{
+    return seededAccounts[random.bounded(seededAccounts.size())];
+}
+
+QJsonObject LoadGenerator::buildRequest(int requestId)
+{
+    using BankProtocol::RequestId;
+
+    switch (static_cast<RequestId>(requestId))
+    {
+    case RequestId::Login:
+    {
+        BankProtocol::LoginRequest request;
+        request.username = randomAccount().username;
+        request.password = accountPassword;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::GetAccountNumber:
+    {
+        BankProtocol::GetAccountNumberRequest request;
+        request.username = randomAccount().username;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::GetBalance:
+    {
+        BankProtocol::GetBalanceRequest request;
+        request.accountNumber = randomAccount().accountNumber;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::CreateAccount:
+    {
+        BankProtocol::CreateAccountRequest request;
+        request.username = QString("%1_c%2").arg(runTag).arg(createdSerial++);
+        request.password = accountPassword;
+        request.name = "Load client";
+        request.age = 30;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::DeleteAccount:
+    {
+        // Only accounts created during the run; with none left yet the delete
+        // of account 0 fails and shows up as an error
+        BankProtocol::DeleteAccountRequest request;
+        request.accountNumber = createdAccounts.isEmpty() ? 0 : createdAccounts.takeLast();
+        return BankProtocol::encode(request);
+    }
+    case RequestId::FetchAllUserData:
+        return BankProtocol::encode(BankProtocol::FetchAllUserDataRequest());
+    case RequestId::MakeTransaction:
+    {
+        // Deposits and withdrawals of up to 10.00
+        BankProtocol::MakeTransactionRequest request;
+        request.accountNumber = randomAccount().accountNumber;
+        request.amount = (random.bounded(2001) - 1000) / 100.0;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::MakeTransfer:
+    {
+        BankProtocol::MakeTransferRequest request;
+        request.fromAccountNumber = randomAccount().accountNumber;
+        do
+        {
+            request.toAccountNumber = randomAccount().accountNumber;
+        } while (request.toAccountNumber == request.fromAccountNumber && seededAccounts.size() > 1);
+        request.amount = random.bounded(1, 1001) / 100.0;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::TransactionHistory:
+    {
+        // The full history grows with the run, a page keeps the cost steady
+        BankProtocol::TransactionHistoryRequest request;
+        request.accountNumber = randomAccount().accountNumber;
+        request.pageSize = historyPageSize;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::UpdateUserData:
+    {
+        const SeededAccount &account = randomAccount();
+        BankProtocol::UpdateUserDataRequest request;
+        request.username = account.username;
+        request.name = QString("Load %1").arg(random.bounded(1000000));
+        request.password = accountPassword;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::AdminGetBalance:
+    {
+        BankProtocol::AdminGetBalanceRequest request;
+        request.accountNumber = randomAccount().accountNumber;
+        return BankProtocol::encode(request);
+    }
+    case RequestId::AdminTransactionHistory:
+    {
+        BankProtocol::AdminTransactionHistoryRequest request;
+        request.accountNumber = randomAccount().accountNumber;
+        request.pageSize = historyPageSize;
+        return BankProtocol::encode(request);
+    }
+    default:
+        break;
+    }
+    return QJsonObject();
+}
+
+// Milliseconds with microsecond resolution
+static QString milliseconds(quint64 microseconds)
+{
+    return QString::number(microseconds / 1000.0, 'f', 3);
+}
+
+void LoadGenerator::printReport() const
+{
+    QTextStream out(stdout);
+    const double seconds = options.durationSeconds;
+
+    out << Qt::endl << "Sent " << sent << ", answered " << answered << "; measured "
+        << overall.responseTime.count() << " over " << seconds << " s" << Qt::endl;
+    if (lateSends > 0)
+    {
+        out << "Warning: " << lateSends << " requests went out over 1 ms late, "
+            << "the generator could not keep up with the rate" << Qt::endl;
+    }
+
+    const auto printTable = [&](const char *title, LatencyHistogram RequestStats::*histogram)
+    {
+        out << Qt::endl << title << Qt::endl;
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10")
+                   .arg("request", -24).arg("count", 8).arg("errors", 7).arg("req/s", 9)
+                   .arg("mean ms", 9).arg("p50 ms", 9).arg("p90 ms", 9).arg("p99 ms", 9)
+                   .arg("p99.9 ms", 9).arg("max ms", 9) << Qt::endl;
+
+        const auto printRow = [&](const QString &name, const RequestStats &requestStats)
+        {
+            const LatencyHistogram &latency = requestStats.*histogram;
+            out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10")
+                       .arg(name, -24).arg(latency.count(), 8).arg(requestStats.errors, 7)
+                       .arg(latency.count() / seconds, 9, 'f', 1)
+                       .arg(QString::number(latency.meanUs() / 1000.0, 'f', 3), 9)
+                       .arg(milliseconds(latency.percentileUs(0.5)), 9)
+                       .arg(milliseconds(latency.percentileUs(0.9)), 9)
+                       .arg(milliseconds(latency.percentileUs(0.99)), 9)
+                       .arg(milliseconds(latency.percentileUs(0.999)), 9)
+                       .arg(milliseconds(latency.maxUs()), 9) << Qt::endl;
+        };
+
+        for (int requestId = 0; requestId < MixRequestCount; ++requestId)
+        {
+            if ((stats[requestId].*histogram).count() > 0)
+            {
+                printRow(requestNames[requestId], stats[requestId]);
+            }
+        }
+        printRow("all", overall);
+    };
+
+    printTable("Response time, from when each request was due (corrected for coordinated omission):",
+               &RequestStats::responseTime);
+    printTable("Service time, from when each request was actually sent:", &RequestStats::serviceTime);
+}
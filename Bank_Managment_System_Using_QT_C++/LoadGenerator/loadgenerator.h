@@ -0,0 +1,130 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QVector>
+#include <QTimer>
+#include <QRandomGenerator>
+
+#include "loadconnection.h"
+#include "latencyhistogram.h"
+
+struct LoadOptions
+{
+    QString host = "localhost";
+    quint16 port = 54321;
+    int connections = 16;
+    // Requests per second over all connections
+    double rate = 1000.0;
+    int durationSeconds = 30;
+    // Sent at the full rate but left out of the report
+    int warmupSeconds = 5;
+    int accounts = 100;
+    // Relative share of each request ID from 0 to 11
+    QVector<int> mix;
+    MessageCodec::Encoding encoding = MessageCodec::Encoding::Json;
+    bool compression = false;
+    bool keepAccounts = false;
+    quint32 seed = 1;
+};
+
+// Open-loop load against a running server. Requests are due at fixed
+// intervals whatever the server's speed, and a request's latency is taken
+// from when it was due, not from when it went out; a stalled server so shows
+// up in the percentiles instead of silently lowering the offered load
+// (coordinated omission). Accounts are created before and deleted after the run.
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int MixRequestCount = 12;
+
+    explicit LoadGenerator(const LoadOptions &options, QObject *parent = nullptr);
+    void start();
+
+    // Weights from "id:weight,...", false if the text is invalid
+    static bool parseMix(const QString &text, QVector<int> &mix);
+    static QVector<int> defaultMix();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void connectionReady();
+    void connectionFailed(QString errorMessage);
+    void responseReceived(int requestId, QJsonObject response, qint64 scheduledNs, qint64 sentNs, qint64 receivedNs);
+    void sendDueRequests();
+    void drainTimedOut();
+
+private:
+    enum class Phase
+    {
+        Connecting,
+        Seeding,
+        Funding,
+        Running,
+        Draining,
+        CleaningUp,
+        Done
+    };
+
+    struct SeededAccount
+    {
+        QString username;
+        qint64 accountNumber;
+    };
+
+    struct RequestStats
+    {
+        LatencyHistogram responseTime;
+        LatencyHistogram serviceTime;
+        quint64 errors = 0;
+    };
+
+    LoadOptions options;
+    Phase phase = Phase::Connecting;
+    QVector<LoadConnection *> connections;
+    // Seeding and cleanup get a connection of their own, idle during the run
+    LoadConnection *setupConnection = nullptr;
+    int readyConnections = 0;
+    int setupOutstanding = 0;
+    QString runTag;
+    QVector<SeededAccount> seededAccounts;
+    // Accounts created during the run, what DeleteAccount requests remove
+    QVector<qint64> createdAccounts;
+    quint64 createdSerial = 0;
+
+    QRandomGenerator random;
+    QVector<int> cumulativeMix;
+    QTimer sendTimer;
+    QTimer drainTimer;
+    qint64 intervalNs = 0;
+    qint64 nextDueNs = 0;
+    qint64 measureStartNs = 0;
+    qint64 endNs = 0;
+    int nextConnection = 0;
+    quint64 sent = 0;
+    quint64 answered = 0;
+    // Sends the generator itself got to over a millisecond late
+    quint64 lateSends = 0;
+    RequestStats stats[MixRequestCount];
+    RequestStats overall;
+
+    void seedAccounts();
+    void fundAccounts();
+    void startRun();
+    void finishRun();
+    void cleanUp();
+    void finish(int exitCode);
+    void sendSetupRequest(const QJsonObject &request);
+    void handleSetupResponse(int requestId, const QJsonObject &response);
+
+    int pickRequestId();
+    const SeededAccount &randomAccount();
+    QJsonObject buildRequest(int requestId);
+    void recordResult(int requestId, qint64 scheduledNs, qint64 sentNs, qint64 endedNs, bool succeeded);
+    void printReport() const;
+};
+
+#endif // LOADGENERATOR_H
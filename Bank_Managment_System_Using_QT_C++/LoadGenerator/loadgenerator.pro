@@ -0,0 +1,32 @@
+QT = core network
+
+CONFIG += c++17 cmdline static
+
+INCLUDEPATH += ../Common
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += \
+        ../Common/messagecodec.cpp \
+        ../Common/messageframing.cpp \
+        connectionchurn.cpp \
+        latencyhistogram.cpp \
+        loadconnection.cpp \
+        loadgenerator.cpp \
+        main.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+HEADERS += \
+    ../Common/bankprotocol.h \
+    ../Common/messagecodec.h \
+    ../Common/messageframing.h \
+    connectionchurn.h \
+    latencyhistogram.h \
+    loadconnection.h \
+    loadgenerator.h
@@ -0,0 +1,91 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include "loadgenerator.h"
+#include "connectionchurn.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("loadgenerator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Open-loop load generator for the bank server. It creates its own "
+                                     "accounts, sends a mix of requests 0-11 at a fixed rate and reports "
+                                     "throughput and latency percentiles per request. With --churn it "
+                                     "opens connections at the rate instead, closes each after its hello "
+                                     "and reports connections/s and their latency; run it against a "
+                                     "thread-per-connection build of the server to compare the two.");
+    parser.addHelpOption();
+
+    const LoadOptions defaults;
+    const QCommandLineOption hostOption("host", "Server host.", "host", defaults.host);
+    const QCommandLineOption portOption("port", "Server port.", "port", QString::number(defaults.port));
+    const QCommandLineOption connectionsOption({"c", "connections"}, "Connections the load is spread over.",
+                                               "count", QString::number(defaults.connections));
+    const QCommandLineOption rateOption({"r", "rate"}, "Requests per second over all connections.",
+                                        "rate", QString::number(defaults.rate));
+    const QCommandLineOption durationOption({"d", "duration"}, "Measured seconds.",
+                                            "seconds", QString::number(defaults.durationSeconds));
+    const QCommandLineOption warmupOption("warmup", "Seconds at full rate before measuring.",
+                                          "seconds", QString::number(defaults.warmupSeconds));
+    const QCommandLineOption accountsOption("accounts", "Accounts created for the run, at least 2.",
+                                            "count", QString::number(defaults.accounts));
+    const QCommandLineOption mixOption("mix", "Request mix as id:weight pairs, e.g. 2:50,6:30,7:20. "
+                                              "Keep 4 (deleteAccount) at or below 3 (createAccount), "
+                                              "it deletes accounts created during the run.", "mix");
+    const QCommandLineOption encodingOption("encoding", "Payload encoding, json or cbor.", "encoding", "json");
+    const QCommandLineOption compressionOption("compression", "Accept compressed responses.");
+    const QCommandLineOption keepOption("keep-accounts", "Leave the created accounts in the database.");
+    const QCommandLineOption churnOption("churn", "Open and close connections at --rate per second "
+                                                  "instead of sending requests.");
+    const QCommandLineOption seedOption("seed", "Seed of the request mix.", "seed", QString::number(defaults.seed));
+    parser.addOptions({hostOption, portOption, connectionsOption, rateOption, durationOption, warmupOption,
+                       accountsOption, mixOption, encodingOption, compressionOption, keepOption, churnOption,
+                       seedOption});
+    parser.process(a);
+
+    LoadOptions options;
+    options.host = parser.value(hostOption);
+    options.port = static_cast<quint16>(parser.value(portOption).toUInt());
+    options.connections = parser.value(connectionsOption).toInt();
+    options.rate = parser.value(rateOption).toDouble();
+    options.durationSeconds = parser.value(durationOption).toInt();
+    options.warmupSeconds = parser.value(warmupOption).toInt();
+    options.accounts = parser.value(accountsOption).toInt();
+    options.compression = parser.isSet(compressionOption);
+    options.keepAccounts = parser.isSet(keepOption);
+    options.seed = parser.value(seedOption).toUInt();
+    options.mix = LoadGenerator::defaultMix();
+
+    QTextStream errors(stderr);
+    if (parser.isSet(mixOption) && !LoadGenerator::parseMix(parser.value(mixOption), options.mix))
+    {
+        errors << "Invalid --mix, expected id:weight pairs with ids 0-11" << Qt::endl;
+        return 2;
+    }
+    if (!MessageCodec::encodingFromName(parser.value(encodingOption), options.encoding))
+    {
+        errors << "Unknown --encoding " << parser.value(encodingOption) << Qt::endl;
+        return 2;
+    }
+    if (options.port == 0 || options.connections < 1 || options.rate <= 0 || options.durationSeconds < 1
+        || options.warmupSeconds < 0 || options.accounts < 2)
+    {
+        errors << "Invalid options, see --help" << Qt::endl;
+        return 2;
+    }
+
+    if (parser.isSet(churnOption))
+    {
+        ConnectionChurn churn(options);
+        QObject::connect(&churn, &ConnectionChurn::finished, &a, &QCoreApplication::exit, Qt::QueuedConnection);
+        churn.start();
+        return a.exec();
+    }
+
+    LoadGenerator generator(options);
+    QObject::connect(&generator, &LoadGenerator::finished, &a, &QCoreApplication::exit, Qt::QueuedConnection);
+    generator.start();
+    return a.exec();
+}
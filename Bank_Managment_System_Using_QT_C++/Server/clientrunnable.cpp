@@ -1,7 +1,15 @@
 #include "ClientRunnable.h"
+#include "serverconfig.h"
+#include "servermetrics.h"
+#include "requesttracer.h"
 
-ClientRunnable::ClientRunnable(qintptr socketDescriptor, QObject *parent)
-    : QObject(parent), socketDescriptor(socketDescriptor), logger("ClientRunnable")
+#include <QAtomicInteger>
+
+// Makes database connection names unique even when a descriptor is reused
+static QAtomicInteger<quint64> sessionSerial;
+
+ClientRunnable::ClientRunnable(quint64 clientId, qintptr socketDescriptor, QObject *parent)
+    : QObject(parent), clientId(clientId), socketDescriptor(socketDescriptor), logger("ClientRunnable")
 {
     logger.log("Object Created.");
 }
@@ -13,39 +21,186 @@ ClientRunnable::~ClientRunnable()
 
 void ClientRunnable::run()
 {
-    // Create QTcpSocket
-    clientSocket = new QTcpSocket();
+    // Create QTcpSocket, owned by this runnable so it goes away with it
+    clientSocket = new QTcpSocket(this);
 
     if (!clientSocket->setSocketDescriptor(socketDescriptor)) {
-        logger.log("Failed to set socket descriptor. Thread will be finished.");
-        emit clientDisconnected(socketDescriptor);
+        logger.log("Failed to set socket descriptor. Client will be dropped.");
+        emit clientDisconnected(clientId, socketDescriptor);
+        deleteLater();
         return;
     }
 
+    // One handler, and so one open database connection, for the whole session
+    QString connectionName = QString("Client-%1-%2").arg(socketDescriptor).arg(sessionSerial.fetchAndAddRelaxed(1));
+    requestHandler = new RequestHandler(connectionName, this);
+    connect(requestHandler, &RequestHandler::requestDecoded, this, &ClientRunnable::trackRequest);
+    connect(requestHandler, &RequestHandler::responseReady, this, &ClientRunnable::queueResponse);
+    connect(requestHandler, &RequestHandler::streamReady, this, &ClientRunnable::queueStream);
+    connect(requestHandler, &RequestHandler::eventReady, this, &ClientRunnable::sendEvent);
+    // A stream waiting on a full socket buffer continues once it drained
+    connect(clientSocket, &QTcpSocket::bytesWritten, this, &ClientRunnable::sendPendingResponses);
+
     connect(clientSocket, &QTcpSocket::readyRead, this, &ClientRunnable::readyRead);
     connect(clientSocket, &QTcpSocket::disconnected, this, &ClientRunnable::socketDisconnected);
+    ServerMetrics::add(ServerMetrics::ConnectionsOpened);
     logger.log(QString("Client setup completed in thread ID: %1").
                arg((quintptr)QThread::currentThreadId()));
 }
 
 void ClientRunnable::readyRead()
 {
-    QByteArray data = clientSocket->readAll();
-    RequestHandler requestHandler(QString::number(socketDescriptor));
-    QByteArray responseData = requestHandler.handleRequest(data);
-    sendResponseToClient(responseData);
+    requestDecoder.append(clientSocket->readAll());
+
+    // A single wakeup may carry several pipelined requests or only part of one
+    QByteArray requestData;
+    while (requestDecoder.takeFrame(requestData))
+    {
+        const quint64 requestSequence = nextRequestSequence++;
+        RequestTiming timing;
+        timing.arrivedNs = ServerMetrics::nowNs();
+        timing.traceId = RequestTracer::startTrace();
+        requestTimings.insert(requestSequence, timing);
+        ServerMetrics::add(ServerMetrics::InFlight);
+
+        requestHandler->handleRequest(requestSequence, requestData, timing.traceId);
+    }
+
+    if (requestDecoder.hasError())
+    {
+        logger.log("Received a malformed frame, dropping the client.");
+        clientSocket->abort();
+    }
 }
 
 void ClientRunnable::sendResponseToClient(QByteArray responseData)
 {
-    if (clientSocket->write(responseData) == -1) {
+    QByteArray frame = MessageFraming::encode(responseData, requestHandler->compressionThreshold(),
+                                              ServerConfig::instance().compressLevel);
+    if (frame.isEmpty())
+    {
+        // The RequestHandler keeps responses within the limit, skipping one would break the order
+        logger.log(QString("Response of %1 bytes is over the frame limit, dropping the client.").arg(responseData.size()));
+        clientSocket->abort();
+        return;
+    }
+    if (clientSocket->write(frame) == -1) {
         logger.log("Failed to write data to client: " + clientSocket->errorString());
     }
 }
 
+void ClientRunnable::queueResponse(quint64 requestSequence, QByteArray responseData)
+{
+    pendingResponses.insert(requestSequence, {responseData, nullptr});
+    sendPendingResponses();
+}
+
+void ClientRunnable::queueStream(quint64 requestSequence, ResultStream *stream)
+{
+    stream->setParent(this);
+    pendingResponses.insert(requestSequence, {QByteArray(), stream});
+    sendPendingResponses();
+}
+
+void ClientRunnable::trackRequest(quint64 requestSequence, int requestId)
+{
+    auto timing = requestTimings.find(requestSequence);
+    if (timing != requestTimings.end())
+    {
+        timing->requestId = requestId;
+    }
+}
+
+void ClientRunnable::addWriteTime(quint64 requestSequence, qint64 writeNs)
+{
+    auto timing = requestTimings.find(requestSequence);
+    if (timing != requestTimings.end())
+    {
+        timing->writeNs += writeNs;
+    }
+}
+
+void ClientRunnable::finishRequest(quint64 requestSequence)
+{
+    auto timing = requestTimings.find(requestSequence);
+    if (timing == requestTimings.end())
+    {
+        return;
+    }
+    const qint64 finishedNs = ServerMetrics::nowNs();
+    ServerMetrics::record(timing->requestId, ServerMetrics::Write, timing->writeNs);
+    ServerMetrics::record(timing->requestId, ServerMetrics::Total, finishedNs - timing->arrivedNs);
+
+    // A streamed response's writes are spread out, the span shows their sum ending here
+    RequestTracer::recordSpan(timing->traceId, "write", finishedNs - timing->writeNs, finishedNs);
+    RequestTracer::recordSpan(timing->traceId, "request", timing->arrivedNs, finishedNs);
+    ServerMetrics::add(ServerMetrics::InFlight, -1);
+    requestTimings.erase(timing);
+}
+
+void ClientRunnable::sendEvent(QJsonObject event)
+{
+    // A client that doesn't read its socket must not make us buffer without end
+    if (clientSocket->bytesToWrite() > ServerConfig::instance().notifyHighWaterBytes)
+    {
+        missedEvents++;
+        return;
+    }
+    if (missedEvents > 0)
+    {
+        event["missedEvents"] = missedEvents;
+        missedEvents = 0;
+    }
+    sendResponseToClient(requestHandler->createResponse(event));
+}
+
+void ClientRunnable::sendPendingResponses()
+{
+    const qint64 highWaterBytes = ServerConfig::instance().streamHighWaterBytes;
+
+    // Send everything that is now next in line
+    auto next = pendingResponses.find(nextResponseSequence);
+    while (next != pendingResponses.end())
+    {
+        ResultStream *stream = next->stream;
+        qint64 writeNs = 0;
+        if (stream != nullptr)
+        {
+            // Only read more rows while the socket isn't backed up
+            QByteArray chunk;
+            while (clientSocket->bytesToWrite() < highWaterBytes && stream->readChunk(chunk))
+            {
+                const qint64 writeStartNs = ServerMetrics::nowNs();
+                sendResponseToClient(chunk);
+                writeNs += ServerMetrics::nowNs() - writeStartNs;
+            }
+            if (!stream->atEnd())
+            {
+                addWriteTime(nextResponseSequence, writeNs);
+                return;
+            }
+            delete stream;
+        }
+        else
+        {
+            const qint64 writeStartNs = ServerMetrics::nowNs();
+            sendResponseToClient(next->responseData);
+            writeNs = ServerMetrics::nowNs() - writeStartNs;
+        }
+        addWriteTime(nextResponseSequence, writeNs);
+        finishRequest(nextResponseSequence);
+        pendingResponses.erase(next);
+        next = pendingResponses.find(++nextResponseSequence);
+    }
+}
+
 void ClientRunnable::socketDisconnected()
 {
-    emit clientDisconnected(socketDescriptor);
+    ServerMetrics::add(ServerMetrics::ConnectionsClosed);
+    // Requests that will never be answered leave the in-flight count
+    ServerMetrics::add(ServerMetrics::InFlight, -static_cast<qint64>(requestTimings.size()));
+    requestTimings.clear();
+    emit clientDisconnected(clientId, socketDescriptor);
     logger.log(QString("Client disconnected in thread ID: %1").
                arg((quintptr)QThread::currentThreadId()));
     deleteLater();
@@ -4,15 +4,20 @@
 #include <QObject>
 #include <QThread>
 #include <QTcpSocket>
+#include <QMap>
+#include <QHash>
 #include "RequestHandler.h"
 #include "Logger.h"
+#include "messageframing.h"
+#include "resultstream.h"
 
 class ClientRunnable : public QObject
 {
     Q_OBJECT
 
 public:
-    ClientRunnable(qintptr socketDescriptor, QObject *parent = nullptr);
+    // clientId is the server's key for the session, descriptors get reused once closed
+    ClientRunnable(quint64 clientId, qintptr socketDescriptor, QObject *parent = nullptr);
     ~ClientRunnable();
 
 public slots:
@@ -21,15 +26,48 @@ public slots:
     void sendResponseToClient(QByteArray responseData);
 
 signals:
-    void clientDisconnected(qintptr socketDescriptor);
+    void clientDisconnected(quint64 clientId, qintptr socketDescriptor);
 
 private slots:
     void socketDisconnected();
+    void queueResponse(quint64 requestSequence, QByteArray responseData);
+    void queueStream(quint64 requestSequence, ResultStream *stream);
+    void trackRequest(quint64 requestSequence, int requestId);
+    void sendEvent(QJsonObject event);
+    void sendPendingResponses();
 
 private:
+    quint64 clientId;
     qintptr socketDescriptor;
     QTcpSocket *clientSocket = nullptr;
+    RequestHandler *requestHandler = nullptr;
+    FrameDecoder requestDecoder;
+
+    // Writes finish out of band, responses are held back until every earlier one went out
+    quint64 nextRequestSequence = 0;
+    quint64 nextResponseSequence = 0;
+    struct PendingResponse
+    {
+        QByteArray responseData;
+        ResultStream *stream = nullptr;
+    };
+    QMap<quint64, PendingResponse> pendingResponses;
+    // Arrival of every unanswered request, for the latency metrics
+    struct RequestTiming
+    {
+        int requestId = -1;
+        qint64 arrivedNs = 0;
+        qint64 writeNs = 0;
+        // Non-zero if the request was sampled for tracing
+        quint64 traceId = 0;
+    };
+    QHash<quint64, RequestTiming> requestTimings;
+    // Events dropped while the socket was backed up, reported with the next one
+    qint64 missedEvents = 0;
     Logger logger;
+
+    void addWriteTime(quint64 requestSequence, qint64 writeNs);
+    void finishRequest(quint64 requestSequence);
 };
 
 #endif // CLIENTRUNNABLE_H
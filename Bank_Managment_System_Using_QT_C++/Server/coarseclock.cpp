@@ -0,0 +1,19 @@
+#include "coarseclock.h"
+
+#include <QDateTime>
+
+#ifdef Q_OS_LINUX
+#include <time.h>
+#endif
+
+qint64 CoarseClock::nowMicros()
+{
+#if defined(Q_OS_LINUX) && defined(CLOCK_REALTIME_COARSE)
+    struct timespec now;
+    if (clock_gettime(CLOCK_REALTIME_COARSE, &now) == 0)
+    {
+        return static_cast<qint64>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+    }
+#endif
+    return QDateTime::currentMSecsSinceEpoch() * 1000;
+}
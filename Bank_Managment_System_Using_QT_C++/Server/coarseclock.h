@@ -0,0 +1,16 @@
+#ifndef COARSECLOCK_H
+#define COARSECLOCK_H
+
+#include <QtGlobal>
+
+// Cheap wall clock for the write path. On Linux it reads the kernel's
+// coarse realtime clock (a few ms resolution, no hardware timer access);
+// elsewhere it falls back to QDateTime.
+class CoarseClock
+{
+public:
+    // Microseconds since the Unix epoch, UTC
+    static qint64 nowMicros();
+};
+
+#endif // COARSECLOCK_H
@@ -0,0 +1,263 @@
+#include "databaseconnectionpool.h"
+#include "serverconfig.h"
+
+#include <QSqlError>
+#include <QStringList>
+
+// SQL of every PooledConnection::Statement, in enum order
+static const char *const statementSql[PooledConnection::StatementCount] =
+{
+    // LoginQuery
+    "SELECT AccountNumber, Admin FROM Accounts "
+    "WHERE Username = :username AND Password = :password",
+    // AccountNumberQuery
+    "SELECT AccountNumber FROM Accounts WHERE Username = :username",
+    // BalanceQuery
+    "SELECT Balance FROM Users_Personal_Data WHERE AccountNumber = :accountNumber",
+    // UsernameCountQuery
+    "SELECT COUNT(*) FROM Accounts WHERE Username = :username",
+    // InsertAccount
+    "INSERT INTO Accounts (Username, Password, Admin) VALUES (:username, :password, :admin)",
+    // InsertPersonalData
+    "INSERT INTO Users_Personal_Data (AccountNumber, Name, Age, Balance) "
+    "VALUES (:accountNumber, :name, :age, :balance)",
+    // DeleteAccount
+    "DELETE FROM Accounts WHERE AccountNumber = :accountNumber",
+    // DeletePersonalData
+    "DELETE FROM Users_Personal_Data WHERE AccountNumber = :accountNumber",
+    // DeleteTransactionHistory
+    "DELETE FROM Transaction_History WHERE AccountNumber = :accountNumber",
+    // FetchAllUserData
+    "SELECT Accounts.AccountNumber, Accounts.Username, Users_Personal_Data.Name, "
+    "Users_Personal_Data.Balance, Users_Personal_Data.Age "
+    "FROM Accounts JOIN Users_Personal_Data "
+    "ON Accounts.AccountNumber = Users_Personal_Data.AccountNumber",
+    // UserDataChanges, one page keyed on (ChangeVersion, AccountNumber); the
+    // account columns are NULL for a deleted row
+    "SELECT Account_Changes.AccountNumber, Account_Changes.ChangeVersion, Account_Changes.Deleted, "
+    "Accounts.Username, Users_Personal_Data.Name, Users_Personal_Data.Balance, Users_Personal_Data.Age "
+    "FROM Account_Changes "
+    "LEFT JOIN Accounts ON Accounts.AccountNumber = Account_Changes.AccountNumber "
+    "LEFT JOIN Users_Personal_Data ON Users_Personal_Data.AccountNumber = Account_Changes.AccountNumber "
+    "WHERE (Account_Changes.ChangeVersion, Account_Changes.AccountNumber) > (:sinceVersion, :afterAccountNumber) "
+    "ORDER BY Account_Changes.ChangeVersion, Account_Changes.AccountNumber LIMIT :limit",
+    // ApplyAmount, matches no row if the balance would go negative
+    "UPDATE Users_Personal_Data SET Balance = Balance + :amount "
+    "WHERE AccountNumber = :accountNumber AND Balance + :checkAmount >= 0 "
+    "RETURNING Balance",
+    // InsertTransaction
+    "INSERT INTO Transaction_History (AccountNumber, Timestamp, Amount) "
+    "VALUES (:accountNumber, :timestamp, :amount)",
+    // TransactionHistory
+    "SELECT TransactionID, Timestamp, Amount FROM Transaction_History "
+    "WHERE AccountNumber = :accountNumber ORDER BY Timestamp DESC, TransactionID DESC",
+    // TransactionHistoryPage, keyset seek on (AccountNumber, Timestamp, rowid) of
+    // Transaction_History_Account_Time; the cursor is the last row of the previous page
+    "SELECT TransactionID, Timestamp, Amount FROM Transaction_History "
+    "WHERE AccountNumber = :accountNumber "
+    "AND (Timestamp, TransactionID) < (:cursorTimestamp, :cursorTransactionId) "
+    "ORDER BY Timestamp DESC, TransactionID DESC LIMIT :limit",
+    // UpdatePassword
+    "UPDATE Accounts SET Password = :password WHERE Username = :username",
+    // UpdateName
+    "UPDATE Users_Personal_Data SET Name = :name WHERE AccountNumber = :accountNumber",
+    // SavepointBegin
+    "SAVEPOINT request_write",
+    // SavepointRelease
+    "RELEASE request_write",
+    // SavepointRollback
+    "ROLLBACK TO request_write",
+    // EnvelopeBegin, wraps the sub-requests of an atomic batch
+    "SAVEPOINT request_envelope",
+    // EnvelopeRelease
+    "RELEASE request_envelope",
+    // EnvelopeRollback
+    "ROLLBACK TO request_envelope",
+    // BatchBegin, takes the write lock up front
+    "BEGIN IMMEDIATE",
+    // BatchCommit
+    "COMMIT",
+    // BatchRollback
+    "ROLLBACK"
+};
+
+PooledConnection::PooledConnection(const QString &connectionName)
+    : connectionName(connectionName)
+{
+    dbConnection = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    dbConnection.setDatabaseName("bankdatabase.db");
+}
+
+PooledConnection::~PooledConnection()
+{
+    // Every query and handle has to be gone before the connection can be removed
+    statements.clear();
+    if (dbConnection.isOpen())
+    {
+        dbConnection.close();
+    }
+    dbConnection = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+bool PooledConnection::open()
+{
+    if (!dbConnection.open())
+    {
+        return false;
+    }
+    if (!applyPragmas())
+    {
+        dbConnection.close();
+        return false;
+    }
+    prepareStatements();
+    return true;
+}
+
+bool PooledConnection::applyPragmas()
+{
+    const ServerConfig &config = ServerConfig::instance();
+    QSqlQuery pragma(dbConnection);
+
+    // journal_mode answers with the mode actually in effect
+    if (!pragma.exec(QString("PRAGMA journal_mode=%1").arg(config.journalMode)) || !pragma.next())
+    {
+        return false;
+    }
+    if (pragma.value(0).toString().compare(config.journalMode, Qt::CaseInsensitive) != 0)
+    {
+        return false;
+    }
+    pragma.finish();
+
+    const QStringList pragmas =
+    {
+        QString("PRAGMA synchronous=%1").arg(config.synchronous),
+        QString("PRAGMA cache_size=%1").arg(config.cacheSize),
+        QString("PRAGMA mmap_size=%1").arg(config.mmapSize),
+        QString("PRAGMA temp_store=%1").arg(config.tempStore),
+        QString("PRAGMA busy_timeout=%1").arg(config.busyTimeoutMs)
+    };
+    for (const QString &statement : pragmas)
+    {
+        if (!pragma.exec(statement))
+        {
+            return false;
+        }
+        pragma.finish();
+    }
+    return true;
+}
+
+bool PooledConnection::isOpen() const
+{
+    return dbConnection.isOpen();
+}
+
+QSqlDatabase PooledConnection::database() const
+{
+    return dbConnection;
+}
+
+QString PooledConnection::name() const
+{
+    return connectionName;
+}
+
+QSqlQuery &PooledConnection::statement(Statement id)
+{
+    // Statements on tables that didn't exist yet at open time get prepared here
+    if (!prepared[id])
+    {
+        prepared[id] = statements[id].prepare(statementSql[id]);
+    }
+    return statements[id];
+}
+
+QSqlQuery PooledConnection::cursor(const QString &sql)
+{
+    QSqlQuery query(dbConnection);
+    // Without this Qt keeps every row read so far for backward navigation
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    return query;
+}
+
+void PooledConnection::prepareStatements()
+{
+    statements.clear();
+    prepared.fill(false, StatementCount);
+    statements.reserve(StatementCount);
+
+    for (int id = 0; id < StatementCount; ++id)
+    {
+        QSqlQuery query(dbConnection);
+        prepared[id] = query.prepare(statementSql[id]);
+        statements.append(query);
+    }
+}
+
+DatabaseConnectionPool::ThreadConnection::~ThreadConnection()
+{
+    delete connection;
+    DatabaseConnectionPool::instance().openConnections.fetchAndSubRelaxed(1);
+}
+
+DatabaseConnectionPool &DatabaseConnectionPool::instance()
+{
+    // Never destroyed, connections of threads exiting late may still report back
+    static DatabaseConnectionPool *pool = new DatabaseConnectionPool();
+    return *pool;
+}
+
+DatabaseConnectionPool::DatabaseConnectionPool()
+    : logger("DatabaseConnectionPool")
+{}
+
+PooledConnection *DatabaseConnectionPool::acquire()
+{
+    if (!threadConnections.hasLocalData() || threadConnections.localData() == nullptr)
+    {
+        QString connectionName = QString("Pool-%1").arg(connectionSerial.fetchAndAddRelaxed(1));
+        PooledConnection *connection = new PooledConnection(connectionName);
+        if (!connection->open())
+        {
+            logger.log(QString("Failed to Open pooled connection '%1': %2")
+                           .arg(connectionName, connection->database().lastError().text()));
+            delete connection;
+            return nullptr;
+        }
+        threadConnections.setLocalData(new ThreadConnection(connection));
+        openConnections.fetchAndAddRelaxed(1);
+        openCount.fetchAndAddRelaxed(1);
+        logger.log(QString("Opened pooled connection '%1'").arg(connectionName));
+    }
+
+    checkouts.fetchAndAddRelaxed(1);
+    return threadConnections.localData()->connection;
+}
+
+void DatabaseConnectionPool::releaseThreadConnection()
+{
+    if (threadConnections.hasLocalData() && threadConnections.localData() != nullptr)
+    {
+        // QThreadStorage deletes the previous value
+        threadConnections.setLocalData(nullptr);
+    }
+}
+
+int DatabaseConnectionPool::size() const
+{
+    return openConnections.loadRelaxed();
+}
+
+quint64 DatabaseConnectionPool::connectionOpenCount() const
+{
+    return openCount.loadRelaxed();
+}
+
+quint64 DatabaseConnectionPool::checkoutCount() const
+{
+    return checkouts.loadRelaxed();
+}
@@ -0,0 +1,112 @@
+#ifndef DATABASECONNECTIONPOOL_H
+#define DATABASECONNECTIONPOOL_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QThreadStorage>
+#include <QAtomicInteger>
+#include <QVector>
+
+#include "logger.h"
+
+// An open SQLite connection with every statement the server runs prepared
+// up front, so a request only has to bind its parameters and execute.
+class PooledConnection
+{
+public:
+    enum Statement
+    {
+        LoginQuery,
+        AccountNumberQuery,
+        BalanceQuery,
+        UsernameCountQuery,
+        InsertAccount,
+        InsertPersonalData,
+        DeleteAccount,
+        DeletePersonalData,
+        DeleteTransactionHistory,
+        FetchAllUserData,
+        UserDataChanges,
+        ApplyAmount,
+        InsertTransaction,
+        TransactionHistory,
+        TransactionHistoryPage,
+        UpdatePassword,
+        UpdateName,
+        SavepointBegin,
+        SavepointRelease,
+        SavepointRollback,
+        EnvelopeBegin,
+        EnvelopeRelease,
+        EnvelopeRollback,
+        BatchBegin,
+        BatchCommit,
+        BatchRollback,
+        StatementCount
+    };
+
+    explicit PooledConnection(const QString &connectionName);
+    ~PooledConnection();
+
+    bool open();
+    bool isOpen() const;
+    QSqlDatabase database() const;
+    QString name() const;
+
+    // The cached statement, prepared again if it couldn't be prepared on open
+    QSqlQuery &statement(Statement id);
+    // A fresh forward-only query for SQL built per request, prepared every time
+    QSqlQuery cursor(const QString &sql);
+
+private:
+    QString connectionName;
+    QSqlDatabase dbConnection;
+    QVector<QSqlQuery> statements;
+    QVector<bool> prepared;
+
+    bool applyPragmas();
+    void prepareStatements();
+};
+
+// Process-wide pool shared by the worker threads.
+// Qt only allows a connection to be used from the thread that opened it,
+// so the pool keeps one connection per worker thread and every session
+// served by that worker checks out the same connection. A checkout never
+// waits for another thread: this is per-thread storage, not a bounded
+// pool, and the connection count is the worker count.
+class DatabaseConnectionPool
+{
+public:
+    static DatabaseConnectionPool &instance();
+
+    // Connection of the calling thread, opened on first use; nullptr if it can't be opened
+    PooledConnection *acquire();
+
+    // Close the calling thread's connection before the thread itself ends
+    void releaseThreadConnection();
+
+    // Metrics
+    int size() const;
+    quint64 connectionOpenCount() const;
+    quint64 checkoutCount() const;
+
+private:
+    DatabaseConnectionPool();
+
+    // Owns the thread's connection and closes it when the thread exits
+    struct ThreadConnection
+    {
+        PooledConnection *connection;
+        explicit ThreadConnection(PooledConnection *connection) : connection(connection) {}
+        ~ThreadConnection();
+    };
+
+    QThreadStorage<ThreadConnection *> threadConnections;
+    QAtomicInteger<quint64> connectionSerial;
+    QAtomicInteger<int> openConnections;
+    QAtomicInteger<quint64> openCount;
+    QAtomicInteger<quint64> checkouts;
+    Logger logger;
+};
+
+#endif // DATABASECONNECTIONPOOL_H
@@ -1,40 +1,59 @@
 #include "DatabaseManager.h"
+#include "coarseclock.h"
+#include "resultstream.h"
+#include "servermetrics.h"
+#include "requesttracer.h"
+#include "querytimer.h"
+
+#include <QSqlRecord>
+#include <limits>
+
+// Ordered schema migrations, each runs once in its own transaction
+const DatabaseManager::SchemaMigration DatabaseManager::schemaMigrations[] =
+{
+    {1, "Create tables", &DatabaseManager::createTables},
+    {2, "Index Transaction_History by account and time", &DatabaseManager::addTransactionHistoryIndex},
+    {3, "Store transaction time as integer microseconds", &DatabaseManager::convertTransactionTimestamps},
+    {4, "Track account changes for delta sync", &DatabaseManager::addAccountChangeTracking},
+    {5, "Index user data columns used by filters", &DatabaseManager::addUserDataFilterIndexes}
+};
+
+// Rows of the user data listing, one per account
+static const char *const userDataFrom =
+    " FROM Accounts JOIN Users_Personal_Data ON Accounts.AccountNumber = Users_Personal_Data.AccountNumber";
 
 DatabaseManager::DatabaseManager(const QString &connectionName, QObject *parent)
     : QObject(parent), connectionName(connectionName), logger("DatabaseManager")
 {
     logger.log("DatabaseManager Object Created.");
-    QSqlDatabase dbConnection = QSqlDatabase::addDatabase("QSQLITE", connectionName);
-    dbConnection.setDatabaseName("bankdatabase.db");
 }
 
 DatabaseManager::~DatabaseManager()
 {
-    QSqlDatabase::removeDatabase(connectionName);
     logger.log("DatabaseManager Object Destroyed.");
 }
 
 bool DatabaseManager::openConnection()
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    if (!dbConnection.open())
+    // Check out the pooled connection of the calling thread
+    connection = DatabaseConnectionPool::instance().acquire();
+    if (connection == nullptr)
     {
         logger.log(QString("Failed to Open database connection '%1'").arg(connectionName));
         return false;
     }
 
-    logger.log(QString("Opened database connection '%1'").arg(connectionName));
+    logger.log(QString("'%1' uses database connection '%2'").arg(connectionName, connection->name()));
     return true;
 }
 
 void DatabaseManager::closeConnection()
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-
-    if (dbConnection.isOpen())
+    // The pooled connection stays open for the other sessions of this thread
+    if (connection != nullptr)
     {
-        dbConnection.close();
-        logger.log(QString("Closed database connection '%1'").arg(connectionName));
+        connection = nullptr;
+        logger.log(QString("Released database connection of '%1'").arg(connectionName));
     }
     else
     {
@@ -43,7 +62,7 @@ void DatabaseManager::closeConnection()
 }
 
 
-void DatabaseManager::initializeDatabase()
+bool DatabaseManager::initializeDatabase()
 {
     QFile databaseFile("bankdatabase.db");
     if (databaseFile.exists())
@@ -52,73 +71,249 @@ void DatabaseManager::initializeDatabase()
     }
     else
     {
-        // Create the file if it doesn't exist
-        if (databaseFile.open(QIODevice::WriteOnly))
+        logger.log("Creating database file: bankdatabase.db");
+    }
+
+    // SQLite creates the file on open, the migrations then bring the schema up to date
+    if (!openConnection())
+    {
+        return false;
+    }
+    bool migrated = migrateSchema();
+    closeConnection();
+
+    return migrated;
+}
+
+bool DatabaseManager::migrateSchema()
+{
+    QSqlDatabase dbConnection = connection->database();
+    QSqlQuery query(dbConnection);
+
+    if (!execQuery(query, "CREATE TABLE IF NOT EXISTS Schema_Version (Version INTEGER NOT NULL)"))
+    {
+        logger.log("Failed to create the Schema_Version table.");
+        logger.log("Error: " + query.lastError().text());
+        return false;
+    }
+
+    int currentVersion = 0;
+    if (execQuery(query, "SELECT MAX(Version) FROM Schema_Version") && query.next())
+    {
+        currentVersion = query.value(0).toInt();
+    }
+    query.finish();
+
+    // Databases created before migrations existed already hold the version 1 tables
+    if (currentVersion == 0 && dbConnection.tables().contains("Accounts"))
+    {
+        if (!setSchemaVersion(1))
         {
-            databaseFile.close();
-            logger.log("Created database file: bankdatabase.db");
-            openConnection();
-            createTables();
-            closeConnection();
+            return false;
         }
-        else
+        currentVersion = 1;
+        logger.log("Existing database recorded as schema version 1.");
+    }
+
+    for (const SchemaMigration &migration : schemaMigrations)
+    {
+        if (migration.version <= currentVersion)
         {
-            logger.log("Failed to create database file!");
+            continue;
         }
+
+        if (!dbConnection.transaction())
+        {
+            logger.log(QString("Failed to start a transaction for schema migration %1.").arg(migration.version));
+            return false;
+        }
+
+        if (!(this->*migration.apply)() || !setSchemaVersion(migration.version) || !dbConnection.commit())
+        {
+            logger.log(QString("Schema migration %1 (%2) failed.").arg(migration.version).arg(migration.description));
+            dbConnection.rollback();
+            return false;
+        }
+
+        currentVersion = migration.version;
+        logger.log(QString("Applied schema migration %1: %2").arg(migration.version).arg(migration.description));
+    }
+
+    logger.log(QString("Database schema is at version %1.").arg(currentVersion));
+    return true;
+}
+
+bool DatabaseManager::setSchemaVersion(int version)
+{
+    QSqlQuery query(connection->database());
+    query.prepare("INSERT INTO Schema_Version (Version) VALUES (:version)");
+    query.bindValue(":version", version);
+    if (!execQuery(query))
+    {
+        logger.log("Failed to record schema version.");
+        logger.log("Error: " + query.lastError().text());
+        return false;
     }
+    return true;
 }
 
-QJsonObject DatabaseManager::processRequest(QJsonObject requestJson)
+QJsonObject DatabaseManager::processRequest(const QJsonObject &requestJson)
 {
+    const quint64 traceId = RequestTracer::currentTrace();
+    RequestTracer::Span mutexSpan(traceId, "database mutex");
     QMutexLocker locker(&mutex);
+    mutexSpan.finish();
+    RequestTracer::Span databaseSpan(traceId, "database");
     // Extract the request ID from the request JSON
-    int requestId = requestJson["requestId"].toInt();
+    int requestId = BankProtocol::requestIdOf(requestJson);
 
     QJsonObject responseJson;
 
-    // Process the request based on the request ID
-    switch(requestId)
-    {
-    case 0:
-        responseJson = login(requestJson);
-        break;
-    case 1:
-        responseJson = getAccountNumber(requestJson);
-        break;
-    case 2:
-        responseJson = getAccountBalance(requestJson);
-        break;
-    case 3:
-        responseJson = createNewAccount(requestJson);
-        break;
-    case 4:
-        responseJson = deleteAccount(requestJson);
-        break;
-    case 5:
-        responseJson = fetchAllUserData();
-        break;
-    case 6:
-        responseJson = makeTransaction(requestJson);
-        break;
-    case 7:
-        responseJson = makeTransfer(requestJson);
-        break;
-    case 8:
-        responseJson = viewTransactionHistory(requestJson);
-        break;
-    case 9:
-        responseJson = updateUserData(requestJson);
-        break;
-    case 10:
-        responseJson = getAccountBalance(requestJson);
-        break;
-    case 11:
-        responseJson = viewTransactionHistory(requestJson);
-        break;
-    default:
+    if (connection == nullptr)
+    {
+        logger.log("Request received without an open database connection.");
+        responseJson["responseId"] = requestId;
+        return responseJson;
+    }
+
+    return executeRequest(requestId, requestJson);
+}
+
+ResultStream *DatabaseManager::openResultStream(const QJsonObject &requestJson, MessageCodec::Encoding encoding)
+{
+    QMutexLocker locker(&mutex);
+
+    if (connection == nullptr)
+    {
+        return nullptr;
+    }
+
+    using BankProtocol::RequestId;
+    const int requestId = BankProtocol::requestIdOf(requestJson);
+
+    if (requestId == static_cast<int>(RequestId::FetchAllUserData))
+    {
+        const BankProtocol::FetchAllUserDataRequest request =
+            BankProtocol::decode<BankProtocol::FetchAllUserDataRequest>(requestJson);
+        if (!request.stream)
+        {
+            return nullptr;
+        }
+
+        // Keyset on the sort key with the account number breaking ties
+        QStringList columns;
+        QStringList conditions;
+        QVariantList values;
+        const char *sortExpression = "Accounts.AccountNumber";
+        ResultStream::RowFormatter formatRow = &DatabaseManager::userDataRow;
+        ResultStream::ChunkQuery chunkQuery;
+        if (request.hasOptions())
+        {
+            // Invalid options are answered by the regular request path
+            QString errorMessage;
+            if (!userDataSql(request, columns, conditions, values, sortExpression, errorMessage))
+            {
+                return nullptr;
+            }
+            if (!request.columns.isEmpty())
+            {
+                formatRow = &DatabaseManager::projectedUserDataRow;
+            }
+            chunkQuery.limit = request.limit;
+        }
+        else
+        {
+            columns = QStringList{"Accounts.AccountNumber AS AccountNumber", "Accounts.Username AS Username",
+                                  "Users_Personal_Data.Name AS Name", "Users_Personal_Data.Balance AS Balance",
+                                  "Users_Personal_Data.Age AS Age"};
+        }
+        columns << QString("%1 AS _key0").arg(sortExpression) << "Accounts.AccountNumber AS _key1";
+
+        const QString direction = request.descending ? "DESC" : "ASC";
+        const QString select = "SELECT " + columns.join(", ") + QLatin1String(userDataFrom);
+        const QString order = QString(" ORDER BY %1 %2, Accounts.AccountNumber %2 LIMIT ?")
+                                  .arg(sortExpression, direction);
+        QStringList nextConditions = conditions;
+        nextConditions.append(QString("(%1, Accounts.AccountNumber) %2 (?, ?)")
+                                  .arg(sortExpression, request.descending ? "<" : ">"));
+
+        chunkQuery.firstSql = select + (conditions.isEmpty() ? QString() : " WHERE " + conditions.join(" AND "))
+                              + order;
+        chunkQuery.nextSql = select + " WHERE " + nextConditions.join(" AND ") + order;
+        chunkQuery.values = values;
+        chunkQuery.keyCount = 2;
+        return new ResultStream(requestId, "fetchUserDataSuccess", "userData",
+                                chunkQuery, formatRow, encoding);
+    }
+
+    if (requestId == static_cast<int>(RequestId::TransactionHistory)
+        || requestId == static_cast<int>(RequestId::AdminTransactionHistory))
+    {
+        BankProtocol::TransactionHistoryRequest request =
+            BankProtocol::decode<BankProtocol::TransactionHistoryRequest>(requestJson);
+        // A page is bounded already and goes out as a single response
+        if (!request.stream || request.pageSize > 0)
+        {
+            return nullptr;
+        }
+
+        // The keyset of the history pages, newest first
+        const QString select = "SELECT TransactionID, Timestamp, Amount, Timestamp AS _key0, TransactionID AS _key1 "
+                               "FROM Transaction_History WHERE AccountNumber = ? ";
+        const QString order = "ORDER BY Timestamp DESC, TransactionID DESC LIMIT ?";
+        ResultStream::ChunkQuery chunkQuery;
+        chunkQuery.firstSql = select + order;
+        chunkQuery.nextSql = select + "AND (Timestamp, TransactionID) < (?, ?) " + order;
+        chunkQuery.values = {request.accountNumber};
+        chunkQuery.keyCount = 2;
+        return new ResultStream(requestId, "viewTransactionHistorySuccess", "transactionHistory",
+                                chunkQuery, &DatabaseManager::transactionRow, encoding);
+    }
+
+    return nullptr;
+}
+
+QJsonObject DatabaseManager::executeRequest(int requestId, const QJsonObject &requestJson)
+{
+    // Handlers indexed by request ID, each decodes its request struct first
+    using BankProtocol::RequestId;
+    static constexpr RequestHandlerFunction handlers[] =
+    {
+        &DatabaseManager::dispatch<BankProtocol::LoginRequest, &DatabaseManager::login>,
+        &DatabaseManager::dispatch<BankProtocol::GetAccountNumberRequest, &DatabaseManager::getAccountNumber>,
+        &DatabaseManager::dispatch<BankProtocol::GetBalanceRequest, &DatabaseManager::getAccountBalance>,
+        &DatabaseManager::dispatch<BankProtocol::CreateAccountRequest, &DatabaseManager::createNewAccount>,
+        &DatabaseManager::dispatch<BankProtocol::DeleteAccountRequest, &DatabaseManager::deleteAccount>,
+        &DatabaseManager::dispatch<BankProtocol::FetchAllUserDataRequest, &DatabaseManager::fetchAllUserData>,
+        &DatabaseManager::dispatch<BankProtocol::MakeTransactionRequest, &DatabaseManager::makeTransaction>,
+        &DatabaseManager::dispatch<BankProtocol::MakeTransferRequest, &DatabaseManager::makeTransfer>,
+        &DatabaseManager::dispatch<BankProtocol::TransactionHistoryRequest, &DatabaseManager::viewTransactionHistory>,
+        &DatabaseManager::dispatch<BankProtocol::UpdateUserDataRequest, &DatabaseManager::updateUserData>,
+        &DatabaseManager::dispatch<BankProtocol::AdminGetBalanceRequest, &DatabaseManager::getAccountBalance>,
+        &DatabaseManager::dispatch<BankProtocol::AdminTransactionHistoryRequest, &DatabaseManager::viewTransactionHistory>,
+        // Hello is answered by the RequestHandler itself
+        nullptr,
+        &DatabaseManager::dispatch<BankProtocol::BatchRequest, &DatabaseManager::processBatch>,
+        // So is Subscribe, it belongs to the connection
+        nullptr,
+        &DatabaseManager::dispatch<BankProtocol::FetchUserDataChangesRequest, &DatabaseManager::fetchUserDataChanges>,
+        // Metrics and traces come from the server, not the database
+        nullptr,
+        nullptr
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == BankProtocol::RequestCount,
+                  "One handler per request ID");
+
+    QJsonObject responseJson;
+
+    if (requestId >= 0 && requestId < BankProtocol::RequestCount && handlers[requestId] != nullptr)
+    {
+        responseJson = (this->*handlers[requestId])(requestJson);
+    }
+    else
+    {
         // Handle unknown request
         logger.log("Unknown request");
-        break;
     }
 
     // Add the response ID to the response JSON
@@ -127,29 +322,123 @@ QJsonObject DatabaseManager::processRequest(QJsonObject requestJson)
     return responseJson;
 }
 
-bool DatabaseManager::createTables()
+QJsonObject DatabaseManager::processBatch(const BankProtocol::BatchRequest &request)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery query(dbConnection);
+    QJsonObject responseJson;
 
-    // Begin transaction
-    if (!dbConnection.transaction())
+    const bool atomic = request.mode.compare("bestEffort", Qt::CaseInsensitive) != 0;
+    if (request.requests.size() > BankProtocol::BatchRequest::MaxRequests)
     {
-        logger.log("Failed to start a transaction for table creation.");
-        query.finish();
-        return false;
+        responseJson["batchSuccess"] = false;
+        responseJson["errorMessage"] = "Too many requests in the batch";
+        return responseJson;
+    }
+
+    // Each sub-request keeps its own savepoint, an atomic batch wraps them in one more
+    if (atomic && !runSavepointStatement(PooledConnection::EnvelopeBegin))
+    {
+        responseJson["batchSuccess"] = false;
+        responseJson["errorMessage"] = "Failed to start transaction";
+        return responseJson;
     }
 
+    QJsonArray responses;
+    int failedCount = 0;
+    // Events of a batch that is rolled back must not go out
+    const qsizetype eventsBefore = accountEvents.size();
+
+    for (qsizetype index = 0; index < request.requests.size(); ++index)
+    {
+        const QJsonObject subRequest = request.requests.at(index).toObject();
+        const int requestId = BankProtocol::requestIdOf(subRequest);
+        const BankProtocol::RequestInfo *info = BankProtocol::requestInfo(requestId);
+
+        QJsonObject subResponse;
+        // Only writes: a read would run on the ledger writer inside the group
+        // commit and hold up every other writer for as long as it takes
+        if (info == nullptr || !info->mutating || info->id == BankProtocol::RequestId::Batch)
+        {
+            subResponse = failureResponse(requestId, "Not allowed in a batch");
+        }
+        else
+        {
+            subResponse = executeRequest(requestId, subRequest);
+        }
+        responses.append(subResponse);
+
+        if (info == nullptr || !subResponse[info->successKey].toBool())
+        {
+            failedCount++;
+            if (atomic)
+            {
+                // Nothing after the first failure runs, nothing before it stays
+                responseJson["failedIndex"] = static_cast<qint64>(index);
+                break;
+            }
+        }
+    }
+
+    if (atomic)
+    {
+        if (failedCount > 0)
+        {
+            runSavepointStatement(PooledConnection::EnvelopeRollback);
+            runSavepointStatement(PooledConnection::EnvelopeRelease);
+            accountEvents.resize(eventsBefore);
+            responseJson["errorMessage"] = "Batch rolled back";
+        }
+        else if (!runSavepointStatement(PooledConnection::EnvelopeRelease))
+        {
+            runSavepointStatement(PooledConnection::EnvelopeRollback);
+            runSavepointStatement(PooledConnection::EnvelopeRelease);
+            accountEvents.resize(eventsBefore);
+            failedCount = static_cast<int>(responses.size());
+            responseJson["errorMessage"] = "Failed to commit batch";
+        }
+    }
+
+    responseJson["batchSuccess"] = (failedCount == 0);
+    responseJson["failedCount"] = failedCount;
+    responseJson["responses"] = responses;
+
+    return responseJson;
+}
+
+bool DatabaseManager::isWriteRequest(int requestId)
+{
+    const BankProtocol::RequestInfo *info = BankProtocol::requestInfo(requestId);
+    return info != nullptr && info->mutating;
+}
+
+QJsonObject DatabaseManager::failureResponse(int requestId, const QString &errorMessage)
+{
+    QJsonObject responseJson;
+
+    const BankProtocol::RequestInfo *info = BankProtocol::requestInfo(requestId);
+    if (info != nullptr)
+    {
+        responseJson[info->successKey] = false;
+    }
+    responseJson["errorMessage"] = errorMessage;
+    responseJson["responseId"] = requestId;
+
+    return responseJson;
+}
+
+bool DatabaseManager::createTables()
+{
+    // Runs inside the transaction of its schema migration
+    QSqlQuery query(connection->database());
+
     // Create Accounts table
     const QString prep_accounts =
         "CREATE TABLE Accounts (AccountNumber INTEGER PRIMARY KEY AUTOINCREMENT,"
         " Username TEXT COLLATE NOCASE UNIQUE NOT NULL, Password TEXT NOT NULL,"
         " Admin BOOLEAN);";
-    if (!query.exec(prep_accounts))
+    if (!execQuery(query, prep_accounts))
     {
         logger.log("Failed execution for Accounts table.");
         logger.log("Error: " + query.lastError().text());
-        dbConnection.rollback();
         query.finish();
         return false;
     }
@@ -158,11 +447,10 @@ bool DatabaseManager::createTables()
     const QString insert_default_admin =
         "INSERT INTO Accounts (Username, Password, Admin) "
         "VALUES ('admin', 'admin', 1);";
-    if (!query.exec(insert_default_admin))
+    if (!execQuery(query, insert_default_admin))
     {
         logger.log("Failed to insert default admin account.");
         logger.log("Error: " + query.lastError().text());
-        dbConnection.rollback();
         query.finish();
         return false;
     }
@@ -172,11 +460,10 @@ bool DatabaseManager::createTables()
         "CREATE TABLE Users_Personal_Data (AccountNumber INTEGER PRIMARY KEY, Name TEXT,"
         " Age INTEGER CHECK(Age >= 18 AND Age <= 120), Balance REAL, FOREIGN KEY(AccountNumber)"
         " REFERENCES Accounts(AccountNumber));";
-    if (!query.exec(prep_users_personal_data))
+    if (!execQuery(query, prep_users_personal_data))
     {
         logger.log("Failed execution for Personal Data table.");
         logger.log("Error: " + query.lastError().text());
-        dbConnection.rollback();
         query.finish();
         return false;
     }
@@ -186,44 +473,275 @@ bool DatabaseManager::createTables()
         "CREATE TABLE Transaction_History (TransactionID INTEGER PRIMARY KEY AUTOINCREMENT,"
         " AccountNumber INTEGER, Date TEXT, Time TEXT, Amount REAL, FOREIGN KEY(AccountNumber)"
         " REFERENCES Accounts(AccountNumber));";
-    if (!query.exec(prep_transaction_history))
+    if (!execQuery(query, prep_transaction_history))
     {
         logger.log("Failed execution for Transaction history table.");
         logger.log("Error: " + query.lastError().text());
-        dbConnection.rollback();
         query.finish();
         return false;
     }
 
-    // Commit transaction
-    if (!dbConnection.commit())
+    logger.log("Created all tables successfully.");
+    query.finish();
+
+    return true;
+}
+
+bool DatabaseManager::addTransactionHistoryIndex()
+{
+    // Serves the per-account history lookup and delete without a full table scan
+    QSqlQuery query(connection->database());
+    if (!execQuery(query, "CREATE INDEX IF NOT EXISTS Transaction_History_Account_Time "
+                          "ON Transaction_History (AccountNumber, Date, Time)"))
     {
-        logger.log("Failed to commit transaction for table creation.");
-        dbConnection.rollback();
-        query.finish();
+        logger.log("Failed to create the Transaction_History index.");
+        logger.log("Error: " + query.lastError().text());
         return false;
     }
+    return true;
+}
 
-    logger.log("Created all tables successfully.");
+bool DatabaseManager::convertTransactionTimestamps()
+{
+    // SQLite can't change a column type in place, so the table is rebuilt.
+    // The old dd-MM-yyyy / hh:mm:ss text was server local time.
+    const QString parsedSeconds =
+        "CAST(strftime('%s', substr(Date, 7, 4) || '-' || substr(Date, 4, 2) || '-' || "
+        "substr(Date, 1, 2) || ' ' || Time, 'utc') AS INTEGER)";
+    const QStringList statements =
+    {
+        // Rows whose text can't be parsed keep it here, their Timestamp becomes 0
+        "CREATE TABLE Transaction_History_Unconverted (TransactionID INTEGER PRIMARY KEY, Date TEXT, Time TEXT);",
+        "INSERT INTO Transaction_History_Unconverted (TransactionID, Date, Time) "
+        "SELECT TransactionID, Date, Time FROM Transaction_History WHERE " + parsedSeconds + " IS NULL;",
+        "CREATE TABLE Transaction_History_New (TransactionID INTEGER PRIMARY KEY AUTOINCREMENT,"
+        " AccountNumber INTEGER, Timestamp INTEGER NOT NULL, Amount REAL, FOREIGN KEY(AccountNumber)"
+        " REFERENCES Accounts(AccountNumber));",
+        "INSERT INTO Transaction_History_New (TransactionID, AccountNumber, Timestamp, Amount) "
+        "SELECT TransactionID, AccountNumber, COALESCE(" + parsedSeconds + ", 0) * 1000000, Amount "
+        "FROM Transaction_History;",
+        "DROP TABLE Transaction_History;",
+        "ALTER TABLE Transaction_History_New RENAME TO Transaction_History;",
+        "CREATE INDEX Transaction_History_Account_Time ON Transaction_History (AccountNumber, Timestamp);"
+    };
+
+    QSqlQuery query(connection->database());
+    for (const QString &statement : statements)
+    {
+        if (!execQuery(query, statement))
+        {
+            logger.log("Failed to convert Transaction_History timestamps.");
+            logger.log("Error: " + query.lastError().text());
+            return false;
+        }
+    }
+
+    if (!execQuery(query, "SELECT COUNT(*), MIN(TransactionID), MAX(TransactionID) "
+                          "FROM Transaction_History_Unconverted;") || !query.next())
+    {
+        logger.log("Failed to count unconverted transaction timestamps.");
+        logger.log("Error: " + query.lastError().text());
+        return false;
+    }
+    const qint64 unconverted = query.value(0).toLongLong();
+    if (unconverted > 0)
+    {
+        logger.log(QString("%1 transaction(s) had an unparseable date, TransactionID %2 to %3. "
+                           "Their Timestamp is 0, the original text is in Transaction_History_Unconverted.")
+                       .arg(unconverted)
+                       .arg(query.value(1).toLongLong())
+                       .arg(query.value(2).toLongLong()));
+    }
     query.finish();
+    return true;
+}
 
+bool DatabaseManager::addAccountChangeTracking()
+{
+    // Every visible change of a user data row stamps it with the next version,
+    // a delete leaves a tombstone so clients can drop the row as well
+    const QString nextVersion = "(SELECT COALESCE(MAX(ChangeVersion), 0) + 1 FROM Account_Changes)";
+    const QString markChanged =
+        "INSERT OR REPLACE INTO Account_Changes (AccountNumber, ChangeVersion, Deleted) "
+        "VALUES (NEW.AccountNumber, " + nextVersion + ", 0);";
+    const QString markDeleted =
+        "INSERT OR REPLACE INTO Account_Changes (AccountNumber, ChangeVersion, Deleted) "
+        "VALUES (OLD.AccountNumber, " + nextVersion + ", 1);";
+
+    const QStringList statements =
+    {
+        "CREATE TABLE Account_Changes (AccountNumber INTEGER PRIMARY KEY,"
+        " ChangeVersion INTEGER NOT NULL, Deleted INTEGER NOT NULL DEFAULT 0);",
+        "CREATE INDEX Account_Changes_Version ON Account_Changes (ChangeVersion);",
+        "INSERT INTO Account_Changes (AccountNumber, ChangeVersion, Deleted) "
+        "SELECT AccountNumber, 1, 0 FROM Accounts;",
+        "CREATE TRIGGER Accounts_Inserted AFTER INSERT ON Accounts BEGIN " + markChanged + " END;",
+        "CREATE TRIGGER Accounts_Updated AFTER UPDATE OF Username ON Accounts BEGIN " + markChanged + " END;",
+        "CREATE TRIGGER Accounts_Deleted AFTER DELETE ON Accounts BEGIN " + markDeleted + " END;",
+        "CREATE TRIGGER Personal_Data_Inserted AFTER INSERT ON Users_Personal_Data BEGIN " + markChanged + " END;",
+        "CREATE TRIGGER Personal_Data_Updated AFTER UPDATE OF Name, Balance, Age ON Users_Personal_Data "
+        "BEGIN " + markChanged + " END;",
+        "CREATE TRIGGER Personal_Data_Deleted AFTER DELETE ON Users_Personal_Data BEGIN " + markDeleted + " END;"
+    };
+
+    QSqlQuery query(connection->database());
+    for (const QString &statement : statements)
+    {
+        if (!execQuery(query, statement))
+        {
+            logger.log("Failed to add account change tracking.");
+            logger.log("Error: " + query.lastError().text());
+            return false;
+        }
+    }
     return true;
 }
 
-QJsonObject DatabaseManager::login(QJsonObject requestJson)
+bool DatabaseManager::addUserDataFilterIndexes()
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery query(dbConnection);
+    // Username already has the index of its UNIQUE constraint
+    const QStringList statements =
+    {
+        "CREATE INDEX Users_Personal_Data_Balance ON Users_Personal_Data (Balance);",
+        "CREATE INDEX Users_Personal_Data_Age ON Users_Personal_Data (Age);",
+        "CREATE INDEX Users_Personal_Data_Name ON Users_Personal_Data (Name);"
+    };
+
+    QSqlQuery query(connection->database());
+    for (const QString &statement : statements)
+    {
+        if (!execQuery(query, statement))
+        {
+            logger.log("Failed to create the user data filter indexes.");
+            logger.log("Error: " + query.lastError().text());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DatabaseManager::beginWrite()
+{
+    // A savepoint starts a transaction on its own, or nests inside the
+    // ledger writer's group commit so one request can fail alone
+    QSqlQuery &query = connection->statement(PooledConnection::SavepointBegin);
+    bool started = execQuery(query);
+    query.finish();
+    return started;
+}
+
+bool DatabaseManager::commitWrite()
+{
+    QSqlQuery &query = connection->statement(PooledConnection::SavepointRelease);
+    bool released = execQuery(query);
+    query.finish();
+    return released;
+}
+
+void DatabaseManager::rollbackWrite()
+{
+    QSqlQuery &rollbackQuery = connection->statement(PooledConnection::SavepointRollback);
+    execQuery(rollbackQuery);
+    rollbackQuery.finish();
+
+    // ROLLBACK TO keeps the savepoint open, release it as well
+    commitWrite();
+}
+
+bool DatabaseManager::runSavepointStatement(PooledConnection::Statement id)
+{
+    QSqlQuery &query = connection->statement(id);
+    bool succeeded = execQuery(query);
+    query.finish();
+    return succeeded;
+}
+
+bool DatabaseManager::execQuery(QSqlQuery &query)
+{
+    return QueryTimer::exec(query, connection->database());
+}
+
+bool DatabaseManager::execQuery(QSqlQuery &query, const QString &sql)
+{
+    return QueryTimer::exec(query, connection->database(), sql);
+}
+
+bool DatabaseManager::isBusyError(const QSqlError &error)
+{
+    // SQLITE_BUSY, with or without an extended code on top
+    return (error.nativeErrorCode().toInt() & 0xFF) == 5;
+}
+
+bool DatabaseManager::beginBatch()
+{
+    if (connection == nullptr)
+    {
+        return false;
+    }
+    QSqlQuery &query = connection->statement(PooledConnection::BatchBegin);
+    bool started = execQuery(query);
+
+    // busy_timeout already waited; another process may still hold the lock, try a few more times
+    for (int retry = 0; !started && retry < MaxBusyRetries && isBusyError(query.lastError()); ++retry)
+    {
+        ServerMetrics::add(ServerMetrics::BusyRetries);
+        query.finish();
+        started = execQuery(query);
+    }
 
-    // Extract the username and password from the request JSON
-    QString username = requestJson["username"].toString();
-    QString password = requestJson["password"].toString();
+    if (!started)
+    {
+        logger.log("Error: " + query.lastError().text());
+    }
+    query.finish();
+    return started;
+}
 
-    query.prepare("SELECT AccountNumber, Admin FROM Accounts "
-                  "WHERE Username = :username AND Password = :password");
-    query.bindValue(":username", username);
-    query.bindValue(":password", password);
-    if (!query.exec())
+bool DatabaseManager::commitBatch()
+{
+    QSqlQuery &query = connection->statement(PooledConnection::BatchCommit);
+    bool committed = execQuery(query);
+    if (!committed)
+    {
+        logger.log("Error: " + query.lastError().text());
+    }
+    query.finish();
+    return committed;
+}
+
+void DatabaseManager::rollbackBatch()
+{
+    QSqlQuery &query = connection->statement(PooledConnection::BatchRollback);
+    execQuery(query);
+    query.finish();
+}
+
+QVector<AccountEvent> DatabaseManager::takeAccountEvents()
+{
+    QVector<AccountEvent> events;
+    events.swap(accountEvents);
+    return events;
+}
+
+void DatabaseManager::addTransactionEvent(qint64 accountNumber, double amount, double balance, qint64 timestamp)
+{
+    QJsonObject event;
+    event["responseId"] = static_cast<int>(BankProtocol::RequestId::Subscribe);
+    event["event"] = "transaction";
+    event["accountNumber"] = accountNumber;
+    event["amount"] = amount;
+    event["balance"] = balance;
+    event["timestamp"] = timestamp;
+    accountEvents.append({accountNumber, event});
+}
+
+QJsonObject DatabaseManager::login(const BankProtocol::LoginRequest &request)
+{
+    QSqlQuery &query = connection->statement(PooledConnection::LoginQuery);
+
+    query.bindValue(":username", request.username);
+    query.bindValue(":password", request.password);
+    if (!execQuery(query))
     {
         logger.log("Failed to execute query for login request.");
         query.finish();
@@ -249,17 +767,12 @@ QJsonObject DatabaseManager::login(QJsonObject requestJson)
     return responseJson;
 }
 
-QJsonObject DatabaseManager::getAccountNumber(QJsonObject requestJson)
+QJsonObject DatabaseManager::getAccountNumber(const BankProtocol::GetAccountNumberRequest &request)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery query(dbConnection);
+    QSqlQuery &query = connection->statement(PooledConnection::AccountNumberQuery);
 
-    // Extract the username from the request JSON
-    QString username = requestJson["username"].toString();
-
-    query.prepare("SELECT AccountNumber FROM Accounts WHERE Username = :username");
-    query.bindValue(":username", username);
-    if (!query.exec())
+    query.bindValue(":username", request.username);
+    if (!execQuery(query))
     {
         logger.log("Failed to execute query for getAccountNumber request.");
         query.finish();
@@ -282,20 +795,15 @@ QJsonObject DatabaseManager::getAccountNumber(QJsonObject requestJson)
     return responseJson;
 }
 
-QJsonObject DatabaseManager::getAccountBalance(QJsonObject requestJson)
+QJsonObject DatabaseManager::getAccountBalance(const BankProtocol::GetBalanceRequest &request)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery query(dbConnection);
+    QSqlQuery &query = connection->statement(PooledConnection::BalanceQuery);
 
-    // Extract the account number from the request JSON
-    qint64 accountNumber = requestJson["accountNumber"].toVariant().toLongLong();
-
-    query.prepare("SELECT Balance FROM Users_Personal_Data WHERE AccountNumber = :accountNumber");
-    query.bindValue(":accountNumber", accountNumber);
+    query.bindValue(":accountNumber", request.accountNumber);
 
     QJsonObject responseJson;
 
-    if (query.exec() && query.next())
+    if (execQuery(query) && query.next())
     {
         responseJson["balance"] = query.value("Balance").toDouble();
         responseJson["accountFound"] = true;
@@ -309,136 +817,134 @@ QJsonObject DatabaseManager::getAccountBalance(QJsonObject requestJson)
     return responseJson;
 }
 
-QJsonObject DatabaseManager::createNewAccount(QJsonObject requestJson)
+QJsonObject DatabaseManager::createNewAccount(const BankProtocol::CreateAccountRequest &request)
 {
-    QSqlDatabase db = QSqlDatabase::database(connectionName);
-    db.transaction();
+    if (!beginWrite())
+    {
+        logger.log("Failed to start transaction.");
+        return failureResponse(static_cast<int>(BankProtocol::RequestId::CreateAccount), "Failed to start transaction");
+    }
 
-    // Extract the necessary data from the request JSON
-    bool isAdmin = requestJson["isAdmin"].toBool();
-    QString username = requestJson["username"].toString();
-    QString password = requestJson["password"].toString();
-    QString name = requestJson["name"].toString();
-    int age = requestJson["age"].toInt();
     double balance = 0.0;
 
-    QSqlQuery checkQuery(db);
-    checkQuery.prepare("SELECT COUNT(*) FROM Accounts WHERE Username = :username");
-    checkQuery.bindValue(":username", username);
+    QSqlQuery &checkQuery = connection->statement(PooledConnection::UsernameCountQuery);
+    checkQuery.bindValue(":username", request.username);
 
     QJsonObject responseJson;
 
-    if (checkQuery.exec() && checkQuery.next() && checkQuery.value(0).toInt() > 0)
+    bool usernameTaken = execQuery(checkQuery) && checkQuery.next() && checkQuery.value(0).toInt() > 0;
+    // Reset the cached statement before moving on
+    checkQuery.finish();
+
+    if (usernameTaken)
     {
         responseJson["createAccountSuccess"] = false;
         responseJson["errorMessage"] = "exists";
-        db.rollback();
-        checkQuery.finish();
+        rollbackWrite();
         return responseJson;
     }
 
-    QSqlQuery insertQuery(db);
-    insertQuery.prepare("INSERT INTO Accounts (Username, Password, Admin) VALUES (:username, :password, :admin)");
-    insertQuery.bindValue(":username", username);
-    insertQuery.bindValue(":password", password);
-    insertQuery.bindValue(":admin", isAdmin);
+    QSqlQuery &insertQuery = connection->statement(PooledConnection::InsertAccount);
+    insertQuery.bindValue(":username", request.username);
+    insertQuery.bindValue(":password", request.password);
+    insertQuery.bindValue(":admin", request.isAdmin);
 
-    if (!insertQuery.exec())
+    if (!execQuery(insertQuery))
     {
         responseJson["createAccountSuccess"] = false;
         responseJson["errorMessage"] = "failed";
-        db.rollback();
+        rollbackWrite();
         insertQuery.finish();
         return responseJson;
     }
 
     qint64 accountNumber = insertQuery.lastInsertId().toLongLong();
 
-    QSqlQuery personalDataQuery(db);
-    personalDataQuery.prepare("INSERT INTO Users_Personal_Data (AccountNumber, Name, Age, Balance) "
-                              "VALUES (:accountNumber, :name, :age, :balance)");
+    QSqlQuery &personalDataQuery = connection->statement(PooledConnection::InsertPersonalData);
     personalDataQuery.bindValue(":accountNumber", accountNumber);
-    personalDataQuery.bindValue(":name", name);
-    personalDataQuery.bindValue(":age", age);
+    personalDataQuery.bindValue(":name", request.name);
+    personalDataQuery.bindValue(":age", request.age);
     personalDataQuery.bindValue(":balance", balance);
 
-    if (!personalDataQuery.exec())
+    if (!execQuery(personalDataQuery))
     {
         responseJson["createAccountSuccess"] = false;
         responseJson["errorMessage"] = "failed";
-        db.rollback();
+        rollbackWrite();
         personalDataQuery.finish();
         return responseJson;
     }
 
-    db.commit();
+    // The connection is shared with the other sessions of this thread,
+    // so a failed commit must not leave the transaction open
+    if (!commitWrite())
+    {
+        responseJson["createAccountSuccess"] = false;
+        responseJson["errorMessage"] = "failed";
+        rollbackWrite();
+        return responseJson;
+    }
     responseJson["createAccountSuccess"] = true;
     responseJson["accountNumber"] = accountNumber;
-    checkQuery.finish();
     insertQuery.finish();
     personalDataQuery.finish();
     return responseJson;
 }
 
-QJsonObject DatabaseManager::deleteAccount(QJsonObject requestJson)
+QJsonObject DatabaseManager::deleteAccount(const BankProtocol::DeleteAccountRequest &request)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-
-    // Extract the account number from the request JSON
-    qint64 accountNumber = requestJson["accountNumber"].toVariant().toLongLong();
+    const qint64 accountNumber = request.accountNumber;
 
     // Start a transaction
-    if (!dbConnection.transaction())
+    if (!beginWrite())
     {
         logger.log("Failed to start transaction.");
-        return QJsonObject();
+        return failureResponse(static_cast<int>(BankProtocol::RequestId::DeleteAccount), "Failed to start transaction");
     }
 
-    QSqlQuery deleteQuery(dbConnection);
-    deleteQuery.prepare("DELETE FROM Accounts WHERE AccountNumber = :accountNumber");
+    QSqlQuery &deleteQuery = connection->statement(PooledConnection::DeleteAccount);
     deleteQuery.bindValue(":accountNumber", accountNumber);
 
     QJsonObject responseJson;
 
-    if (!deleteQuery.exec())
+    if (!execQuery(deleteQuery))
     {
         logger.log("Failed to delete account from Accounts table.");
-        dbConnection.rollback();
+        rollbackWrite();
         responseJson["deleteAccountSuccess"] = false;
         deleteQuery.finish();
         return responseJson;
     }
 
-    QSqlQuery deletePersonalDataQuery(dbConnection);
-    deletePersonalDataQuery.prepare("DELETE FROM Users_Personal_Data WHERE AccountNumber = :accountNumber");
+    QSqlQuery &deletePersonalDataQuery = connection->statement(PooledConnection::DeletePersonalData);
     deletePersonalDataQuery.bindValue(":accountNumber", accountNumber);
 
-    if (!deletePersonalDataQuery.exec())
+    if (!execQuery(deletePersonalDataQuery))
     {
         logger.log("Failed to delete account from Users_Personal_Data table.");
-        dbConnection.rollback();
+        rollbackWrite();
         responseJson["deleteAccountSuccess"] = false;
         deletePersonalDataQuery.finish();
         return responseJson;
     }
 
-    QSqlQuery deleteTransactionQuery(dbConnection);
-    deleteTransactionQuery.prepare("DELETE FROM Transaction_History WHERE AccountNumber = :accountNumber");
+    QSqlQuery &deleteTransactionQuery = connection->statement(PooledConnection::DeleteTransactionHistory);
     deleteTransactionQuery.bindValue(":accountNumber", accountNumber);
 
-    if(!deleteTransactionQuery.exec())
+    if(!execQuery(deleteTransactionQuery))
     {
         logger.log("Failed to delete transaction history for the account.");
-        dbConnection.rollback();
+        rollbackWrite();
         responseJson["deleteAccountSuccess"] = false;
         deleteTransactionQuery.finish();
         return responseJson;
     }
 
     // If all delete operations succeed, commit the transaction
-    if (!dbConnection.commit())
+    if (!commitWrite())
     {
         logger.log("Failed to commit transaction.");
+        rollbackWrite();
         responseJson["deleteAccountSuccess"] = false;
         return responseJson;
     }
@@ -447,22 +953,54 @@ QJsonObject DatabaseManager::deleteAccount(QJsonObject requestJson)
     deleteTransactionQuery.finish();
     responseJson["deleteAccountSuccess"] = true;
 
+    QJsonObject event;
+    event["responseId"] = static_cast<int>(BankProtocol::RequestId::Subscribe);
+    event["event"] = "accountDeleted";
+    event["accountNumber"] = accountNumber;
+    accountEvents.append({accountNumber, event});
+
     return responseJson;
 }
 
-QJsonObject DatabaseManager::fetchAllUserData()
+QJsonObject DatabaseManager::fetchAllUserData(const BankProtocol::FetchAllUserDataRequest &request)
 {
-    QSqlDatabase db = QSqlDatabase::database(connectionName);
+    QJsonObject responseJson;
 
-    QSqlQuery fetchAllUserDataQuery(db);
-    fetchAllUserDataQuery.prepare("SELECT Accounts.AccountNumber, Accounts.Username, Users_Personal_Data.Name, "
-                                  "Users_Personal_Data.Balance, Users_Personal_Data.Age "
-                                  "FROM Accounts JOIN Users_Personal_Data "
-                                  "ON Accounts.AccountNumber = Users_Personal_Data.AccountNumber");
+    if (request.hasOptions())
+    {
+        QSqlQuery filteredQuery;
+        QString errorMessage;
+        if (!prepareUserDataQuery(request, filteredQuery, errorMessage))
+        {
+            responseJson["fetchUserDataSuccess"] = false;
+            responseJson["errorMessage"] = errorMessage;
+            return responseJson;
+        }
+        // Timed through its last row, a filtered listing can be most of the table
+        QueryTimer::Scope timing(filteredQuery, connection->database());
+        if (!timing.exec())
+        {
+            logger.log("Error: " + filteredQuery.lastError().text());
+            responseJson["fetchUserDataSuccess"] = false;
+            responseJson["errorMessage"] = "failed";
+            return responseJson;
+        }
 
-    QJsonObject responseJson;
+        const bool projected = !request.columns.isEmpty();
+        QJsonArray userDataArray;
+        while (timing.next())
+        {
+            userDataArray.append(projected ? projectedUserDataRow(filteredQuery) : userDataRow(filteredQuery));
+        }
+        responseJson["fetchUserDataSuccess"] = true;
+        responseJson["userData"] = userDataArray;
+        return responseJson;
+    }
+
+    QSqlQuery &fetchAllUserDataQuery = connection->statement(PooledConnection::FetchAllUserData);
 
-    if (!fetchAllUserDataQuery.exec())
+    QueryTimer::Scope timing(fetchAllUserDataQuery, connection->database());
+    if (!timing.exec())
     {
         responseJson["fetchUserDataSuccess"] = false;
         responseJson["errorMessage"] = "failed";
@@ -473,16 +1011,9 @@ QJsonObject DatabaseManager::fetchAllUserData()
     // Create a JSON array to store user data
     QJsonArray userDataArray;
 
-    while (fetchAllUserDataQuery.next())
+    while (timing.next())
     {
-        QJsonObject userData;
-        userData["AccountNumber"] = fetchAllUserDataQuery.value("AccountNumber").toLongLong();
-        userData["Username"] = fetchAllUserDataQuery.value("Username").toString();
-        userData["Name"] = fetchAllUserDataQuery.value("Name").toString();
-        userData["Balance"] = fetchAllUserDataQuery.value("Balance").toDouble();
-        userData["Age"] = fetchAllUserDataQuery.value("Age").toInt();
-
-        userDataArray.append(userData);
+        userDataArray.append(userDataRow(fetchAllUserDataQuery));
     }
 
     responseJson["fetchUserDataSuccess"] = true;
@@ -492,158 +1023,251 @@ QJsonObject DatabaseManager::fetchAllUserData()
     return responseJson;
 }
 
-QJsonObject DatabaseManager::makeTransaction(QJsonObject requestJson)
+QJsonObject DatabaseManager::fetchUserDataChanges(const BankProtocol::FetchUserDataChangesRequest &request)
 {
-    QSqlDatabase db = QSqlDatabase::database(connectionName);
-    db.transaction();
+    QSqlQuery &changesQuery = connection->statement(PooledConnection::UserDataChanges);
+    changesQuery.bindValue(":sinceVersion", request.sinceVersion);
+    // Without a previous page every change at sinceVersion was already seen
+    changesQuery.bindValue(":afterAccountNumber", request.afterAccountNumber != 0
+                                                      ? request.afterAccountNumber
+                                                      : std::numeric_limits<qint64>::max());
+    // One row past the page tells whether there is another
+    changesQuery.bindValue(":limit", BankProtocol::FetchUserDataChangesRequest::MaxRows + 1);
+
+    QJsonObject responseJson;
+
+    QueryTimer::Scope timing(changesQuery, connection->database());
+    if (!timing.exec())
+    {
+        responseJson["fetchUserDataChangesSuccess"] = false;
+        responseJson["errorMessage"] = "failed";
+        changesQuery.finish();
+        return responseJson;
+    }
 
-    // Extract the necessary data from the request JSON
-    qint64 accountNumber = requestJson["accountNumber"].toVariant().toLongLong();
-    double amount = requestJson["amount"].toDouble();
+    QJsonArray userDataArray;
+    QJsonArray deletedArray;
+    qint64 version = request.sinceVersion;
+    qint64 lastAccountNumber = 0;
+    int rows = 0;
+    bool hasMore = false;
 
-    // Check if the balance is sufficient
-    QJsonObject balanceObj = getAccountBalance(requestJson);
+    while (timing.next())
+    {
+        if (rows == BankProtocol::FetchUserDataChangesRequest::MaxRows)
+        {
+            hasMore = true;
+            break;
+        }
+        ++rows;
+        version = qMax(version, changesQuery.value("ChangeVersion").toLongLong());
+        lastAccountNumber = changesQuery.value("AccountNumber").toLongLong();
+        if (changesQuery.value("Deleted").toBool())
+        {
+            deletedArray.append(changesQuery.value("AccountNumber").toLongLong());
+        }
+        else if (!changesQuery.value("Age").isNull())
+        {
+            // Accounts without personal data, like the admin, aren't in the table
+            userDataArray.append(userDataRow(changesQuery));
+        }
+    }
+    changesQuery.finish();
 
-    double currentBalance = balanceObj["balance"].toDouble();
+    responseJson["fetchUserDataChangesSuccess"] = true;
+    responseJson["userData"] = userDataArray;
+    responseJson["deleted"] = deletedArray;
+    responseJson["version"] = version;
+    responseJson["hasMore"] = hasMore;
+    if (hasMore)
+    {
+        responseJson["afterAccountNumber"] = lastAccountNumber;
+    }
 
-    QJsonObject responseJson;
+    return responseJson;
+}
+
+DatabaseManager::BalanceUpdate DatabaseManager::applyAmount(qint64 accountNumber, double amount, double &newBalance)
+{
+    // Check and update in one statement so concurrent writers can't lose an update
+    QSqlQuery &applyAmountQuery = connection->statement(PooledConnection::ApplyAmount);
+    applyAmountQuery.bindValue(":accountNumber", accountNumber);
+    applyAmountQuery.bindValue(":amount", amount);
+    applyAmountQuery.bindValue(":checkAmount", amount);
 
-    if (currentBalance < 0 || currentBalance + amount < 0)
+    if (!execQuery(applyAmountQuery))
     {
-        responseJson["transactionSuccess"] = false;
-        responseJson["errorMessage"] = "Insufficient balance";
-        db.rollback();
-        return responseJson;
+        logger.log("Failed to update balance: " + applyAmountQuery.lastError().text());
+        applyAmountQuery.finish();
+        return BalanceUpdate::Failed;
+    }
+
+    // RETURNING yields the row only if the WHERE clause matched
+    bool applied = applyAmountQuery.next();
+    if (applied)
+    {
+        newBalance = applyAmountQuery.value(0).toDouble();
+    }
+    applyAmountQuery.finish();
+
+    if (applied)
+    {
+        return BalanceUpdate::Applied;
+    }
+
+    // Rare path, tell a missing account apart from an insufficient balance
+    QSqlQuery &balanceQuery = connection->statement(PooledConnection::BalanceQuery);
+    balanceQuery.bindValue(":accountNumber", accountNumber);
+    bool accountFound = execQuery(balanceQuery) && balanceQuery.next();
+    balanceQuery.finish();
+
+    return accountFound ? BalanceUpdate::InsufficientBalance : BalanceUpdate::AccountNotFound;
+}
+
+QJsonObject DatabaseManager::makeTransaction(const BankProtocol::MakeTransactionRequest &request)
+{
+    if (!beginWrite())
+    {
+        logger.log("Failed to start transaction.");
+        return failureResponse(static_cast<int>(BankProtocol::RequestId::MakeTransaction), "Failed to start transaction");
     }
 
-    // Update the balance
-    double newBalance = currentBalance + amount;  // Reverse the logic here
-    QSqlQuery updateBalanceQuery(db);
-    updateBalanceQuery.prepare("UPDATE Users_Personal_Data SET Balance = :balance WHERE AccountNumber = :accountNumber");
-    updateBalanceQuery.bindValue(":balance", newBalance);
-    updateBalanceQuery.bindValue(":accountNumber", accountNumber);
+    const qint64 accountNumber = request.accountNumber;
+    const double amount = request.amount;
+
+    QJsonObject responseJson;
+
+    // Update the balance, only if it stays non-negative
+    double newBalance = 0.0;
+    BalanceUpdate update = applyAmount(accountNumber, amount, newBalance);
 
-    if (!updateBalanceQuery.exec())
+    if (update != BalanceUpdate::Applied)
     {
         responseJson["transactionSuccess"] = false;
-        responseJson["errorMessage"] = "Failed to update balance";
-        db.rollback();
-        updateBalanceQuery.finish();
+        if (update == BalanceUpdate::InsufficientBalance)
+        {
+            responseJson["errorMessage"] = "Insufficient balance";
+        }
+        else if (update == BalanceUpdate::AccountNotFound)
+        {
+            responseJson["errorMessage"] = "Account not found";
+        }
+        else
+        {
+            responseJson["errorMessage"] = "Failed to update balance";
+        }
+        rollbackWrite();
         return responseJson;
     }
 
     // Log the transaction in the Transaction_History table
-    QDateTime currentDateTime = QDateTime::currentDateTime();
-    QString formattedDate = currentDateTime.toString("dd-MM-yyyy");
-    QString formattedTime = currentDateTime.toString("hh:mm:ss");
+    qint64 timestamp = CoarseClock::nowMicros();
 
-    QSqlQuery logTransactionQuery(db);
-    logTransactionQuery.prepare("INSERT INTO Transaction_History (AccountNumber, Date, Time, Amount) "
-                                "VALUES (:accountNumber, :date, :time, :amount)");
+    QSqlQuery &logTransactionQuery = connection->statement(PooledConnection::InsertTransaction);
     logTransactionQuery.bindValue(":accountNumber", accountNumber);
-    logTransactionQuery.bindValue(":date", formattedDate);
-    logTransactionQuery.bindValue(":time", formattedTime);
+    logTransactionQuery.bindValue(":timestamp", timestamp);
     logTransactionQuery.bindValue(":amount", amount);
 
-    if (!logTransactionQuery.exec())
+    if (!execQuery(logTransactionQuery))
     {
         responseJson["transactionSuccess"] = false;
         responseJson["errorMessage"] = "Failed to log transaction";
-        db.rollback();
+        rollbackWrite();
         logTransactionQuery.finish();
         return responseJson;
     }
 
-    db.commit();
+    if (!commitWrite())
+    {
+        responseJson["transactionSuccess"] = false;
+        responseJson["errorMessage"] = "Failed to commit transaction";
+        rollbackWrite();
+        return responseJson;
+    }
     responseJson["transactionSuccess"] = true;
     responseJson["newBalance"] = newBalance;
-    updateBalanceQuery.finish();
     logTransactionQuery.finish();
+    addTransactionEvent(accountNumber, amount, newBalance, timestamp);
     return responseJson;
 }
 
-QJsonObject DatabaseManager::makeTransfer(QJsonObject requestJson)
+QJsonObject DatabaseManager::makeTransfer(const BankProtocol::MakeTransferRequest &request)
 {
-    QSqlDatabase db = QSqlDatabase::database(connectionName);
-    db.transaction();
-
-    // Extract the necessary data from the request JSON
-    qint64 fromAccountNumber = requestJson["fromAccountNumber"].toVariant().toLongLong();
-    qint64 toAccountNumber = requestJson["toAccountNumber"].toVariant().toLongLong();
-    double amount = requestJson["amount"].toDouble();
-
-    // Create a new JSON object for the 'from' account balance request
-    QJsonObject fromBalanceRequest;
-    fromBalanceRequest["accountNumber"] = fromAccountNumber;
-
-    // Check if the 'from' account has sufficient balance
-    QJsonObject fromBalanceObj = getAccountBalance(fromBalanceRequest);
-    double fromAccountBalance = fromBalanceObj["balance"].toDouble();
+    const qint64 fromAccountNumber = request.fromAccountNumber;
+    const qint64 toAccountNumber = request.toAccountNumber;
+    const double amount = request.amount;
 
     QJsonObject responseJson;
 
-    if (fromAccountBalance < 0 || fromAccountBalance - amount < 0)
+    // A negative amount would pull money out of the 'to' account
+    if (amount <= 0 || fromAccountNumber == toAccountNumber)
     {
         responseJson["transferSuccess"] = false;
-        responseJson["errorMessage"] = "Insufficient balance for the transfer";
-        db.rollback();
+        responseJson["errorMessage"] = "Invalid transfer";
         return responseJson;
     }
 
-    // Update the 'from' and 'to' account balances
-    double newFromBalance = fromAccountBalance - amount;
-
-    // Create a new JSON object for the 'to' account balance request
-    QJsonObject toBalanceRequest;
-    toBalanceRequest["accountNumber"] = toAccountNumber;
-
-    QJsonObject toBalanceObj = getAccountBalance(toBalanceRequest);
-    double newToBalance = toBalanceObj["balance"].toDouble() + amount;
+    if (!beginWrite())
+    {
+        logger.log("Failed to start transaction.");
+        return failureResponse(static_cast<int>(BankProtocol::RequestId::MakeTransfer), "Failed to start transaction");
+    }
 
-    QSqlQuery updateBalanceQuery(db);
-    updateBalanceQuery.prepare("UPDATE Users_Personal_Data SET Balance = :balance WHERE AccountNumber = :accountNumber");
-    updateBalanceQuery.bindValue(":balance", newFromBalance);
-    updateBalanceQuery.bindValue(":accountNumber", fromAccountNumber);
+    // Debit the 'from' account, only if it covers the amount
+    double newFromBalance = 0.0;
+    BalanceUpdate fromUpdate = applyAmount(fromAccountNumber, -amount, newFromBalance);
 
-    if (!updateBalanceQuery.exec())
+    if (fromUpdate != BalanceUpdate::Applied)
     {
         responseJson["transferSuccess"] = false;
-        responseJson["errorMessage"] = "Failed to update 'from' account balance";
-        db.rollback();
-        updateBalanceQuery.finish();
+        if (fromUpdate == BalanceUpdate::InsufficientBalance)
+        {
+            responseJson["errorMessage"] = "Insufficient balance for the transfer";
+        }
+        else if (fromUpdate == BalanceUpdate::AccountNotFound)
+        {
+            responseJson["errorMessage"] = "'From' account not found";
+        }
+        else
+        {
+            responseJson["errorMessage"] = "Failed to update 'from' account balance";
+        }
+        rollbackWrite();
         return responseJson;
     }
 
-    updateBalanceQuery.bindValue(":balance", newToBalance);
-    updateBalanceQuery.bindValue(":accountNumber", toAccountNumber);
+    // Credit the 'to' account
+    double newToBalance = 0.0;
+    BalanceUpdate toUpdate = applyAmount(toAccountNumber, amount, newToBalance);
 
-    if (!updateBalanceQuery.exec())
+    if (toUpdate != BalanceUpdate::Applied)
     {
         responseJson["transferSuccess"] = false;
-        responseJson["errorMessage"] = "Failed to update 'to' account balance";
-        db.rollback();
-        updateBalanceQuery.finish();
+        if (toUpdate == BalanceUpdate::AccountNotFound)
+        {
+            responseJson["errorMessage"] = "'To' account not found";
+        }
+        else
+        {
+            responseJson["errorMessage"] = "Failed to update 'to' account balance";
+        }
+        rollbackWrite();
         return responseJson;
     }
 
     // Log the transfer in the Transaction_History table for both 'from' and 'to' accounts
-    QDateTime currentDateTime = QDateTime::currentDateTime();
-    QString formattedDate = currentDateTime.toString("dd-MM-yyyy");
-    QString formattedTime = currentDateTime.toString("hh:mm:ss");
+    qint64 timestamp = CoarseClock::nowMicros();
 
-    QSqlQuery logTransactionQuery(db);
-    logTransactionQuery.prepare("INSERT INTO Transaction_History (AccountNumber, Date, Time, Amount) "
-                                "VALUES (:accountNumber, :date, :time, :amount)");
+    QSqlQuery &logTransactionQuery = connection->statement(PooledConnection::InsertTransaction);
     logTransactionQuery.bindValue(":accountNumber", fromAccountNumber);
-    logTransactionQuery.bindValue(":date", formattedDate);
-    logTransactionQuery.bindValue(":time", formattedTime);
+    logTransactionQuery.bindValue(":timestamp", timestamp);
     logTransactionQuery.bindValue(":amount", -amount); // Negative amount for 'from' account
 
-    if (!logTransactionQuery.exec())
+    if (!execQuery(logTransactionQuery))
     {
         responseJson["transferSuccess"] = false;
         responseJson["errorMessage"] = "Failed to log 'from' account transaction";
-        db.rollback();
+        rollbackWrite();
         logTransactionQuery.finish();
         return responseJson;
     }
@@ -651,52 +1275,350 @@ QJsonObject DatabaseManager::makeTransfer(QJsonObject requestJson)
     logTransactionQuery.bindValue(":accountNumber", toAccountNumber);
     logTransactionQuery.bindValue(":amount", amount); // Positive amount for 'to' account
 
-    if (!logTransactionQuery.exec())
+    if (!execQuery(logTransactionQuery))
     {
         responseJson["transferSuccess"] = false;
         responseJson["errorMessage"] = "Failed to log 'to' account transaction";
-        db.rollback();
+        rollbackWrite();
         logTransactionQuery.finish();
         return responseJson;
     }
 
-    db.commit();
+    if (!commitWrite())
+    {
+        responseJson["transferSuccess"] = false;
+        responseJson["errorMessage"] = "Failed to commit transfer";
+        rollbackWrite();
+        return responseJson;
+    }
     responseJson["transferSuccess"] = true;
     responseJson["newFromBalance"] = newFromBalance;
     responseJson["newToBalance"] = newToBalance;
-    updateBalanceQuery.finish();
     logTransactionQuery.finish();
+    addTransactionEvent(fromAccountNumber, -amount, newFromBalance, timestamp);
+    addTransactionEvent(toAccountNumber, amount, newToBalance, timestamp);
 
     return responseJson;
 }
 
-QJsonObject DatabaseManager::viewTransactionHistory(QJsonObject requestJson)
+QJsonObject DatabaseManager::viewTransactionHistoryPage(const BankProtocol::TransactionHistoryRequest &request)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery query(dbConnection);
+    QJsonObject responseJson;
 
-    // Extract the account number from the request JSON
-    qint64 accountNumber = requestJson["accountNumber"].toVariant().toLongLong();
+    // The first page starts above every possible key
+    qint64 cursorTimestamp = std::numeric_limits<qint64>::max();
+    qint64 cursorTransactionId = std::numeric_limits<qint64>::max();
+    if (!request.cursor.isEmpty() && !decodeHistoryCursor(request.cursor, cursorTimestamp, cursorTransactionId))
+    {
+        responseJson["viewTransactionHistorySuccess"] = false;
+        responseJson["errorMessage"] = "Invalid cursor";
+        return responseJson;
+    }
 
-    query.prepare("SELECT TransactionID, Date, Time, Amount FROM Transaction_History "
-                  "WHERE AccountNumber = :accountNumber ORDER BY Date DESC, Time DESC");
+    const int pageSize = qMin(request.pageSize, BankProtocol::TransactionHistoryRequest::MaxPageSize);
 
-    query.bindValue(":accountNumber", accountNumber);
+    QSqlQuery &query = connection->statement(PooledConnection::TransactionHistoryPage);
+    query.bindValue(":accountNumber", request.accountNumber);
+    query.bindValue(":cursorTimestamp", cursorTimestamp);
+    query.bindValue(":cursorTransactionId", cursorTransactionId);
+    // One row more than asked tells whether another page follows
+    query.bindValue(":limit", pageSize + 1);
+
+    QueryTimer::Scope timing(query, connection->database());
+    if (!timing.exec())
+    {
+        logger.log("Error: " + query.lastError().text());
+        query.finish();
+        responseJson["viewTransactionHistorySuccess"] = false;
+        responseJson["errorMessage"] = "failed";
+        return responseJson;
+    }
 
-    QJsonObject responseJson;
     QJsonArray transactionHistoryArray;
+    qint64 lastTimestamp = 0;
+    qint64 lastTransactionId = 0;
+    bool hasMore = false;
+
+    while (timing.next())
+    {
+        if (transactionHistoryArray.size() == pageSize)
+        {
+            hasMore = true;
+            break;
+        }
+        QJsonObject row = transactionRow(query);
+        lastTimestamp = row["Timestamp"].toInteger();
+        lastTransactionId = row["TransactionID"].toInteger();
+        transactionHistoryArray.append(row);
+    }
+    query.finish();
 
-    if (query.exec())
+    responseJson["transactionHistory"] = transactionHistoryArray;
+    responseJson["viewTransactionHistorySuccess"] = true;
+    responseJson["hasMore"] = hasMore;
+    if (hasMore)
+    {
+        responseJson["nextCursor"] = encodeHistoryCursor(lastTimestamp, lastTransactionId);
+    }
+
+    return responseJson;
+}
+
+QString DatabaseManager::encodeHistoryCursor(qint64 timestamp, qint64 transactionId)
+{
+    // Opaque to the client, only ever handed back unchanged
+    QByteArray key = QByteArray::number(timestamp) + ':' + QByteArray::number(transactionId);
+    return QString::fromLatin1(key.toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals));
+}
+
+bool DatabaseManager::decodeHistoryCursor(const QString &cursor, qint64 &timestamp, qint64 &transactionId)
+{
+    QByteArray::FromBase64Result decoded =
+        QByteArray::fromBase64Encoding(cursor.toLatin1(), QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
+    if (!decoded)
+    {
+        return false;
+    }
+
+    QList<QByteArray> parts = decoded.decoded.split(':');
+    if (parts.size() != 2)
+    {
+        return false;
+    }
+    bool timestampOk = false;
+    bool transactionIdOk = false;
+    timestamp = parts[0].toLongLong(&timestampOk);
+    transactionId = parts[1].toLongLong(&transactionIdOk);
+    return timestampOk && transactionIdOk;
+}
+
+// Keys a fetchAllUserData request may project and sort on
+static const struct
+{
+    const char *name;
+    const char *expression;
+} userDataColumns[] =
+{
+    {"AccountNumber", "Accounts.AccountNumber"},
+    {"Username", "Accounts.Username"},
+    {"Name", "Users_Personal_Data.Name"},
+    {"Balance", "Users_Personal_Data.Balance"},
+    {"Age", "Users_Personal_Data.Age"}
+};
+
+static const char *userDataColumn(const QString &name)
+{
+    for (const auto &column : userDataColumns)
+    {
+        if (name == QLatin1String(column.name))
+        {
+            return column.expression;
+        }
+    }
+    return nullptr;
+}
+
+// Adds a prefix match as a range, so an index on the column can serve it.
+// A COLLATE NOCASE column compares with ASCII letters folded to lower case,
+// so both bounds are built in that folded order
+static void addPrefixCondition(const char *expression, const QString &prefix, bool noCase,
+                               QStringList &conditions, QVariantList &values)
+{
+    QString start = prefix;
+    if (noCase)
+    {
+        for (QChar &character : start)
+        {
+            if (character >= QLatin1Char('A') && character <= QLatin1Char('Z'))
+            {
+                character = QChar(character.unicode() + ('a' - 'A'));
+            }
+        }
+    }
+    conditions.append(QString("%1 >= ?").arg(expression));
+    values.append(start);
+
+    // The smallest string past every one with this prefix
+    QString end = start;
+    char16_t last = end.back().unicode();
+    if (last != 0xFFFF)
+    {
+        ++last;
+        // Upper case letters sort as lower case ones under NOCASE, the next
+        // character in that order after '@' is '['
+        if (noCase && last >= u'A' && last <= u'Z')
+        {
+            last = u'[';
+        }
+        end.back() = QChar(last);
+        conditions.append(QString("%1 < ?").arg(expression));
+        values.append(end);
+    }
+}
+
+bool DatabaseManager::userDataSql(const BankProtocol::FetchAllUserDataRequest &request, QStringList &columns,
+                                  QStringList &conditions, QVariantList &values, const char *&sortExpression,
+                                  QString &errorMessage)
+{
+    // Only names from userDataColumns ever reach the SQL text, values are bound
+    if (request.columns.isEmpty())
+    {
+        for (const auto &column : userDataColumns)
+        {
+            columns.append(QString("%1 AS %2").arg(column.expression, column.name));
+        }
+    }
+    for (const QString &name : request.columns)
+    {
+        const char *expression = userDataColumn(name);
+        if (expression == nullptr)
+        {
+            errorMessage = "Unknown column: " + name;
+            return false;
+        }
+        columns.append(QString("%1 AS %2").arg(expression, name));
+    }
+
+    if (request.minBalance)
+    {
+        conditions.append("Users_Personal_Data.Balance >= ?");
+        values.append(*request.minBalance);
+    }
+    if (request.maxBalance)
+    {
+        conditions.append("Users_Personal_Data.Balance <= ?");
+        values.append(*request.maxBalance);
+    }
+    if (request.minAge)
+    {
+        conditions.append("Users_Personal_Data.Age >= ?");
+        values.append(*request.minAge);
+    }
+    if (request.maxAge)
+    {
+        conditions.append("Users_Personal_Data.Age <= ?");
+        values.append(*request.maxAge);
+    }
+    if (!request.usernamePrefix.isEmpty())
     {
-        while (query.next())
+        addPrefixCondition("Accounts.Username", request.usernamePrefix, true, conditions, values);
+    }
+    if (!request.namePrefix.isEmpty())
+    {
+        addPrefixCondition("Users_Personal_Data.Name", request.namePrefix, false, conditions, values);
+    }
+
+    sortExpression = userDataColumn(request.sortBy.isEmpty() ? "AccountNumber" : request.sortBy);
+    if (sortExpression == nullptr)
+    {
+        errorMessage = "Unknown column: " + request.sortBy;
+        return false;
+    }
+    if (request.limit < 0)
+    {
+        errorMessage = "Invalid limit";
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::prepareUserDataQuery(const BankProtocol::FetchAllUserDataRequest &request,
+                                           QSqlQuery &query, QString &errorMessage)
+{
+    QStringList columns;
+    QStringList conditions;
+    QVariantList values;
+    const char *sortExpression = nullptr;
+    if (!userDataSql(request, columns, conditions, values, sortExpression, errorMessage))
+    {
+        return false;
+    }
+
+    QString sql = "SELECT " + columns.join(", ") + QLatin1String(userDataFrom);
+    if (!conditions.isEmpty())
+    {
+        sql += " WHERE " + conditions.join(" AND ");
+    }
+
+    // A limit without a sort order still returns the same rows every time
+    if (!request.sortBy.isEmpty() || request.limit > 0)
+    {
+        sql += QString(" ORDER BY %1 %2").arg(sortExpression, request.descending ? "DESC" : "ASC");
+    }
+    if (request.limit > 0)
+    {
+        sql += " LIMIT ?";
+        values.append(request.limit);
+    }
+
+    query = connection->cursor(sql);
+    for (const QVariant &value : values)
+    {
+        query.addBindValue(value);
+    }
+    return true;
+}
+
+QJsonObject DatabaseManager::userDataRow(const QSqlQuery &query)
+{
+    QJsonObject userData;
+    userData["AccountNumber"] = query.value("AccountNumber").toLongLong();
+    userData["Username"] = query.value("Username").toString();
+    userData["Name"] = query.value("Name").toString();
+    userData["Balance"] = query.value("Balance").toDouble();
+    userData["Age"] = query.value("Age").toInt();
+    return userData;
+}
+
+QJsonObject DatabaseManager::projectedUserDataRow(const QSqlQuery &query)
+{
+    QJsonObject userData;
+    const QSqlRecord record = query.record();
+    for (int field = 0; field < record.count(); ++field)
+    {
+        const QString name = record.fieldName(field);
+        if (!name.startsWith('_'))
         {
-            QJsonObject transactionObj;
-            transactionObj["TransactionID"] = query.value("TransactionID").toLongLong();
-            transactionObj["Date"] = query.value("Date").toString();
-            transactionObj["Time"] = query.value("Time").toString();
-            transactionObj["Amount"] = query.value("Amount").toDouble();
+            userData[name] = QJsonValue::fromVariant(query.value(field));
+        }
+    }
+    return userData;
+}
+
+QJsonObject DatabaseManager::transactionRow(const QSqlQuery &query)
+{
+    QJsonObject transactionObj;
+    transactionObj["TransactionID"] = query.value("TransactionID").toLongLong();
+    // Stored as UTC microseconds, formatted in server local time only here
+    qint64 timestamp = query.value("Timestamp").toLongLong();
+    QDateTime dateTime = QDateTime::fromMSecsSinceEpoch(timestamp / 1000);
+    transactionObj["Timestamp"] = timestamp;
+    transactionObj["Date"] = dateTime.toString("dd-MM-yyyy");
+    transactionObj["Time"] = dateTime.toString("hh:mm:ss");
+    transactionObj["Amount"] = query.value("Amount").toDouble();
+    return transactionObj;
+}
+
+QJsonObject DatabaseManager::viewTransactionHistory(const BankProtocol::TransactionHistoryRequest &request)
+{
+    if (request.pageSize > 0)
+    {
+        return viewTransactionHistoryPage(request);
+    }
+
+    QSqlQuery &query = connection->statement(PooledConnection::TransactionHistory);
 
-            transactionHistoryArray.append(transactionObj);
+    query.bindValue(":accountNumber", request.accountNumber);
+
+    QJsonObject responseJson;
+    QJsonArray transactionHistoryArray;
+
+    QueryTimer::Scope timing(query, connection->database());
+    if (timing.exec())
+    {
+        while (timing.next())
+        {
+            transactionHistoryArray.append(transactionRow(query));
         }
     }
 
@@ -707,66 +1629,80 @@ QJsonObject DatabaseManager::viewTransactionHistory(QJsonObject requestJson)
     return responseJson;
 }
 
-QJsonObject DatabaseManager::updateUserData(QJsonObject requestJson)
+QJsonObject DatabaseManager::updateUserData(const BankProtocol::UpdateUserDataRequest &request)
 {
-    QSqlDatabase db = QSqlDatabase::database(connectionName);
+    const QString &username = request.username;
+    const QString &name = request.name;
+    const QString &password = request.password;
 
-    // Extract the necessary data from the request JSON
-    QString username = requestJson["username"].toString();
-    QString name = requestJson["name"].toString();
-    QString password = requestJson["password"].toString();
+    // Password and name change together or not at all
+    if (!beginWrite())
+    {
+        logger.log("Failed to start transaction.");
+        return failureResponse(static_cast<int>(BankProtocol::RequestId::UpdateUserData), "Failed to start transaction");
+    }
 
     // Check if the account exists and get the account number
-    QSqlQuery checkQuery(db);
-    checkQuery.prepare("SELECT AccountNumber FROM Accounts WHERE Username = :username");
+    QSqlQuery &checkQuery = connection->statement(PooledConnection::AccountNumberQuery);
     checkQuery.bindValue(":username", username);
 
     QJsonObject responseJson;
 
-    if (checkQuery.exec() && checkQuery.next())
+    if (execQuery(checkQuery) && checkQuery.next())
     {
         qint64 accountNumber = checkQuery.value(0).toLongLong();
+        checkQuery.finish();
 
         // The account exists, proceed with the update
         if (!password.isEmpty())
         {
-            QSqlQuery updateQuery(db);
-            updateQuery.prepare("UPDATE Accounts SET Password = :password WHERE Username = :username");
+            QSqlQuery &updateQuery = connection->statement(PooledConnection::UpdatePassword);
             updateQuery.bindValue(":username", username);
             updateQuery.bindValue(":password", password);
-            if (!updateQuery.exec())
+            if (!execQuery(updateQuery))
             {
                 responseJson["updateSuccess"] = false;
                 responseJson["errorMessage"] = "Failed to update password";
-                checkQuery.finish();
+                updateQuery.finish();
+                rollbackWrite();
                 return responseJson;
             }
+            updateQuery.finish();
         }
 
         if (!name.isEmpty())
         {
-            QSqlQuery updateQuery(db);
-            updateQuery.prepare("UPDATE Users_Personal_Data SET Name = :name WHERE AccountNumber = :accountNumber");
+            QSqlQuery &updateQuery = connection->statement(PooledConnection::UpdateName);
             updateQuery.bindValue(":accountNumber", accountNumber);
             updateQuery.bindValue(":name", name);
-            if (!updateQuery.exec())
+            if (!execQuery(updateQuery))
             {
                 responseJson["updateSuccess"] = false;
                 responseJson["errorMessage"] = "Failed to update name";
                 updateQuery.finish();
+                rollbackWrite();
                 return responseJson;
             }
+            updateQuery.finish();
         }
 
+        if (!commitWrite())
+        {
+            responseJson["updateSuccess"] = false;
+            responseJson["errorMessage"] = "Failed to commit update";
+            rollbackWrite();
+            return responseJson;
+        }
         responseJson["updateSuccess"] = true;
     }
     else
     {
         // The account does not exist
+        checkQuery.finish();
+        rollbackWrite();
         responseJson["updateSuccess"] = false;
         responseJson["errorMessage"] = "Account not found";
     }
-    checkQuery.finish();
 
     return responseJson;
 }
@@ -13,6 +13,12 @@
 #include <QDateTime>
 
 #include "Logger.h"
+#include "databaseconnectionpool.h"
+#include "bankprotocol.h"
+#include "messagecodec.h"
+#include "notificationhub.h"
+
+class ResultStream;
 
 class DatabaseManager : public QObject
 {
@@ -21,27 +27,107 @@ class DatabaseManager : public QObject
 public:
     explicit DatabaseManager(const QString &connectionName, QObject *parent = nullptr);
     ~DatabaseManager();
-    void initializeDatabase();
+    bool initializeDatabase();
     bool openConnection();
     void closeConnection();
-    bool createTables();
-    QJsonObject processRequest(QJsonObject requestJson);
+    QJsonObject processRequest(const QJsonObject &requestJson);
+    // Chunked keyset reads for a request that asked to be streamed, nullptr for every other request
+    ResultStream *openResultStream(const QJsonObject &requestJson, MessageCodec::Encoding encoding);
+
+    // Requests that change data go through the LedgerWriter
+    static bool isWriteRequest(int requestId);
+    static QJsonObject failureResponse(int requestId, const QString &errorMessage);
+
+    // Transaction around a group commit, the requests inside nest as savepoints
+    bool beginBatch();
+    bool commitBatch();
+    void rollbackBatch();
+    // Account changes of the writes so far, published by the writer once they committed
+    QVector<AccountEvent> takeAccountEvents();
 
 private:
     QMutex mutex;
     QString connectionName;
+    PooledConnection *connection = nullptr;
     Logger logger;
+    QVector<AccountEvent> accountEvents;
+
+    struct SchemaMigration
+    {
+        int version;
+        const char *description;
+        bool (DatabaseManager::*apply)();
+    };
+    static const SchemaMigration schemaMigrations[];
+
+    bool beginWrite();
+    bool commitWrite();
+    void rollbackWrite();
+    bool runSavepointStatement(PooledConnection::Statement id);
+    // Every statement runs through these, timed by the QueryTimer
+    bool execQuery(QSqlQuery &query);
+    bool execQuery(QSqlQuery &query, const QString &sql);
+    static const int MaxBusyRetries = 3;
+    static bool isBusyError(const QSqlError &error);
+
+    bool migrateSchema();
+    bool setSchemaVersion(int version);
+    bool createTables();
+    bool addTransactionHistoryIndex();
+    bool convertTransactionTimestamps();
+    bool addAccountChangeTracking();
+    bool addUserDataFilterIndexes();
+
+    using RequestHandlerFunction = QJsonObject (DatabaseManager::*)(const QJsonObject &);
+
+    // Decodes the request struct once and calls its typed handler
+    template <typename Request, auto Handler>
+    QJsonObject dispatch(const QJsonObject &requestJson)
+    {
+        return (this->*Handler)(BankProtocol::decode<Request>(requestJson));
+    }
+
+    QJsonObject executeRequest(int requestId, const QJsonObject &requestJson);
+    QJsonObject processBatch(const BankProtocol::BatchRequest &request);
+
+    QJsonObject login(const BankProtocol::LoginRequest &request);
+    QJsonObject getAccountNumber(const BankProtocol::GetAccountNumberRequest &request);
+    QJsonObject getAccountBalance(const BankProtocol::GetBalanceRequest &request);
+    QJsonObject createNewAccount(const BankProtocol::CreateAccountRequest &request);
+    QJsonObject deleteAccount(const BankProtocol::DeleteAccountRequest &request);
+    QJsonObject fetchAllUserData(const BankProtocol::FetchAllUserDataRequest &request);
+    QJsonObject fetchUserDataChanges(const BankProtocol::FetchUserDataChangesRequest &request);
+    // Outcome of adding an amount to one account's balance
+    enum class BalanceUpdate
+    {
+        Applied,
+        InsufficientBalance,
+        AccountNotFound,
+        Failed
+    };
+    BalanceUpdate applyAmount(qint64 accountNumber, double amount, double &newBalance);
+
+    void addTransactionEvent(qint64 accountNumber, double amount, double balance, qint64 timestamp);
 
-    QJsonObject login(QJsonObject requestJson);
-    QJsonObject getAccountNumber(QJsonObject requestJson);
-    QJsonObject getAccountBalance(QJsonObject requestJson);
-    QJsonObject createNewAccount(QJsonObject requestJson);
-    QJsonObject deleteAccount(QJsonObject requestJson);
-    QJsonObject fetchAllUserData(void);
-    QJsonObject makeTransaction(QJsonObject requestJson);
-    QJsonObject makeTransfer(QJsonObject requestJson);
-    QJsonObject viewTransactionHistory(QJsonObject requestJson);
-    QJsonObject updateUserData(QJsonObject requestJson);
+    QJsonObject makeTransaction(const BankProtocol::MakeTransactionRequest &request);
+    QJsonObject makeTransfer(const BankProtocol::MakeTransferRequest &request);
+    QJsonObject viewTransactionHistory(const BankProtocol::TransactionHistoryRequest &request);
+    QJsonObject viewTransactionHistoryPage(const BankProtocol::TransactionHistoryRequest &request);
+    static QString encodeHistoryCursor(qint64 timestamp, qint64 transactionId);
+    static bool decodeHistoryCursor(const QString &cursor, qint64 &timestamp, qint64 &transactionId);
+    // Selected columns, filters with their values and sort key of a fetchAllUserData
+    // with options; false if the options are invalid
+    static bool userDataSql(const BankProtocol::FetchAllUserDataRequest &request, QStringList &columns,
+                            QStringList &conditions, QVariantList &values, const char *&sortExpression,
+                            QString &errorMessage);
+    // Query for a fetchAllUserData with options, its filters bound; false if the options are invalid
+    bool prepareUserDataQuery(const BankProtocol::FetchAllUserDataRequest &request,
+                              QSqlQuery &query, QString &errorMessage);
+    static QJsonObject userDataRow(const QSqlQuery &query);
+    // Only the columns the query selected, a stream's _key columns left out
+    static QJsonObject projectedUserDataRow(const QSqlQuery &query);
+    static QJsonObject transactionRow(const QSqlQuery &query);
+    QJsonObject updateUserData(const BankProtocol::UpdateUserDataRequest &request);
 };
 
 #endif // DATABASEMANAGER_H
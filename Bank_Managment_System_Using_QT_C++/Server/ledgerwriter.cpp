@@ -0,0 +1,219 @@
+#include "ledgerwriter.h"
+#include "databasemanager.h"
+#include "serverconfig.h"
+#include "notificationhub.h"
+#include "coarseclock.h"
+#include "servermetrics.h"
+#include "requesttracer.h"
+
+#include <QDeadlineTimer>
+#include <chrono>
+
+LedgerReply::LedgerReply(quint64 requestSequence, quint64 traceId, QObject *parent)
+    : QObject(parent), requestSequence(requestSequence), traceId(traceId)
+{}
+
+quint64 LedgerReply::sequence() const
+{
+    return requestSequence;
+}
+
+quint64 LedgerReply::trace() const
+{
+    return traceId;
+}
+
+LedgerWriter &LedgerWriter::instance()
+{
+    static LedgerWriter writer;
+    return writer;
+}
+
+LedgerWriter::LedgerWriter()
+    : version(CoarseClock::nowMicros()), logger("LedgerWriter")
+{
+    setObjectName("LedgerWriter");
+}
+
+void LedgerWriter::submit(const QJsonObject &requestJson, LedgerReply *reply)
+{
+    QMutexLocker locker(&mutex);
+
+    if (stopping)
+    {
+        locker.unlock();
+        int requestId = BankProtocol::requestIdOf(requestJson);
+        deliver({requestJson, reply, 0}, DatabaseManager::failureResponse(requestId, "Server is shutting down"));
+        return;
+    }
+
+    pendingJobs.append({requestJson, reply, reply->trace() != 0 ? ServerMetrics::nowNs() : 0});
+    jobsAvailable.wakeOne();
+}
+
+void LedgerWriter::stop()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        jobsAvailable.wakeAll();
+    }
+    wait();
+    logger.log("Writer thread stopped.");
+}
+
+void LedgerWriter::run()
+{
+    const ServerConfig &config = ServerConfig::instance();
+
+    // Opens the pooled connection of this thread, the only one that writes
+    DatabaseManager databaseManager("LedgerWriter");
+    if (!databaseManager.openConnection())
+    {
+        logger.log("Failed to open the writer connection, writes will fail.");
+    }
+    logger.log(QString("Writer thread started, batch window %1 us, max batch %2.")
+                   .arg(config.batchWindowUs).arg(config.maxBatchSize));
+
+    QVector<Job> batch;
+
+    forever
+    {
+        {
+            QMutexLocker locker(&mutex);
+            while (pendingJobs.isEmpty() && !stopping)
+            {
+                jobsAvailable.wait(&mutex);
+            }
+            if (pendingJobs.isEmpty() && stopping)
+            {
+                break;
+            }
+
+            // Give concurrent writers a moment to join this batch
+            QDeadlineTimer window(std::chrono::microseconds(config.batchWindowUs), Qt::PreciseTimer);
+            while (pendingJobs.size() < config.maxBatchSize && !stopping)
+            {
+                if (!jobsAvailable.wait(&mutex, window))
+                {
+                    break;
+                }
+            }
+
+            int batchSize = qMin(static_cast<int>(pendingJobs.size()), config.maxBatchSize);
+            batch = pendingJobs.mid(0, batchSize);
+            pendingJobs.remove(0, batchSize);
+        }
+
+        QVector<QJsonObject> responses;
+        QVector<qint64> databaseNs;
+        responses.reserve(batch.size());
+        databaseNs.reserve(batch.size());
+
+        if (!databaseManager.beginBatch())
+        {
+            for (const Job &job : batch)
+            {
+                int requestId = BankProtocol::requestIdOf(job.requestJson);
+                deliver(job, DatabaseManager::failureResponse(requestId, "Failed to start transaction"));
+            }
+            batch.clear();
+            continue;
+        }
+
+        // Each request runs inside its own savepoint, a failure only undoes itself
+        for (const Job &job : batch)
+        {
+            const qint64 startNs = ServerMetrics::nowNs();
+            RequestTracer::recordSpan(job.reply->trace(), "ledger queue", job.submittedNs, startNs);
+            RequestTracer::Scope traceScope(job.reply->trace());
+            responses.append(databaseManager.processRequest(job.requestJson));
+            databaseNs.append(ServerMetrics::nowNs() - startNs);
+        }
+
+        const qint64 commitStartNs = ServerMetrics::nowNs();
+        if (!databaseManager.commitBatch())
+        {
+            logger.log(QString("Failed to commit a batch of %1 writes.").arg(batch.size()));
+            databaseManager.rollbackBatch();
+            databaseManager.takeAccountEvents();
+            for (const Job &job : batch)
+            {
+                int requestId = BankProtocol::requestIdOf(job.requestJson);
+                deliver(job, DatabaseManager::failureResponse(requestId, "Failed to commit"));
+            }
+            batch.clear();
+            continue;
+        }
+
+        // Published before the replies, a writer reading its own change never sees a stale cache
+        version.fetchAndAddRelease(1);
+        recordBatch(batch.size());
+
+        // Every request of the batch waited for the one commit
+        const qint64 commitEndNs = ServerMetrics::nowNs();
+        const qint64 commitNs = commitEndNs - commitStartNs;
+        for (int i = 0; i < batch.size(); ++i)
+        {
+            ServerMetrics::record(BankProtocol::requestIdOf(batch[i].requestJson), ServerMetrics::Database,
+                                  databaseNs[i] + commitNs);
+            RequestTracer::recordSpan(batch[i].reply->trace(), "batch commit", commitStartNs, commitEndNs);
+        }
+        // Subscribers hear about a change only once it is durable
+        NotificationHub::instance().publish(databaseManager.takeAccountEvents());
+        for (int i = 0; i < batch.size(); ++i)
+        {
+            deliver(batch[i], responses[i]);
+        }
+        batch.clear();
+    }
+
+    databaseManager.closeConnection();
+    DatabaseConnectionPool::instance().releaseThreadConnection();
+}
+
+void LedgerWriter::deliver(const Job &job, const QJsonObject &responseJson)
+{
+    // Queued to the submitting thread, dropped if its handler is gone already
+    emit job.reply->finished(job.reply->sequence(), responseJson);
+    job.reply->deleteLater();
+}
+
+void LedgerWriter::recordBatch(int batchSize)
+{
+    commits.fetchAndAddRelaxed(1);
+    committedRequests.fetchAndAddRelaxed(batchSize);
+
+    int bucket = 0;
+    while (bucket < BatchSizeBuckets - 1 && (2 << bucket) <= batchSize)
+    {
+        bucket++;
+    }
+    batchSizes[bucket].fetchAndAddRelaxed(1);
+}
+
+quint64 LedgerWriter::dataVersion() const
+{
+    return version.loadAcquire();
+}
+
+quint64 LedgerWriter::commitCount() const
+{
+    return commits.loadRelaxed();
+}
+
+quint64 LedgerWriter::committedRequestCount() const
+{
+    return committedRequests.loadRelaxed();
+}
+
+QVector<quint64> LedgerWriter::batchSizeHistogram() const
+{
+    QVector<quint64> histogram;
+    histogram.reserve(BatchSizeBuckets);
+    for (int bucket = 0; bucket < BatchSizeBuckets; ++bucket)
+    {
+        histogram.append(batchSizes[bucket].loadRelaxed());
+    }
+    return histogram;
+}
@@ -0,0 +1,86 @@
+#ifndef LEDGERWRITER_H
+#define LEDGERWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QJsonObject>
+#include <QAtomicInteger>
+
+#include "logger.h"
+
+// Carries one write result back to the thread that submitted the request.
+// Connections to it are dropped automatically if the receiver goes away first.
+class LedgerReply : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LedgerReply(quint64 requestSequence, quint64 traceId = 0, QObject *parent = nullptr);
+    quint64 sequence() const;
+    quint64 trace() const;
+
+signals:
+    void finished(quint64 requestSequence, QJsonObject responseJson);
+
+private:
+    quint64 requestSequence;
+    quint64 traceId;
+};
+
+// The only thread that writes to the database. Mutating requests queue up
+// here and whatever arrives within a short window is committed as one SQLite
+// transaction; every request still gets its own result through a savepoint.
+class LedgerWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    static const int BatchSizeBuckets = 10;
+
+    static LedgerWriter &instance();
+
+    // Queue a write; the reply emits finished() once its batch committed
+    void submit(const QJsonObject &requestJson, LedgerReply *reply);
+    void stop();
+
+    // Moves on with every commit; starts from the clock so it keeps growing across restarts
+    quint64 dataVersion() const;
+
+    // Metrics
+    quint64 commitCount() const;
+    quint64 committedRequestCount() const;
+    // Batches per size bucket: 1, 2-3, 4-7, ... , 512 and up
+    QVector<quint64> batchSizeHistogram() const;
+
+protected:
+    void run() override;
+
+private:
+    struct Job
+    {
+        QJsonObject requestJson;
+        LedgerReply *reply;
+        // Only taken for traced requests
+        qint64 submittedNs;
+    };
+
+    LedgerWriter();
+
+    QMutex mutex;
+    QWaitCondition jobsAvailable;
+    QVector<Job> pendingJobs;
+    bool stopping = false;
+
+    QAtomicInteger<quint64> version;
+    QAtomicInteger<quint64> commits;
+    QAtomicInteger<quint64> committedRequests;
+    QAtomicInteger<quint64> batchSizes[BatchSizeBuckets];
+    Logger logger;
+
+    void recordBatch(int batchSize);
+    static void deliver(const Job &job, const QJsonObject &responseJson);
+};
+
+#endif // LEDGERWRITER_H
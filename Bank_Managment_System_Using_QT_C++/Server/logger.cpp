@@ -1,7 +1,16 @@
 #include "Logger.h"
+#include "logwriter.h"
 
 Logger::Logger(const QString &tag, QObject *parent)
     : QObject(parent), logTag(tag)
+{
+    // Looked up once, every default Logger shares this writer
+    static LogWriter &commonWriter = LogWriter::forFile("common_log.txt");
+    writer = &commonWriter;
+}
+
+Logger::Logger(const QString &tag, const QString &filePath, QObject *parent)
+    : QObject(parent), logTag(tag), writer(&LogWriter::forFile(filePath))
 {}
 
 Logger::~Logger()
@@ -9,24 +18,5 @@ Logger::~Logger()
 
 void Logger::log(const QString &message)
 {
-    QMutexLocker locker(&mutex);
-
-    QString logFilePath = "common_log.txt";
-
-    logFile.setFileName(logFilePath);
-
-    if (logFile.open(QIODevice::WriteOnly | QIODevice::Append))
-    {
-        textStream.setDevice(&logFile);
-    }
-    else
-    {
-        qDebug() << "Failed to open log file:" << logFilePath;
-    }
-    QString formattedMessage = QString("%1: %2").arg(logTag, message);
-    textStream << formattedMessage << '\n';
-    textStream.flush();
-    logFile.close();
-
-    qDebug() << formattedMessage;
+    writer->append(QString("%1: %2").arg(logTag, message));
 }
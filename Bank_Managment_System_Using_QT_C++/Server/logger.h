@@ -2,10 +2,9 @@
 #define LOGGER_H
 
 #include <QObject>
-#include <QFile>
-#include <QTextStream>
-#include <QMutex>
-#include <QDebug>
+#include <QString>
+
+class LogWriter;
 
 class Logger : public QObject
 {
@@ -13,15 +12,16 @@ class Logger : public QObject
 
 public:
     Logger(const QString &tag, QObject *parent = nullptr);
+    // Logger writing to its own file instead of common_log.txt
+    Logger(const QString &tag, const QString &filePath, QObject *parent = nullptr);
     ~Logger();
 
+    // Queues the line for the file's LogWriter and returns right away
     void log(const QString &message);
 
 private:
-    QFile logFile;
-    QTextStream textStream;
     QString logTag;
-    QMutex mutex;
+    LogWriter *writer;
 };
 
 #endif // LOGGER_H
@@ -0,0 +1,279 @@
+#include "logwriter.h"
+#include "serverconfig.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QTextStream>
+#include <QMap>
+#include <QDebug>
+
+// Lines written per flush of the file
+static const int MaxBatchLines = 512;
+
+// Writers live until the process ends, Loggers in static objects may still log late
+static QMutex writersMutex;
+static QMap<QString, LogWriter *> writers;
+
+LogWriter &LogWriter::forFile(const QString &filePath)
+{
+    QMutexLocker locker(&writersMutex);
+
+    LogWriter *writer = writers.value(filePath, nullptr);
+    if (writer == nullptr)
+    {
+        if (writers.isEmpty())
+        {
+            // Flush whatever is queued when the application goes down
+            qAddPostRoutine(LogWriter::stopAll);
+        }
+        writer = new LogWriter(filePath);
+        writers.insert(filePath, writer);
+        writer->start();
+    }
+    return *writer;
+}
+
+void LogWriter::stopAll()
+{
+    QMutexLocker locker(&writersMutex);
+    for (LogWriter *writer : std::as_const(writers))
+    {
+        writer->stop();
+    }
+}
+
+LogWriter::LogWriter(const QString &filePath)
+    : filePath(filePath)
+{
+    const ServerConfig &config = ServerConfig::instance();
+    fullPolicy = config.logFullPolicy;
+    consoleEcho = config.logConsole;
+
+    // Round the capacity up to a power of two so a position maps to a slot with a mask
+    quint64 capacity = 2;
+    while (capacity < static_cast<quint64>(config.logBufferSize))
+    {
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    ring.reset(new Slot[capacity]);
+    for (quint64 i = 0; i < capacity; ++i)
+    {
+        ring[i].sequence.storeRelaxed(i);
+    }
+
+    setObjectName("LogWriter");
+}
+
+void LogWriter::append(const QString &line)
+{
+    // Announced before looking at stopped, so stop() can wait for this push to land
+    activeProducers.fetchAndAddOrdered(1);
+    if (stopped.loadAcquire())
+    {
+        activeProducers.fetchAndSubRelease(1);
+        writeDirect(line);
+        return;
+    }
+
+    while (!tryPush(line))
+    {
+        if (fullPolicy == FullPolicy::Drop)
+        {
+            dropped.fetchAndAddRelaxed(1);
+            activeProducers.fetchAndSubRelease(1);
+            return;
+        }
+        if (stopped.loadAcquire())
+        {
+            // Nobody is left to free a slot
+            activeProducers.fetchAndSubRelease(1);
+            writeDirect(line);
+            return;
+        }
+        // Block: let the writer catch up
+        wakeConsumer();
+        QThread::yieldCurrentThread();
+    }
+    activeProducers.fetchAndSubRelease(1);
+
+    if (sleeping.loadAcquire())
+    {
+        wakeConsumer();
+    }
+}
+
+quint64 LogWriter::droppedCount() const
+{
+    return dropped.loadRelaxed();
+}
+
+// Bounded queue after Dmitry Vyukov: every slot carries a sequence number telling
+// whether it is free for the position a producer claimed or holds a finished line.
+bool LogWriter::tryPush(const QString &line)
+{
+    quint64 position = enqueuePos.loadRelaxed();
+    forever
+    {
+        Slot &slot = ring[position & mask];
+        qint64 difference = static_cast<qint64>(slot.sequence.loadAcquire() - position);
+        if (difference == 0)
+        {
+            // Claim the position, on a lost race position holds the current one
+            if (enqueuePos.testAndSetRelaxed(position, position + 1, position))
+            {
+                slot.line = line;
+                slot.sequence.storeRelease(position + 1);
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The consumer hasn't freed this slot yet, the ring is full
+            return false;
+        }
+        else
+        {
+            position = enqueuePos.loadRelaxed();
+        }
+    }
+}
+
+bool LogWriter::tryPop(QString &line)
+{
+    // Single consumer, no need to claim the position
+    quint64 position = dequeuePos.loadRelaxed();
+    Slot &slot = ring[position & mask];
+    if (slot.sequence.loadAcquire() != position + 1)
+    {
+        return false;
+    }
+    line = std::move(slot.line);
+    slot.line = QString();
+    dequeuePos.storeRelaxed(position + 1);
+    slot.sequence.storeRelease(position + mask + 1);
+    return true;
+}
+
+void LogWriter::wakeConsumer()
+{
+    QMutexLocker locker(&wakeMutex);
+    wakeup.wakeOne();
+}
+
+void LogWriter::run()
+{
+    QFile logFile(filePath);
+    QTextStream fileStream;
+    if (logFile.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        fileStream.setDevice(&logFile);
+    }
+    else
+    {
+        qDebug() << "Failed to open log file:" << filePath;
+    }
+    QTextStream console(stderr);
+
+    quint64 reportedDrops = 0;
+    QString line;
+
+    forever
+    {
+        int written = 0;
+        while (written < MaxBatchLines && tryPop(line))
+        {
+            if (logFile.isOpen())
+            {
+                fileStream << line << '\n';
+            }
+            if (consoleEcho)
+            {
+                console << line << '\n';
+            }
+            written++;
+        }
+
+        quint64 drops = dropped.loadRelaxed();
+        if (drops != reportedDrops)
+        {
+            QString notice = QString("LogWriter: %1 log lines dropped, buffer full").arg(drops - reportedDrops);
+            if (logFile.isOpen())
+            {
+                fileStream << notice << '\n';
+            }
+            if (consoleEcho)
+            {
+                console << notice << '\n';
+            }
+            reportedDrops = drops;
+            written++;
+        }
+
+        if (written > 0)
+        {
+            fileStream.flush();
+            console.flush();
+            continue;
+        }
+
+        if (stopping.loadAcquire())
+        {
+            break;
+        }
+
+        QMutexLocker locker(&wakeMutex);
+        sleeping.storeRelease(1);
+        // A line pushed before the flag was visible would otherwise wait for the timeout
+        if (ring[dequeuePos.loadRelaxed() & mask].sequence.loadAcquire() != dequeuePos.loadRelaxed() + 1
+            && !stopping.loadAcquire())
+        {
+            wakeup.wait(&wakeMutex, 100);
+        }
+        sleeping.storeRelease(0);
+    }
+
+    fileStream.flush();
+    logFile.close();
+}
+
+void LogWriter::stop()
+{
+    if (stopped.loadAcquire())
+    {
+        return;
+    }
+    stopping.storeRelease(1);
+    wakeConsumer();
+    wait();
+    stopped.fetchAndStoreOrdered(1);
+
+    // A producer that saw stopped unset may still be pushing, the drain waits for it
+    while (activeProducers.loadAcquire() != 0)
+    {
+        QThread::yieldCurrentThread();
+    }
+
+    // Lines pushed while the thread was finishing
+    QString line;
+    while (tryPop(line))
+    {
+        writeDirect(line);
+    }
+}
+
+void LogWriter::writeDirect(const QString &line)
+{
+    QMutexLocker locker(&directMutex);
+
+    QFile logFile(filePath);
+    if (logFile.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        QTextStream textStream(&logFile);
+        textStream << line << '\n';
+    }
+    if (consoleEcho)
+    {
+        QTextStream(stderr) << line << '\n';
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include <QString>
+#include <memory>
+
+// Background writer behind every Logger of one log file.
+// log() only pushes the line into a bounded lock-free ring (multi-producer,
+// single consumer); this thread keeps the file open and writes in batches.
+class LogWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    // What log() does when the ring is full
+    enum class FullPolicy
+    {
+        Block,
+        Drop
+    };
+
+    // Writer of the given file, created and started on first use
+    static LogWriter &forFile(const QString &filePath);
+
+    // Flush and stop every writer, later lines are written synchronously
+    static void stopAll();
+
+    void append(const QString &line);
+
+    // Metrics
+    quint64 droppedCount() const;
+
+protected:
+    void run() override;
+
+private:
+    struct Slot
+    {
+        QAtomicInteger<quint64> sequence;
+        QString line;
+    };
+
+    explicit LogWriter(const QString &filePath);
+
+    bool tryPush(const QString &line);
+    bool tryPop(QString &line);
+    void wakeConsumer();
+    void stop();
+    void writeDirect(const QString &line);
+
+    QString filePath;
+    FullPolicy fullPolicy;
+    bool consoleEcho;
+
+    std::unique_ptr<Slot[]> ring;
+    quint64 mask;
+    // Producers and the consumer each own a cache line
+    alignas(64) QAtomicInteger<quint64> enqueuePos;
+    alignas(64) QAtomicInteger<quint64> dequeuePos;
+
+    QAtomicInteger<quint64> dropped;
+    QAtomicInt sleeping;
+    QAtomicInt stopping;
+    QAtomicInt stopped;
+    // Producers between checking stopped and finishing their push
+    QAtomicInt activeProducers;
+    QMutex wakeMutex;
+    QWaitCondition wakeup;
+    QMutex directMutex;
+};
+
+#endif // LOGWRITER_H
@@ -1,6 +1,11 @@
 #include <QCoreApplication>
 #include <signal.h>
 #include "databasemanager.h"
+#include "databaseconnectionpool.h"
+#include "ledgerwriter.h"
+#include "notificationhub.h"
+#include "metricsserver.h"
+#include "serverconfig.h"
 #include "Server.h"
 #include "Logger.h"
 
@@ -12,9 +17,21 @@ int main(int argc, char *argv[])
 
     signal(SIGINT, handleSignal);
 
-    // Initialize the database
+    // Initialize the database and bring its schema up to date
     DatabaseManager databaseManager("InitializeDatabase",&a);
-    databaseManager.initializeDatabase();
+    if (!databaseManager.initializeDatabase())
+    {
+        return 1;
+    }
+
+    // The main thread serves no clients, give its pooled connection back
+    DatabaseConnectionPool::instance().releaseThreadConnection();
+
+    // Committed account changes are pushed to subscribers from this thread
+    NotificationHub::instance().start();
+
+    // Every mutating request is committed by this thread
+    LedgerWriter::instance().start();
 
     // Create the Server object
     Server server(&a);
@@ -24,13 +41,26 @@ int main(int argc, char *argv[])
     if (!server.isListening())
     {
         mainLogger.log("Failed to start the server.");
+        LedgerWriter::instance().stop();
+        NotificationHub::instance().stop();
         return 1;
     }
 
+    // Scrape endpoint for the request metrics, owned by the application
+    if (ServerConfig::instance().metricsPort != 0)
+    {
+        new MetricsServer(ServerConfig::instance().metricsPort, &a);
+    }
+
     mainLogger.log("Event loop Started.");
 
     a.processEvents();
-    return a.exec();
+    int exitCode = a.exec();
+
+    // Commit whatever is still queued before the sessions go away
+    LedgerWriter::instance().stop();
+    NotificationHub::instance().stop();
+    return exitCode;
 }
 
 void handleSignal(int signal)
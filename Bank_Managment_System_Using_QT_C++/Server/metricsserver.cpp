@@ -0,0 +1,70 @@
+#include "metricsserver.h"
+#include "servermetrics.h"
+#include "requesttracer.h"
+#include "querytimer.h"
+
+#include <QTcpSocket>
+#include <QJsonDocument>
+
+MetricsServer::MetricsServer(quint16 port, QObject *parent)
+    : QTcpServer(parent), logger("MetricsServer")
+{
+    // Local scrapers only, the numbers aren't meant for clients
+    if (!listen(QHostAddress::LocalHost, port))
+    {
+        logger.log("Failed to start the metrics endpoint: " + errorString());
+    }
+    else
+    {
+        logger.log(QString("Metrics endpoint listening on port %1").arg(port));
+    }
+}
+
+void MetricsServer::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor))
+    {
+        delete socket;
+        return;
+    }
+    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+
+    // Answer once the request headers are in; GET /trace dumps the traced spans, anything else gets the metrics
+    connect(socket, &QTcpSocket::readyRead, socket, [socket]
+    {
+        QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+        if (!request.contains("\r\n\r\n"))
+        {
+            if (request.size() > 8192)
+            {
+                socket->abort();
+            }
+            else
+            {
+                socket->setProperty("request", request);
+            }
+            return;
+        }
+        QObject::disconnect(socket, &QTcpSocket::readyRead, nullptr, nullptr);
+
+        QByteArray body;
+        QByteArray contentType;
+        if (request.startsWith("GET /trace "))
+        {
+            body = QJsonDocument(RequestTracer::dump()).toJson(QJsonDocument::Compact);
+            contentType = "application/json";
+        }
+        else
+        {
+            body = (ServerMetrics::snapshot().toText() + QueryTimer::toText()).toUtf8();
+            contentType = "text/plain; version=0.0.4";
+        }
+        socket->write("HTTP/1.0 200 OK\r\n"
+                      "Content-Type: " + contentType + "\r\n"
+                      "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                      "Connection: close\r\n\r\n");
+        socket->write(body);
+        socket->disconnectFromHost();
+    });
+}
@@ -0,0 +1,25 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QTcpServer>
+
+#include "logger.h"
+
+// Plain HTTP endpoint on its own local port for metric scrapers.
+// Every request, whatever its path, gets the current ServerMetrics snapshot
+// as text and the connection is closed.
+class MetricsServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(quint16 port, QObject *parent = nullptr);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    Logger logger;
+};
+
+#endif // METRICSSERVER_H
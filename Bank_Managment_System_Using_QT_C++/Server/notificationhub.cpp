@@ -0,0 +1,99 @@
+#include "notificationhub.h"
+
+NotificationHub &NotificationHub::instance()
+{
+    static NotificationHub hub;
+    return hub;
+}
+
+NotificationHub::NotificationHub()
+    : logger("NotificationHub")
+{
+    hubThread.setObjectName("NotificationHub");
+    moveToThread(&hubThread);
+}
+
+void NotificationHub::start()
+{
+    hubThread.start();
+    logger.log("Notification thread started.");
+}
+
+void NotificationHub::stop()
+{
+    hubThread.quit();
+    hubThread.wait();
+    logger.log("Notification thread stopped.");
+}
+
+void NotificationHub::subscribe(AccountSubscription *subscription, const QList<qint64> &accountNumbers)
+{
+    // Only its creator may move it, that is the caller the first time
+    if (subscription->thread() != &hubThread)
+    {
+        subscription->moveToThread(&hubThread);
+    }
+    QMetaObject::invokeMethod(this, [this, subscription, accountNumbers]
+                              { setAccounts(subscription, accountNumbers); }, Qt::QueuedConnection);
+}
+
+void NotificationHub::unsubscribe(AccountSubscription *subscription)
+{
+    QMetaObject::invokeMethod(this, [this, subscription]
+                              { removeSubscription(subscription); }, Qt::QueuedConnection);
+}
+
+void NotificationHub::publish(const QVector<AccountEvent> &events)
+{
+    if (events.isEmpty())
+    {
+        return;
+    }
+    QMetaObject::invokeMethod(this, [this, events] { deliver(events); }, Qt::QueuedConnection);
+}
+
+void NotificationHub::setAccounts(AccountSubscription *subscription, const QList<qint64> &accountNumbers)
+{
+    for (qint64 accountNumber : accountsBySubscription.value(subscription))
+    {
+        auto subscribers = subscribersByAccount.find(accountNumber);
+        if (subscribers != subscribersByAccount.end())
+        {
+            subscribers->remove(subscription);
+            if (subscribers->isEmpty())
+            {
+                subscribersByAccount.erase(subscribers);
+            }
+        }
+    }
+
+    accountsBySubscription.insert(subscription, accountNumbers);
+    for (qint64 accountNumber : accountNumbers)
+    {
+        subscribersByAccount[accountNumber].insert(subscription);
+    }
+}
+
+void NotificationHub::removeSubscription(AccountSubscription *subscription)
+{
+    setAccounts(subscription, {});
+    accountsBySubscription.remove(subscription);
+    delete subscription;
+}
+
+void NotificationHub::deliver(const QVector<AccountEvent> &events)
+{
+    for (const AccountEvent &accountEvent : events)
+    {
+        const auto subscribers = subscribersByAccount.constFind(accountEvent.accountNumber);
+        if (subscribers == subscribersByAccount.constEnd())
+        {
+            continue;
+        }
+        // Queued to each subscriber's own thread
+        for (AccountSubscription *subscription : *subscribers)
+        {
+            emit subscription->eventReady(accountEvent.event);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef NOTIFICATIONHUB_H
+#define NOTIFICATIONHUB_H
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QVector>
+#include <QJsonObject>
+
+#include "logger.h"
+
+// Change to one account, published once the write behind it committed
+struct AccountEvent
+{
+    qint64 accountNumber;
+    QJsonObject event;
+};
+
+// One connection's interest in account events. It is created by the
+// connection, then owned by the hub and only ever touched in the hub thread;
+// its eventReady connection drops by itself when the receiver goes away.
+class AccountSubscription : public QObject
+{
+    Q_OBJECT
+
+signals:
+    void eventReady(QJsonObject event);
+};
+
+// Fans committed account changes out to the connections subscribed to them.
+// Everything runs in the hub's own thread, so the ledger writer only posts
+// the events of a commit and never waits on subscribers or their sockets.
+class NotificationHub : public QObject
+{
+    Q_OBJECT
+
+public:
+    static NotificationHub &instance();
+
+    void start();
+    void stop();
+
+    // Called from the subscription's thread; replaces the accounts it watches
+    void subscribe(AccountSubscription *subscription, const QList<qint64> &accountNumbers);
+    void unsubscribe(AccountSubscription *subscription);
+
+    // Called by the ledger writer after a commit, returns right away
+    void publish(const QVector<AccountEvent> &events);
+
+private:
+    NotificationHub();
+
+    void setAccounts(AccountSubscription *subscription, const QList<qint64> &accountNumbers);
+    void removeSubscription(AccountSubscription *subscription);
+    void deliver(const QVector<AccountEvent> &events);
+
+    QThread hubThread;
+    // Hub thread only
+    QHash<qint64, QSet<AccountSubscription *>> subscribersByAccount;
+    QHash<AccountSubscription *, QList<qint64>> accountsBySubscription;
+    Logger logger;
+};
+
+#endif // NOTIFICATIONHUB_H
@@ -0,0 +1,262 @@
+#include "querytimer.h"
+#include "servermetrics.h"
+#include "serverconfig.h"
+#include "logger.h"
+
+#include <QSqlError>
+#include <QJsonObject>
+#include <QStringList>
+#include <algorithm>
+
+QAtomicPointer<QueryTimer::Shard> QueryTimer::shards;
+
+// Slow statements go to their own file, not common_log.txt
+static Logger &slowQueryLog()
+{
+    static Logger logger("SlowQuery", ServerConfig::instance().slowQueryLogFile);
+    return logger;
+}
+
+bool QueryTimer::exec(QSqlQuery &query, const QSqlDatabase &database)
+{
+    Scope scope(query, database);
+    return scope.exec();
+}
+
+bool QueryTimer::exec(QSqlQuery &query, const QSqlDatabase &database, const QString &sql)
+{
+    Scope scope(query, database);
+    return scope.exec(sql);
+}
+
+QueryTimer::Scope::Scope(QSqlQuery &query, const QSqlDatabase &database)
+    : query(query), database(database)
+{}
+
+QueryTimer::Scope::~Scope()
+{
+    if (executed)
+    {
+        record(query, database, sql.isNull() ? query.lastQuery() : sql,
+               static_cast<quint64>(elapsedNs) / 1000, succeeded);
+    }
+}
+
+bool QueryTimer::Scope::exec()
+{
+    const qint64 startNs = ServerMetrics::nowNs();
+    succeeded = query.exec();
+    elapsedNs += ServerMetrics::nowNs() - startNs;
+    executed = true;
+    return succeeded;
+}
+
+bool QueryTimer::Scope::exec(const QString &sql)
+{
+    this->sql = sql;
+    const qint64 startNs = ServerMetrics::nowNs();
+    succeeded = query.exec(sql);
+    elapsedNs += ServerMetrics::nowNs() - startNs;
+    executed = true;
+    return succeeded;
+}
+
+bool QueryTimer::Scope::next()
+{
+    // Each row past the first is another step of the statement
+    const qint64 startNs = ServerMetrics::nowNs();
+    const bool hasRow = query.next();
+    elapsedNs += ServerMetrics::nowNs() - startNs;
+    return hasRow;
+}
+
+QueryTimer::Shard &QueryTimer::localShard()
+{
+    static thread_local Shard *shard = nullptr;
+    if (shard == nullptr)
+    {
+        // Kept for the life of the process like the ServerMetrics shards
+        shard = new Shard();
+        Shard *head = shards.loadAcquire();
+        do
+        {
+            shard->next = head;
+        } while (!shards.testAndSetOrdered(head, shard, head));
+    }
+    return *shard;
+}
+
+void QueryTimer::record(const QSqlQuery &query, const QSqlDatabase &database, const QString &statement,
+                        quint64 elapsedUs, bool succeeded)
+{
+    const int thresholdMs = ServerConfig::instance().slowQueryMs;
+    const bool slow = thresholdMs > 0 && elapsedUs >= static_cast<quint64>(thresholdMs) * 1000;
+
+    Shard &shard = localShard();
+    bool explain = false;
+    QString plan;
+    QString key;
+    {
+        QMutexLocker locker(&shard.mutex);
+        const bool known = shard.entries.size() < MaxStatements || shard.entries.contains(statement);
+        key = known ? statement : QStringLiteral("(other)");
+        Entry &entry = shard.entries[key];
+        ++entry.count;
+        entry.totalUs += elapsedUs;
+        entry.maxUs = qMax(entry.maxUs, elapsedUs);
+        if (!slow)
+        {
+            return;
+        }
+        ++entry.slowCount;
+        explain = !entry.explained;
+        entry.explained = true;
+        plan = entry.plan;
+    }
+
+    // The plan only depends on the statement, so it is taken once; outside the
+    // lock since it runs SQL of its own
+    if (explain)
+    {
+        plan = queryPlan(database, statement, query.boundValues());
+        QMutexLocker locker(&shard.mutex);
+        auto entry = shard.entries.find(key);
+        if (entry != shard.entries.end())
+        {
+            entry->plan = plan;
+        }
+    }
+
+    slowQueryLog().log(QString("%1 ms%2: %3 | values: %4 | plan: %5")
+                           .arg(elapsedUs / 1000.0, 0, 'f', 1)
+                           .arg(succeeded ? "" : " (failed)")
+                           .arg(statement.simplified(), redactedValues(query.boundValues()),
+                                plan.isEmpty() ? QString("-") : plan));
+}
+
+QString QueryTimer::redactedValues(const QVariantList &values)
+{
+    // Only the type and size, the values are account numbers, passwords and amounts
+    QStringList redacted;
+    for (int i = 0; i < values.size(); ++i)
+    {
+        const QVariant &value = values.at(i);
+        QString description;
+        if (value.isNull())
+        {
+            description = "null";
+        }
+        else if (value.typeId() == QMetaType::QString)
+        {
+            description = QString("text(%1)").arg(value.toString().size());
+        }
+        else if (value.typeId() == QMetaType::QByteArray)
+        {
+            description = QString("blob(%1)").arg(value.toByteArray().size());
+        }
+        else if (value.typeId() == QMetaType::Double)
+        {
+            description = "real";
+        }
+        else
+        {
+            description = value.typeName();
+        }
+        redacted.append(QString("?%1=%2").arg(i + 1).arg(description));
+    }
+    return redacted.isEmpty() ? QString("-") : redacted.join(", ");
+}
+
+QString QueryTimer::queryPlan(const QSqlDatabase &database, const QString &sql, const QVariantList &values)
+{
+    // Schema changes and transaction control have no plan worth logging
+    static const QStringList plannedStatements = {"SELECT", "INSERT", "UPDATE", "DELETE", "REPLACE", "WITH"};
+    const QString firstWord = sql.trimmed().section(' ', 0, 0).toUpper();
+    if (!plannedStatements.contains(firstWord))
+    {
+        return QString();
+    }
+
+    QSqlQuery planQuery(database);
+    if (!planQuery.prepare("EXPLAIN QUERY PLAN " + sql))
+    {
+        return "unavailable: " + planQuery.lastError().text();
+    }
+    for (int i = 0; i < values.size(); ++i)
+    {
+        planQuery.bindValue(i, values.at(i));
+    }
+    if (!planQuery.exec())
+    {
+        return "unavailable: " + planQuery.lastError().text();
+    }
+
+    // Columns are id, parent, notused and detail
+    QStringList steps;
+    while (planQuery.next())
+    {
+        steps.append(planQuery.value(3).toString());
+    }
+    return steps.join("; ");
+}
+
+QVector<QueryTimer::StatementStats> QueryTimer::statementStats()
+{
+    QHash<QString, StatementStats> merged;
+    for (Shard *shard = shards.loadAcquire(); shard != nullptr; shard = shard->next)
+    {
+        QMutexLocker locker(&shard->mutex);
+        for (auto entry = shard->entries.cbegin(); entry != shard->entries.cend(); ++entry)
+        {
+            StatementStats &stats = merged[entry.key()];
+            stats.count += entry->count;
+            stats.slowCount += entry->slowCount;
+            stats.totalUs += entry->totalUs;
+            stats.maxUs = qMax(stats.maxUs, entry->maxUs);
+        }
+    }
+
+    QVector<StatementStats> statements;
+    statements.reserve(merged.size());
+    for (auto stats = merged.begin(); stats != merged.end(); ++stats)
+    {
+        stats->sql = stats.key().simplified();
+        statements.append(*stats);
+    }
+    std::sort(statements.begin(), statements.end(),
+              [](const StatementStats &a, const StatementStats &b) { return a.totalUs > b.totalUs; });
+    return statements;
+}
+
+QJsonArray QueryTimer::toJson()
+{
+    QJsonArray statements;
+    for (const StatementStats &stats : statementStats())
+    {
+        QJsonObject statement;
+        statement["sql"] = stats.sql;
+        statement["count"] = static_cast<qint64>(stats.count);
+        statement["slowCount"] = static_cast<qint64>(stats.slowCount);
+        statement["totalUs"] = static_cast<qint64>(stats.totalUs);
+        statement["maxUs"] = static_cast<qint64>(stats.maxUs);
+        statements.append(statement);
+    }
+    return statements;
+}
+
+QString QueryTimer::toText()
+{
+    QStringList lines;
+    lines.append("# TYPE bank_sql_statement_duration_us summary");
+    for (const StatementStats &stats : statementStats())
+    {
+        QString sql = stats.sql;
+        sql.replace('\\', "\\\\").replace('"', "\\\"");
+        const QString label = QString("statement=\"%1\"").arg(sql);
+        lines.append(QString("bank_sql_statement_duration_us_sum{%1} %2").arg(label).arg(stats.totalUs));
+        lines.append(QString("bank_sql_statement_duration_us_count{%1} %2").arg(label).arg(stats.count));
+        lines.append(QString("bank_sql_statement_max_us{%1} %2").arg(label).arg(stats.maxUs));
+        lines.append(QString("bank_sql_statement_slow_total{%1} %2").arg(label).arg(stats.slowCount));
+    }
+    return lines.join('\n') + '\n';
+}
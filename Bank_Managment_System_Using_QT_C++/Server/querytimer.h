@@ -0,0 +1,93 @@
+#ifndef QUERYTIMER_H
+#define QUERYTIMER_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QAtomicPointer>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+#include <QJsonArray>
+#include <QString>
+
+// Runs the DatabaseManager's SQL statements and times each one under its SQL
+// text. A statement slower than sql/slowQueryMs is written to the slow query
+// log with its bound values redacted to their types and the EXPLAIN QUERY
+// PLAN of the statement, taken once per statement and thread.
+class QueryTimer
+{
+public:
+    // The prepared query, or sql run directly on it. Times up to the first
+    // row, all of a statement that returns at most one.
+    static bool exec(QSqlQuery &query, const QSqlDatabase &database);
+    static bool exec(QSqlQuery &query, const QSqlDatabase &database, const QString &sql);
+
+    // Times a statement over its exec() and every next() through it, for
+    // reads of many rows; it is recorded, and judged slow or not, when the
+    // scope ends. The time the caller spends on each row isn't counted.
+    class Scope
+    {
+    public:
+        Scope(QSqlQuery &query, const QSqlDatabase &database);
+        ~Scope();
+        bool exec();
+        bool exec(const QString &sql);
+        bool next();
+
+    private:
+        QSqlQuery &query;
+        QSqlDatabase database;
+        QString sql;
+        qint64 elapsedNs = 0;
+        bool executed = false;
+        bool succeeded = false;
+    };
+
+    struct StatementStats
+    {
+        QString sql;
+        quint64 count = 0;
+        quint64 slowCount = 0;
+        quint64 totalUs = 0;
+        quint64 maxUs = 0;
+    };
+
+    // Merged over every thread, most total time first
+    static QVector<StatementStats> statementStats();
+    static QJsonArray toJson();
+    // Prometheus text exposition format
+    static QString toText();
+
+private:
+    struct Entry
+    {
+        quint64 count = 0;
+        quint64 slowCount = 0;
+        quint64 totalUs = 0;
+        quint64 maxUs = 0;
+        // Taken on the first slow run
+        bool explained = false;
+        QString plan;
+    };
+
+    // Only the owning thread records into a shard, the mutex is for snapshots
+    struct Shard
+    {
+        QMutex mutex;
+        QHash<QString, Entry> entries;
+        Shard *next = nullptr;
+    };
+
+    // Statements built per request could grow the table without bound
+    static const int MaxStatements = 256;
+
+    static Shard &localShard();
+    static void record(const QSqlQuery &query, const QSqlDatabase &database, const QString &statement,
+                       quint64 elapsedUs, bool succeeded);
+    static QString redactedValues(const QVariantList &values);
+    static QString queryPlan(const QSqlDatabase &database, const QString &sql, const QVariantList &values);
+
+    static QAtomicPointer<Shard> shards;
+};
+
+#endif // QUERYTIMER_H
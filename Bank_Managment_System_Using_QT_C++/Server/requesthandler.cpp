@@ -1,4 +1,12 @@
 #include "RequestHandler.h"
+#include "ledgerwriter.h"
+#include "notificationhub.h"
+#include "serverconfig.h"
+#include "messageframing.h"
+#include "userdatacache.h"
+#include "servermetrics.h"
+#include "requesttracer.h"
+#include "querytimer.h"
 
 RequestHandler::RequestHandler(const QString &connectionName, QObject *parent)
     : QObject(parent), connectionName(connectionName), logger("RequestHandler")
@@ -15,6 +23,10 @@ RequestHandler::RequestHandler(const QString &connectionName, QObject *parent)
 
 RequestHandler::~RequestHandler()
 {
+    if (subscription != nullptr)
+    {
+        NotificationHub::instance().unsubscribe(subscription);
+    }
     databaseManager->closeConnection();
     if(databaseManager != nullptr)
     {
@@ -24,29 +36,334 @@ RequestHandler::~RequestHandler()
     logger.log("RequestHandler Object Destroyed");
 }
 
-QByteArray RequestHandler::handleRequest(QByteArray requestData)
+void RequestHandler::handleRequest(quint64 requestSequence, const QByteArray &requestData, quint64 traceId)
 {
     //"not needed anymore they were just for debugging" faster performance
     //logger.log("Processing Request: " + QString(requestData));
 
-    // Convert the received data to a JSON document
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(requestData);
+    // Decode the JSON or CBOR payload into a JSON object
+    const qint64 parseStartNs = ServerMetrics::nowNs();
+    RequestTracer::Span parseSpan(traceId, "parse");
+    QJsonObject jsonObj;
+    const bool decoded = MessageCodec::decode(requestData, jsonObj);
+    parseSpan.finish();
+    if (!decoded)
+    {
+        ServerMetrics::record(-1, ServerMetrics::Parse, ServerMetrics::nowNs() - parseStartNs);
+        ServerMetrics::add(ServerMetrics::MalformedRequests);
+
+        // Still answered, later responses wait for this sequence number
+        QJsonObject errorJson;
+        errorJson["responseId"] = -1;
+        errorJson["errorMessage"] = "Malformed request";
+        respond(requestSequence, errorJson, traceId);
+        return;
+    }
+
+    const int requestId = BankProtocol::requestIdOf(jsonObj);
+    ServerMetrics::record(requestId, ServerMetrics::Parse, ServerMetrics::nowNs() - parseStartNs);
+    emit requestDecoded(requestSequence, requestId);
+
+    if (requestId == MessageCodec::HelloRequestId)
+    {
+        QJsonObject helloResponse = handleHello(requestSequence, jsonObj);
+
+        // Answered in the old encoding, every later response in the chosen one
+        respond(requestSequence, helloResponse, traceId);
+        if (helloResponse["helloSuccess"].toBool())
+        {
+            MessageCodec::encodingFromName(helloResponse["encoding"].toString(), responseEncoding);
+            compressThreshold = helloResponse["compressionThreshold"].toInt();
+        }
+        return;
+    }
+
+    if (requestId == static_cast<int>(BankProtocol::RequestId::Subscribe))
+    {
+        respond(requestSequence, handleSubscribe(jsonObj), traceId);
+        return;
+    }
+
+    if (requestId == static_cast<int>(BankProtocol::RequestId::Metrics))
+    {
+        respond(requestSequence, handleMetrics(), traceId);
+        return;
+    }
 
-    // Convert the JSON document to a JSON object
-    QJsonObject jsonObj = jsonDoc.object();
+    if (requestId == static_cast<int>(BankProtocol::RequestId::TraceDump))
+    {
+        respond(requestSequence, handleTraceDump(jsonObj), traceId);
+        return;
+    }
+
+    // A read must see every write the session sent before it, so it waits
+    // for them to commit; anything after a waiting request waits behind it
+    if (!heldRequests.isEmpty() || (pendingWrites > 0 && !DatabaseManager::isWriteRequest(requestId)))
+    {
+        heldRequests.enqueue({requestSequence, requestId, jsonObj, traceId});
+        return;
+    }
+
+    executeRequest(requestSequence, requestId, jsonObj, traceId);
+}
+
+void RequestHandler::executeRequest(quint64 requestSequence, int requestId, const QJsonObject &jsonObj,
+                                    quint64 traceId)
+{
+    // Writes are handed to the LedgerWriter and answered once their batch committed
+    if (DatabaseManager::isWriteRequest(requestId))
+    {
+        LedgerReply *reply = new LedgerReply(requestSequence, traceId);
+        if (traceId != 0)
+        {
+            pendingTraces.insert(requestSequence, traceId);
+        }
+        connect(reply, &LedgerReply::finished, this, &RequestHandler::writeFinished);
+        pendingWrites++;
+        LedgerWriter::instance().submit(jsonObj, reply);
+        return;
+    }
+
+    const qint64 databaseStartNs = ServerMetrics::nowNs();
+    RequestTracer::Scope traceScope(traceId);
+
+    // The plain user data listing is the same for every session, answer it from the cache
+    if (requestId == static_cast<int>(BankProtocol::RequestId::FetchAllUserData))
+    {
+        const BankProtocol::FetchAllUserDataRequest request =
+            BankProtocol::decode<BankProtocol::FetchAllUserDataRequest>(jsonObj);
+        if (!request.stream && !request.hasOptions())
+        {
+            QByteArray responseData = sharedUserData(requestSequence, jsonObj);
+            ServerMetrics::record(requestId, ServerMetrics::Database, ServerMetrics::nowNs() - databaseStartNs);
+            if (!responseData.isNull())
+            {
+                emit responseReady(requestSequence, responseData);
+            }
+            return;
+        }
+    }
+
+    // Large reads that asked for it go out chunk by chunk from the cursor
+    ResultStream *stream = databaseManager->openResultStream(jsonObj, responseEncoding);
+    if (stream != nullptr)
+    {
+        ServerMetrics::record(requestId, ServerMetrics::Database, ServerMetrics::nowNs() - databaseStartNs);
+        emit streamReady(requestSequence, stream);
+        return;
+    }
 
     // Process the request using the DatabaseManager
     QJsonObject responseObj = databaseManager->processRequest(jsonObj);
+    ServerMetrics::record(requestId, ServerMetrics::Database, ServerMetrics::nowNs() - databaseStartNs);
+
+    respond(requestSequence, responseObj, traceId);
+}
+
+void RequestHandler::writeFinished(quint64 requestSequence, QJsonObject responseJson)
+{
+    pendingWrites--;
+    respond(requestSequence, responseJson, pendingTraces.take(requestSequence));
+
+    // Run what waited for the session's writes, up to the next read that still has to
+    while (!heldRequests.isEmpty()
+           && (pendingWrites == 0 || DatabaseManager::isWriteRequest(heldRequests.head().requestId)))
+    {
+        const HeldRequest held = heldRequests.dequeue();
+        executeRequest(held.requestSequence, held.requestId, held.requestJson, held.traceId);
+    }
+}
+
+void RequestHandler::respond(quint64 requestSequence, const QJsonObject &responseJson, quint64 traceId)
+{
+    const int requestId = responseJson["responseId"].toInt(-1);
+    const BankProtocol::RequestInfo *info = BankProtocol::requestInfo(requestId);
+    const bool succeeded = info != nullptr && responseJson[info->successKey].toBool();
+    if (!succeeded)
+    {
+        ServerMetrics::countError(requestId);
+    }
+
+    // The admin requests of the server trust what this session logged in as
+    if (requestId == static_cast<int>(BankProtocol::RequestId::Login))
+    {
+        sessionIsAdmin = succeeded && responseJson["isAdmin"].toBool();
+    }
+
+    const qint64 serializeStartNs = ServerMetrics::nowNs();
+    RequestTracer::Span serializeSpan(traceId, "serialize");
+    QByteArray responseData = limitPayload(requestId, createResponse(responseJson));
+    serializeSpan.finish();
+    ServerMetrics::record(requestId, ServerMetrics::Serialize, ServerMetrics::nowNs() - serializeStartNs);
+
+    emit responseReady(requestSequence, responseData);
+}
+
+QJsonObject RequestHandler::handleHello(quint64 requestSequence, const QJsonObject &requestJson)
+{
+    QJsonObject responseJson;
+    responseJson["responseId"] = MessageCodec::HelloRequestId;
+
+    // Switching mid-session could re-encode a write that is still being committed
+    if (requestSequence != 0)
+    {
+        responseJson["helloSuccess"] = false;
+        responseJson["errorMessage"] = "Hello must be the first request";
+        return responseJson;
+    }
+
+    // The first encoding of the client's list that we support wins
+    MessageCodec::Encoding chosen = MessageCodec::Encoding::Json;
+    const BankProtocol::HelloRequest hello = BankProtocol::decode<BankProtocol::HelloRequest>(requestJson);
+    for (const QString &name : hello.encodings)
+    {
+        if (MessageCodec::encodingFromName(name, chosen))
+        {
+            break;
+        }
+    }
+
+    // Compression only if the client can inflate it and it isn't turned off here
+    const int threshold = ServerConfig::instance().compressThresholdBytes;
+    const bool compress = threshold > 0
+        && hello.compression.contains(QLatin1String(MessageFraming::CompressionName), Qt::CaseInsensitive);
+
+    responseJson["helloSuccess"] = true;
+    responseJson["encoding"] = MessageCodec::encodingName(chosen);
+    responseJson["compression"] = compress ? MessageFraming::CompressionName : "none";
+    responseJson["compressionThreshold"] = compress ? threshold : 0;
+    responseJson["encodings"] = QJsonArray::fromStringList(MessageCodec::supportedEncodings());
+    return responseJson;
+}
+
+QJsonObject RequestHandler::handleSubscribe(const QJsonObject &requestJson)
+{
+    QJsonObject responseJson;
+    responseJson["responseId"] = static_cast<int>(BankProtocol::RequestId::Subscribe);
+
+    const BankProtocol::SubscribeRequest request = BankProtocol::decode<BankProtocol::SubscribeRequest>(requestJson);
+    if (request.accountNumbers.size() > BankProtocol::SubscribeRequest::MaxAccounts)
+    {
+        responseJson["subscribeSuccess"] = false;
+        responseJson["errorMessage"] = "Too many accounts";
+        return responseJson;
+    }
+
+    if (subscription == nullptr)
+    {
+        subscription = new AccountSubscription();
+        connect(subscription, &AccountSubscription::eventReady, this, &RequestHandler::eventReady);
+    }
+    NotificationHub::instance().subscribe(subscription, request.accountNumbers);
 
-    // Convert the response object to a JSON document
-    QJsonDocument jsonResponse(responseObj);
+    responseJson["subscribeSuccess"] = true;
+    responseJson["accountNumbers"] = BankProtocol::writeValue(request.accountNumbers);
+    return responseJson;
+}
 
-    // Convert the JSON document to a byte array
-    QByteArray responseData = jsonResponse.toJson();
+QByteArray RequestHandler::sharedUserData(quint64 requestSequence, const QJsonObject &requestJson)
+{
+    const quint64 version = LedgerWriter::instance().dataVersion();
+    const qint64 knownVersion = BankProtocol::decode<BankProtocol::FetchAllUserDataRequest>(requestJson).knownVersion;
 
+    // Nothing was committed since the client's copy
+    if (knownVersion != 0 && static_cast<quint64>(knownVersion) == version)
+    {
+        QJsonObject responseJson;
+        responseJson["responseId"] = static_cast<int>(BankProtocol::RequestId::FetchAllUserData);
+        responseJson["fetchUserDataSuccess"] = true;
+        responseJson["notModified"] = true;
+        responseJson["version"] = knownVersion;
+        return createResponse(responseJson);
+    }
+
+    const QByteArray payload = UserDataCache::instance().payload(version, responseEncoding,
+        [this, &requestJson] { return databaseManager->processRequest(requestJson); },
+        [this, requestSequence]
+        {
+            UserDataReply *reply = new UserDataReply(requestSequence, responseEncoding);
+            connect(reply, &UserDataReply::finished, this, &RequestHandler::userDataFinished);
+            return reply;
+        });
+    if (payload.isNull())
+    {
+        return payload;
+    }
+    return limitPayload(static_cast<int>(BankProtocol::RequestId::FetchAllUserData), payload);
+}
+
+void RequestHandler::userDataFinished(quint64 requestSequence, QByteArray payload)
+{
+    emit responseReady(requestSequence, limitPayload(static_cast<int>(BankProtocol::RequestId::FetchAllUserData),
+                                                     payload));
+}
+
+QByteArray RequestHandler::limitPayload(int requestId, const QByteArray &payload)
+{
+    if (payload.size() <= MessageFraming::MaxPayloadSize)
+    {
+        return payload;
+    }
+    logger.log(QString("Response to request %1 is %2 bytes, over the frame limit.").arg(requestId).arg(payload.size()));
+    return createResponse(DatabaseManager::failureResponse(requestId, "Response too large, request it as a stream"));
+}
+
+QJsonObject RequestHandler::handleMetrics()
+{
+    QJsonObject responseJson;
+    responseJson["responseId"] = static_cast<int>(BankProtocol::RequestId::Metrics);
+
+    if (!sessionIsAdmin)
+    {
+        responseJson["metricsSuccess"] = false;
+        responseJson["errorMessage"] = "Admin login required";
+        return responseJson;
+    }
+
+    responseJson["metricsSuccess"] = true;
+    responseJson["metrics"] = ServerMetrics::snapshot().toJson();
+    responseJson["statements"] = QueryTimer::toJson();
+    return responseJson;
+}
+
+QJsonObject RequestHandler::handleTraceDump(const QJsonObject &requestJson)
+{
+    QJsonObject responseJson;
+    responseJson["responseId"] = static_cast<int>(BankProtocol::RequestId::TraceDump);
+
+    if (!sessionIsAdmin)
+    {
+        responseJson["traceDumpSuccess"] = false;
+        responseJson["errorMessage"] = "Admin login required";
+        return responseJson;
+    }
+
+    const BankProtocol::TraceDumpRequest request = BankProtocol::decode<BankProtocol::TraceDumpRequest>(requestJson);
+    responseJson["traceDumpSuccess"] = true;
+    responseJson["trace"] = RequestTracer::dump();
+    if (request.clear)
+    {
+        RequestTracer::clear();
+    }
+    if (request.sampleEvery.has_value())
+    {
+        RequestTracer::setSampleEvery(*request.sampleEvery);
+        logger.log(QString("Trace sampling set to every %1 requests").arg(RequestTracer::sampleEvery()));
+    }
+    responseJson["sampleEvery"] = RequestTracer::sampleEvery();
+    return responseJson;
+}
+
+int RequestHandler::compressionThreshold() const
+{
+    return compressThreshold;
+}
+
+QByteArray RequestHandler::createResponse(QJsonObject responseJson)
+{
     // Log the response data "not needed anymore they were just for debugging" faster performance
-    //logger.log("Returning Response: " + QString(responseData));
+    //logger.log("Returning Response: " + QJsonDocument(responseJson).toJson());
 
-    // Return the response data
-    return responseData;
+    // Encode the response object in the connection's encoding
+    return MessageCodec::encode(responseJson, responseEncoding);
 }
@@ -5,9 +5,16 @@
 #include <QByteArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
+#include <QHash>
+#include <QQueue>
 
 #include "databasemanager.h"
 #include "logger.h"
+#include "messagecodec.h"
+
+class ResultStream;
+class AccountSubscription;
 
 class RequestHandler : public QObject
 {
@@ -16,17 +23,65 @@ class RequestHandler : public QObject
 public:
     explicit RequestHandler(const QString &connectionName, QObject *parent = nullptr);
     ~RequestHandler();
-    QByteArray handleRequest(QByteArray requestData);
+    // The response comes back through responseReady, for writes only after they committed.
+    // A read runs only once the session's earlier writes committed.
+    // A non-zero traceId records the request's spans in the RequestTracer.
+    void handleRequest(quint64 requestSequence, const QByteArray &requestData, quint64 traceId = 0);
+    QByteArray createResponse(QJsonObject responseJson);
+    // Responses this large are compressed on the wire, 0 if the client can't inflate them
+    int compressionThreshold() const;
 
 signals:
-    void responseReady(QByteArray responseData);
+    // Emitted as soon as the request ID is known, before any response
+    void requestDecoded(quint64 requestSequence, int requestId);
+    void responseReady(quint64 requestSequence, QByteArray responseData);
+    // The response is sent chunk by chunk, the receiver takes ownership of the stream
+    void streamReady(quint64 requestSequence, ResultStream *stream);
+    // Account event of a subscription, sent outside the response order
+    void eventReady(QJsonObject event);
+
+private slots:
+    void writeFinished(quint64 requestSequence, QJsonObject responseJson);
+    void userDataFinished(quint64 requestSequence, QByteArray payload);
 
 private:
     DatabaseManager *databaseManager;
     QString connectionName;
     Logger logger;
+    // Encoding of the responses, chosen by the client's hello
+    MessageCodec::Encoding responseEncoding = MessageCodec::Encoding::Json;
+    int compressThreshold = 0;
+    // Owned by the NotificationHub once created
+    AccountSubscription *subscription = nullptr;
+    // Set by a successful admin login, gates the server's own requests
+    bool sessionIsAdmin = false;
+    // Trace IDs of the sampled writes still waiting for their commit
+    QHash<quint64, quint64> pendingTraces;
 
-    QByteArray createResponse(QJsonObject responseJson);
+    // A request decoded but not run yet, it waits for the session's earlier writes
+    struct HeldRequest
+    {
+        quint64 requestSequence;
+        int requestId;
+        QJsonObject requestJson;
+        quint64 traceId;
+    };
+    // Writes submitted to the LedgerWriter and not answered yet
+    int pendingWrites = 0;
+    QQueue<HeldRequest> heldRequests;
+
+    // Submit a write or run a read, once nothing the session sent before is in its way
+    void executeRequest(quint64 requestSequence, int requestId, const QJsonObject &jsonObj, quint64 traceId);
+    QJsonObject handleHello(quint64 requestSequence, const QJsonObject &requestJson);
+    QJsonObject handleSubscribe(const QJsonObject &requestJson);
+    QJsonObject handleMetrics();
+    QJsonObject handleTraceDump(const QJsonObject &requestJson);
+    // Encode and emit the response to a request, counting it in the metrics
+    void respond(quint64 requestSequence, const QJsonObject &responseJson, quint64 traceId = 0);
+    // Null when another session's build answers it later through userDataFinished
+    QByteArray sharedUserData(quint64 requestSequence, const QJsonObject &requestJson);
+    // The payload, or an error response if it won't fit in a frame
+    QByteArray limitPayload(int requestId, const QByteArray &payload);
 };
 
 #endif // REQUESTHANDLER_H
@@ -0,0 +1,188 @@
+#include "requesttracer.h"
+#include "servermetrics.h"
+#include "serverconfig.h"
+
+#include <QThread>
+#include <QJsonArray>
+#include <QCoreApplication>
+
+QAtomicInteger<int> RequestTracer::sampleInterval(-1);
+QAtomicInteger<quint64> RequestTracer::nextTraceId(1);
+QAtomicInteger<int> RequestTracer::threadCount;
+QAtomicPointer<RequestTracer::ThreadBuffer> RequestTracer::buffers;
+
+static thread_local quint64 currentTraceId = 0;
+
+quint64 RequestTracer::startTrace()
+{
+    int interval = sampleInterval.loadRelaxed();
+    if (interval < 0)
+    {
+        // Not set at runtime yet, start from the configuration
+        interval = ServerConfig::instance().traceSampleEvery;
+        sampleInterval.testAndSetRelaxed(-1, interval);
+    }
+    if (interval == 0)
+    {
+        return 0;
+    }
+
+    static thread_local quint64 arrivals = 0;
+    if (++arrivals % static_cast<quint64>(interval) != 0)
+    {
+        return 0;
+    }
+    return nextTraceId.fetchAndAddRelaxed(1);
+}
+
+void RequestTracer::setSampleEvery(int sampleEvery)
+{
+    sampleInterval.storeRelaxed(qMax(0, sampleEvery));
+}
+
+int RequestTracer::sampleEvery()
+{
+    int interval = sampleInterval.loadRelaxed();
+    return interval < 0 ? ServerConfig::instance().traceSampleEvery : interval;
+}
+
+quint64 RequestTracer::currentTrace()
+{
+    return currentTraceId;
+}
+
+RequestTracer::Scope::Scope(quint64 traceId)
+    : previousTraceId(currentTraceId)
+{
+    currentTraceId = traceId;
+}
+
+RequestTracer::Scope::~Scope()
+{
+    currentTraceId = previousTraceId;
+}
+
+RequestTracer::Span::Span(quint64 traceId, const char *name)
+    : traceId(traceId), name(name), startNs(traceId != 0 ? ServerMetrics::nowNs() : 0)
+{}
+
+RequestTracer::Span::~Span()
+{
+    finish();
+}
+
+void RequestTracer::Span::finish()
+{
+    if (traceId != 0)
+    {
+        recordSpan(traceId, name, startNs, ServerMetrics::nowNs());
+        traceId = 0;
+    }
+}
+
+RequestTracer::ThreadBuffer &RequestTracer::localBuffer()
+{
+    static thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer == nullptr)
+    {
+        // Once per thread, on its first sampled span; kept for the process lifetime
+        buffer = new ThreadBuffer();
+        buffer->threadIndex = threadCount.fetchAndAddRelaxed(1) + 1;
+        QThread *thread = QThread::currentThread();
+        buffer->threadName = thread->objectName().isEmpty()
+                                 ? (thread == QCoreApplication::instance()->thread() ? QString("Main")
+                                                                                     : QString("Thread-%1").arg(buffer->threadIndex))
+                                 : thread->objectName();
+        buffer->capacity = ServerConfig::instance().traceBufferSpans;
+        buffer->records = new SpanRecord[buffer->capacity];
+
+        ThreadBuffer *head = buffers.loadAcquire();
+        do
+        {
+            buffer->next = head;
+        } while (!buffers.testAndSetOrdered(head, buffer, head));
+    }
+    return *buffer;
+}
+
+void RequestTracer::recordSpan(quint64 traceId, const char *name, qint64 startNs, qint64 endNs)
+{
+    if (traceId == 0)
+    {
+        return;
+    }
+
+    ThreadBuffer &buffer = localBuffer();
+    const quint64 index = buffer.written.loadRelaxed();
+    SpanRecord &record = buffer.records[index % buffer.capacity];
+    record.name.storeRelaxed(name);
+    record.traceId.storeRelaxed(traceId);
+    record.startNs.storeRelaxed(startNs);
+    record.durationNs.storeRelaxed(endNs - startNs);
+    // Publishes the record to dump()
+    buffer.written.storeRelease(index + 1);
+}
+
+QJsonObject RequestTracer::dump()
+{
+    QJsonArray events;
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    for (ThreadBuffer *buffer = buffers.loadAcquire(); buffer != nullptr; buffer = buffer->next)
+    {
+        QJsonObject threadName;
+        threadName["name"] = "thread_name";
+        threadName["ph"] = "M";
+        threadName["pid"] = pid;
+        threadName["tid"] = buffer->threadIndex;
+        threadName["args"] = QJsonObject{{"name", buffer->threadName}};
+        events.append(threadName);
+
+        const quint64 written = buffer->written.loadAcquire();
+        const quint64 capacity = static_cast<quint64>(buffer->capacity);
+        quint64 first = written > capacity ? written - capacity : 0;
+        first = qMax(first, buffer->clearedBefore.loadRelaxed());
+
+        QJsonArray threadEvents;
+        for (quint64 index = first; index < written; ++index)
+        {
+            const SpanRecord &record = buffer->records[index % capacity];
+            QJsonObject event;
+            event["name"] = record.name.loadRelaxed();
+            event["cat"] = "request";
+            event["ph"] = "X";
+            event["ts"] = record.startNs.loadRelaxed() / 1000.0;
+            event["dur"] = record.durationNs.loadRelaxed() / 1000.0;
+            event["pid"] = pid;
+            event["tid"] = buffer->threadIndex;
+            event["args"] = QJsonObject{{"traceId", static_cast<qint64>(record.traceId.loadRelaxed())}};
+            threadEvents.append(event);
+        }
+
+        // The owner kept writing meanwhile, drop what it may have overwritten
+        const quint64 writtenAfter = buffer->written.loadAcquire();
+        const qint64 overwritten = static_cast<qint64>(writtenAfter > capacity ? writtenAfter - capacity : 0)
+                                   - static_cast<qint64>(first);
+        for (qint64 skip = overwritten; skip > 0 && !threadEvents.isEmpty(); --skip)
+        {
+            threadEvents.removeFirst();
+        }
+        for (const QJsonValue &event : std::as_const(threadEvents))
+        {
+            events.append(event);
+        }
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ns";
+    return trace;
+}
+
+void RequestTracer::clear()
+{
+    for (ThreadBuffer *buffer = buffers.loadAcquire(); buffer != nullptr; buffer = buffer->next)
+    {
+        buffer->clearedBefore.storeRelaxed(buffer->written.loadAcquire());
+    }
+}
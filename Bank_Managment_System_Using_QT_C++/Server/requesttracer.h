@@ -0,0 +1,89 @@
+#ifndef REQUESTTRACER_H
+#define REQUESTTRACER_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QJsonObject>
+#include <QString>
+
+// Sampled span tracing of single requests. A sampled request gets a trace ID
+// at arrival; every layer it passes records spans under that ID into a ring
+// buffer of its own thread. Requests that weren't sampled carry ID 0, and a
+// span on ID 0 costs one branch. dump() returns the buffered spans as
+// Chrome trace-event JSON, which chrome://tracing and Perfetto open directly.
+class RequestTracer
+{
+public:
+    // Trace ID for a new request: every sampleEvery-th one, 0 for the rest
+    static quint64 startTrace();
+    // 0 turns sampling off, 1 traces every request
+    static void setSampleEvery(int sampleEvery);
+    static int sampleEvery();
+
+    // Trace of the request the calling thread works on, for layers that only see the JSON
+    static quint64 currentTrace();
+
+    // Makes a trace ID current on this thread for the lifetime of the scope
+    class Scope
+    {
+    public:
+        explicit Scope(quint64 traceId);
+        ~Scope();
+
+    private:
+        quint64 previousTraceId;
+    };
+
+    // Times from construction until finish() or destruction. The name must be a
+    // string literal, only its pointer is kept.
+    class Span
+    {
+    public:
+        Span(quint64 traceId, const char *name);
+        ~Span();
+        void finish();
+
+    private:
+        quint64 traceId;
+        const char *name;
+        qint64 startNs;
+    };
+
+    // Span whose start was taken earlier, e.g. a request finishing on another call
+    static void recordSpan(quint64 traceId, const char *name, qint64 startNs, qint64 endNs);
+
+    // Buffered spans of every thread as {"traceEvents": [...]}
+    static QJsonObject dump();
+    static void clear();
+
+private:
+    struct SpanRecord
+    {
+        QAtomicPointer<const char> name;
+        QAtomicInteger<quint64> traceId;
+        QAtomicInteger<qint64> startNs;
+        QAtomicInteger<qint64> durationNs;
+    };
+
+    struct ThreadBuffer
+    {
+        int threadIndex;
+        QString threadName;
+        int capacity;
+        SpanRecord *records;
+        // Spans ever written; the ring holds the last capacity of them
+        QAtomicInteger<quint64> written;
+        // Spans before this one were cleared
+        QAtomicInteger<quint64> clearedBefore;
+        ThreadBuffer *next = nullptr;
+    };
+
+    static ThreadBuffer &localBuffer();
+
+    static QAtomicInteger<int> sampleInterval;
+    static QAtomicInteger<quint64> nextTraceId;
+    static QAtomicInteger<int> threadCount;
+    static QAtomicPointer<ThreadBuffer> buffers;
+};
+
+#endif // REQUESTTRACER_H
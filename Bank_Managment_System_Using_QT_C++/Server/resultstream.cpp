@@ -0,0 +1,100 @@
+#include "resultstream.h"
+#include "serverconfig.h"
+#include "databaseconnectionpool.h"
+#include "querytimer.h"
+
+#include <QJsonArray>
+
+ResultStream::ResultStream(int requestId, const char *successKey, const char *rowsKey,
+                           const ChunkQuery &chunkQuery, RowFormatter formatRow,
+                           MessageCodec::Encoding encoding, QObject *parent)
+    : QObject(parent), requestId(requestId), successKey(successKey), rowsKey(rowsKey),
+      chunkQuery(chunkQuery), formatRow(formatRow), encoding(encoding),
+      chunkRows(ServerConfig::instance().streamChunkRows)
+{}
+
+bool ResultStream::readChunk(QByteArray &payload)
+{
+    if (finished)
+    {
+        return false;
+    }
+
+    QJsonObject chunk;
+    chunk["responseId"] = requestId;
+    chunk["chunk"] = chunkIndex++;
+
+    // Rows this chunk may send, one more is read to tell whether another follows
+    qint64 wanted = chunkRows;
+    if (chunkQuery.limit > 0)
+    {
+        wanted = qMin(wanted, chunkQuery.limit - rowsSent);
+    }
+
+    // Streams are only read on the worker thread that opened them
+    PooledConnection *connection = DatabaseConnectionPool::instance().acquire();
+    bool executed = false;
+    QJsonArray rows;
+    bool hasMore = false;
+    if (connection != nullptr)
+    {
+        QSqlQuery query = connection->cursor(lastKey.isEmpty() ? chunkQuery.firstSql : chunkQuery.nextSql);
+        for (const QVariant &value : std::as_const(chunkQuery.values))
+        {
+            query.addBindValue(value);
+        }
+        for (const QVariant &key : std::as_const(lastKey))
+        {
+            query.addBindValue(key);
+        }
+        query.addBindValue(wanted + 1);
+
+        QueryTimer::Scope timing(query, connection->database());
+        executed = timing.exec();
+        while (executed && timing.next())
+        {
+            if (rows.size() == wanted)
+            {
+                hasMore = true;
+                break;
+            }
+            rows.append(formatRow(query));
+            lastKey.clear();
+            for (int key = 0; key < chunkQuery.keyCount; ++key)
+            {
+                lastKey.append(query.value(QString("_key%1").arg(key)));
+            }
+        }
+        // Ends the read transaction before the chunk goes out
+        query.finish();
+    }
+
+    if (!executed)
+    {
+        // The query failed to run, answer like the single response would
+        chunk[successKey] = false;
+        chunk["errorMessage"] = "failed";
+        chunk["hasMore"] = false;
+        finished = true;
+        payload = MessageCodec::encode(chunk, encoding);
+        return true;
+    }
+
+    rowsSent += rows.size();
+    if (chunkQuery.limit > 0 && rowsSent >= chunkQuery.limit)
+    {
+        hasMore = false;
+    }
+    finished = !hasMore;
+
+    chunk[successKey] = true;
+    chunk[rowsKey] = rows;
+    chunk["hasMore"] = hasMore;
+    payload = MessageCodec::encode(chunk, encoding);
+    return true;
+}
+
+bool ResultStream::atEnd() const
+{
+    return finished;
+}
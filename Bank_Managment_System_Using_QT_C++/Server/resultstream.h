@@ -0,0 +1,65 @@
+#ifndef RESULTSTREAM_H
+#define RESULTSTREAM_H
+
+#include <QObject>
+#include <QSqlQuery>
+#include <QJsonObject>
+#include <QByteArray>
+#include <QVariantList>
+
+#include "messagecodec.h"
+
+// A read result sent as a series of response frames, so memory stays
+// bounded by one chunk whatever the row count. Every chunk is a complete
+// response carrying the next rows, its index in "chunk" and whether more
+// follow in "hasMore".
+//
+// Each chunk is a bounded keyset query of its own, run and finished on the
+// worker's pooled connection in one go. No statement stays open between
+// chunks, so a client that reads slowly never pins a read snapshot for the
+// other sessions of its worker. The price is that later chunks see what was
+// committed after the first one.
+class ResultStream : public QObject
+{
+    Q_OBJECT
+
+public:
+    using RowFormatter = QJsonObject (*)(const QSqlQuery &query);
+
+    // Both statements end in "LIMIT ?" and select the key columns as _key0,
+    // _key1, ... in sort order. firstSql reads from the start; nextSql has the
+    // condition past the last key sent, whose placeholders follow values.
+    struct ChunkQuery
+    {
+        QString firstSql;
+        QString nextSql;
+        QVariantList values;
+        int keyCount = 1;
+        // Rows over all chunks, 0 for no limit
+        qint64 limit = 0;
+    };
+
+    ResultStream(int requestId, const char *successKey, const char *rowsKey,
+                 const ChunkQuery &chunkQuery, RowFormatter formatRow,
+                 MessageCodec::Encoding encoding, QObject *parent = nullptr);
+
+    // Encode the next chunk; false once the last one was handed out
+    bool readChunk(QByteArray &payload);
+    bool atEnd() const;
+
+private:
+    int requestId;
+    const char *successKey;
+    const char *rowsKey;
+    ChunkQuery chunkQuery;
+    RowFormatter formatRow;
+    MessageCodec::Encoding encoding;
+    int chunkRows;
+    int chunkIndex = 0;
+    qint64 rowsSent = 0;
+    // Key of the last row sent, empty before the first chunk
+    QVariantList lastKey;
+    bool finished = false;
+};
+
+#endif // RESULTSTREAM_H
@@ -1,9 +1,26 @@
 #include "Server.h"
+#include "serverconfig.h"
+#include "databaseconnectionpool.h"
+#include "ledgerwriter.h"
+#include "userdatacache.h"
+#include "requesttracer.h"
+
+#include <QStringList>
 
 Server::Server(QObject *parent)
     : QTcpServer(parent), logger("Server")
 {
     logger.log("Object Created.");
+    startWorkers();
+
+    int statsInterval = ServerConfig::instance().statsIntervalSeconds;
+    if (statsInterval > 0)
+    {
+        connect(&statsTimer, &QTimer::timeout, this, &Server::logStatistics);
+        statsClock.start();
+        statsTimer.start(statsInterval * 1000);
+    }
+
     if (!listen(QHostAddress::LocalHost, 54321)) {
         logger.log("Failed to start server: " + errorString());
     } else {
@@ -13,39 +30,121 @@ Server::Server(QObject *parent)
 
 Server::~Server()
 {
-    //just to be sure
-    for (auto it = clientThreads.begin(); it != clientThreads.end(); ++it)
+    close();
+    // Stopping a worker also deletes the clients still living in it
+    for (Worker &worker : workers)
     {
-        it.value()->quit();
-        it.value()->wait();
-        delete it.value();
+        worker.thread->quit();
+        worker.thread->wait();
+        delete worker.thread;
     }
-    close();
+    workers.clear();
     logger.log("All Threads have been closed");
     logger.log("Object Destroyed.");
 }
 
+void Server::startWorkers()
+{
+    const int workerCount = ServerConfig::instance().workerThreads;
+    workers.reserve(workerCount);
+
+    for (int i = 0; i < workerCount; ++i)
+    {
+        QThread* workerThread = new QThread();
+        workerThread->setObjectName(QString("Worker-%1").arg(i));
+        workerThread->start();
+        workers.append({workerThread, 0});
+    }
+    logger.log(QString("Started %1 worker threads.").arg(workerCount));
+}
+
+int Server::pickWorker()
+{
+    if (ServerConfig::instance().workerScheduling == ServerConfig::WorkerScheduling::RoundRobin)
+    {
+        int workerIndex = nextWorker;
+        nextWorker = (nextWorker + 1) % workers.size();
+        return workerIndex;
+    }
+
+    // Least loaded, ties go to the lowest index
+    int workerIndex = 0;
+    for (int i = 1; i < workers.size(); ++i)
+    {
+        if (workers[i].clientCount < workers[workerIndex].clientCount)
+        {
+            workerIndex = i;
+        }
+    }
+    return workerIndex;
+}
+
 void Server::incomingConnection(qintptr socketDescriptor)
 {
-    QThread* clientThread = new QThread();
-    clientThreads.insert(socketDescriptor, clientThread);
+    RequestTracer::Span acceptSpan(RequestTracer::startTrace(), "accept");
+    int workerIndex = pickWorker();
+    Worker &worker = workers[workerIndex];
 
-    ClientRunnable* clientRunnable = new ClientRunnable(socketDescriptor);
-    clientRunnable->moveToThread(clientThread);
+    const quint64 clientId = nextClientId++;
+    ClientRunnable* clientRunnable = new ClientRunnable(clientId, socketDescriptor);
+    clientRunnable->moveToThread(worker.thread);
 
-    connect(clientThread, &QThread::started, clientRunnable, &ClientRunnable::run);
     connect(clientRunnable, &ClientRunnable::clientDisconnected, this, &Server::handleClientDisconnected);
-    connect(clientRunnable, &ClientRunnable::destroyed, clientThread, &QThread::quit);
+    connect(worker.thread, &QThread::finished, clientRunnable, &QObject::deleteLater);
 
-    clientThread->start();
-    logger.log(QString("Client connected with socket descriptor: %1").arg(socketDescriptor));
+    // Set the socket up inside the worker's event loop
+    QMetaObject::invokeMethod(clientRunnable, &ClientRunnable::run, Qt::QueuedConnection);
+
+    worker.clientCount++;
+    clientWorkers.insert(clientId, workerIndex);
+    logger.log(QString("Client connected with socket descriptor: %1 on worker %2").
+               arg(socketDescriptor).arg(workerIndex));
 }
 
-void Server::handleClientDisconnected(qintptr socketDescriptor)
+void Server::handleClientDisconnected(quint64 clientId, qintptr socketDescriptor)
 {
-    clientThreads.value(socketDescriptor)->quit();
-    clientThreads.value(socketDescriptor)->wait();
-    delete clientThreads.value(socketDescriptor);
-    clientThreads.remove(socketDescriptor);
+    // The descriptor may already belong to a newer client, the ID never does
+    auto it = clientWorkers.find(clientId);
+    if (it != clientWorkers.end())
+    {
+        workers[it.value()].clientCount--;
+        clientWorkers.erase(it);
+    }
     logger.log(QString("Client disconnected with socket descriptor: %1").arg(socketDescriptor));
 }
+
+void Server::logStatistics()
+{
+    double seconds = statsClock.restart() / 1000.0;
+    const DatabaseConnectionPool &pool = DatabaseConnectionPool::instance();
+    quint64 openCount = pool.connectionOpenCount();
+
+    logger.log(QString("Stats: %1 clients, %2 database opens/s, pool size %3, %4 checkouts")
+                   .arg(clientWorkers.size())
+                   .arg((openCount - lastOpenCount) / seconds, 0, 'f', 1)
+                   .arg(pool.size())
+                   .arg(pool.checkoutCount()));
+    lastOpenCount = openCount;
+
+    const LedgerWriter &writer = LedgerWriter::instance();
+    quint64 commits = writer.commitCount();
+    quint64 committedRequests = writer.committedRequestCount();
+    quint64 intervalCommits = commits - lastCommitCount;
+    double averageBatch = intervalCommits > 0
+            ? static_cast<double>(committedRequests - lastCommittedRequests) / intervalCommits : 0.0;
+
+    QStringList buckets;
+    for (quint64 count : writer.batchSizeHistogram())
+    {
+        buckets.append(QString::number(count));
+    }
+    logger.log(QString("Ledger: %1 commits/s, avg batch %2, batch sizes [%3]")
+                   .arg(intervalCommits / seconds, 0, 'f', 1)
+                   .arg(averageBatch, 0, 'f', 1)
+                   .arg(buckets.join(' ')));
+    lastCommitCount = commits;
+    lastCommittedRequests = committedRequests;
+
+    const UserDataCache &cache = UserDataCache::instance();
+    logger.log(QString("User data cache: %1 hits, %2 builds").arg(cache.hitCount()).arg(cache.buildCount()));
+}
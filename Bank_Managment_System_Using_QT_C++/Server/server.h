@@ -4,6 +4,9 @@
 #include <QTcpServer>
 #include <QThread>
 #include <QMap>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
 #include "ClientRunnable.h"
 #include "Logger.h"
 
@@ -19,11 +22,31 @@ protected:
     void incomingConnection(qintptr socketDescriptor) override;
 
 private slots:
-    void handleClientDisconnected(qintptr socketDescriptor);
+    void handleClientDisconnected(quint64 clientId, qintptr socketDescriptor);
+    void logStatistics();
 
 private:
-    QMap<qintptr, QThread*> clientThreads;
+    // One event-loop thread of the fixed pool and the number of clients it serves
+    struct Worker
+    {
+        QThread *thread;
+        int clientCount;
+    };
+
+    QVector<Worker> workers;
+    // Worker of every connected client by its client ID
+    QMap<quint64, int> clientWorkers;
+    quint64 nextClientId = 0;
+    int nextWorker = 0;
+    QTimer statsTimer;
+    QElapsedTimer statsClock;
+    quint64 lastOpenCount = 0;
+    quint64 lastCommitCount = 0;
+    quint64 lastCommittedRequests = 0;
     Logger logger;
+
+    void startWorkers();
+    int pickWorker();
 };
 
 #endif // SERVER_H
@@ -2,17 +2,33 @@ QT = core network sql
 
 CONFIG += c++17 cmdline static
 
+INCLUDEPATH += ../Common
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+        ../Common/messagecodec.cpp \
+        ../Common/messageframing.cpp \
         clientrunnable.cpp \
+        coarseclock.cpp \
+        databaseconnectionpool.cpp \
         databasemanager.cpp \
+        ledgerwriter.cpp \
         logger.cpp \
+        logwriter.cpp \
         main.cpp \
+        metricsserver.cpp \
+        notificationhub.cpp \
+        querytimer.cpp \
         requesthandler.cpp \
-        server.cpp
+        requesttracer.cpp \
+        resultstream.cpp \
+        server.cpp \
+        serverconfig.cpp \
+        servermetrics.cpp \
+        userdatacache.cpp
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -20,8 +36,23 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    ../Common/bankprotocol.h \
+    ../Common/messagecodec.h \
+    ../Common/messageframing.h \
     clientrunnable.h \
+    coarseclock.h \
+    databaseconnectionpool.h \
     databasemanager.h \
+    ledgerwriter.h \
     logger.h \
+    logwriter.h \
+    metricsserver.h \
+    notificationhub.h \
+    querytimer.h \
     requesthandler.h \
-    server.h
+    requesttracer.h \
+    resultstream.h \
+    server.h \
+    serverconfig.h \
+    servermetrics.h \
+    userdatacache.h
@@ -0,0 +1,81 @@
+#include "serverconfig.h"
+
+#include <QSettings>
+#include <QThread>
+#include <QStringList>
+
+// Upper-cased value if it is one of the allowed options, the fallback otherwise
+static QString pickOption(const QString &value, const QStringList &allowed, const QString &fallback)
+{
+    QString option = value.trimmed().toUpper();
+    return allowed.contains(option) ? option : fallback;
+}
+
+const ServerConfig &ServerConfig::instance()
+{
+    static const ServerConfig config;
+    return config;
+}
+
+ServerConfig::ServerConfig()
+{
+    QSettings settings("server.ini", QSettings::IniFormat);
+
+    // Worker pool
+    workerThreads = settings.value("workers/threads", QThread::idealThreadCount()).toInt();
+    if (workerThreads < 1)
+    {
+        workerThreads = 1;
+    }
+    QString scheduling = settings.value("workers/scheduling", "leastLoaded").toString();
+    workerScheduling = (scheduling.compare("roundRobin", Qt::CaseInsensitive) == 0)
+                           ? WorkerScheduling::RoundRobin
+                           : WorkerScheduling::LeastLoaded;
+
+    // SQLite pragmas, unknown values fall back to the defaults
+    journalMode = pickOption(settings.value("database/journalMode", "WAL").toString(),
+                             {"WAL", "DELETE", "TRUNCATE", "PERSIST", "MEMORY"}, "WAL");
+    synchronous = pickOption(settings.value("database/synchronous", "NORMAL").toString(),
+                             {"OFF", "NORMAL", "FULL", "EXTRA"}, "NORMAL");
+    cacheSize = settings.value("database/cacheSize", -16000).toInt();  // negative means KiB
+    mmapSize = settings.value("database/mmapSize", 256LL * 1024 * 1024).toLongLong();
+    tempStore = pickOption(settings.value("database/tempStore", "MEMORY").toString(),
+                           {"DEFAULT", "FILE", "MEMORY"}, "MEMORY");
+    busyTimeoutMs = settings.value("database/busyTimeoutMs", 5000).toInt();
+
+    // Group commit: how long the writer waits to fill a batch and its upper size
+    batchWindowUs = qMax(0, settings.value("ledger/batchWindowUs", 1000).toInt());
+    maxBatchSize = qMax(1, settings.value("ledger/maxBatchSize", 256).toInt());
+
+    // Log ring capacity in lines (rounded up to a power of two) and what to do when it is full
+    logBufferSize = qMax(2, settings.value("log/bufferSize", 8192).toInt());
+    QString fullPolicy = settings.value("log/fullPolicy", "block").toString();
+    logFullPolicy = (fullPolicy.compare("drop", Qt::CaseInsensitive) == 0)
+                        ? LogWriter::FullPolicy::Drop
+                        : LogWriter::FullPolicy::Block;
+    logConsole = settings.value("log/console", true).toBool();
+
+    // Rows per streamed chunk, and how much output may queue up before reading more rows
+    streamChunkRows = qMax(1, settings.value("stream/chunkRows", 500).toInt());
+    streamHighWaterBytes = qMax(1LL, settings.value("stream/highWaterBytes", 256LL * 1024).toLongLong());
+
+    // A subscriber with more output than this still queued misses events instead
+    notifyHighWaterBytes = qMax(1LL, settings.value("notify/highWaterBytes", 1024LL * 1024).toLongLong());
+
+    // Responses from this size on are zlib compressed, 0 turns compression off;
+    // the level goes from 1 (fastest) to 9 (smallest), -1 is zlib's default
+    compressThresholdBytes = qMax(0, settings.value("compress/thresholdBytes", 1024).toInt());
+    compressLevel = qBound(-1, settings.value("compress/level", -1).toInt(), 9);
+
+    // Periodic statistics in the log, 0 turns them off
+    statsIntervalSeconds = settings.value("stats/intervalSeconds", 10).toInt();
+    metricsPort = static_cast<quint16>(settings.value("stats/metricsPort", 54322).toUInt());
+
+    // Statements taking this long go to the slow query log, 0 turns it off
+    slowQueryMs = qMax(0, settings.value("sql/slowQueryMs", 100).toInt());
+    slowQueryLogFile = settings.value("sql/slowQueryLog", "slow_query_log.txt").toString();
+
+    // Trace every Nth request, 0 is off; spans kept per thread before the oldest are overwritten
+    traceSampleEvery = qMax(0, settings.value("trace/sampleEvery", 0).toInt());
+    traceBufferSpans = qMax(16, settings.value("trace/bufferSpans", 65536).toInt());
+}
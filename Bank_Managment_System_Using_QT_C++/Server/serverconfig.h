@@ -0,0 +1,70 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <QString>
+
+#include "logwriter.h"
+
+// Server tunables, read once from "server.ini" in the working directory.
+// Every key is optional; missing keys fall back to the defaults below.
+class ServerConfig
+{
+public:
+    enum class WorkerScheduling
+    {
+        LeastLoaded,
+        RoundRobin
+    };
+
+    static const ServerConfig &instance();
+
+    // [workers]
+    int workerThreads;
+    WorkerScheduling workerScheduling;
+
+    // [database] pragmas applied to every connection on open
+    QString journalMode;
+    QString synchronous;
+    int cacheSize;
+    qint64 mmapSize;
+    QString tempStore;
+    int busyTimeoutMs;
+
+    // [ledger] group commit of the writer thread
+    int batchWindowUs;
+    int maxBatchSize;
+
+    // [log] asynchronous log writer
+    int logBufferSize;
+    LogWriter::FullPolicy logFullPolicy;
+    bool logConsole;
+
+    // [stream] chunked read responses
+    int streamChunkRows;
+    qint64 streamHighWaterBytes;
+
+    // [notify] pushed account events
+    qint64 notifyHighWaterBytes;
+
+    // [compress] response frames of clients that accept compression
+    int compressThresholdBytes;
+    int compressLevel;
+
+    // [stats]
+    int statsIntervalSeconds;
+    // Local port of the plain-text metrics endpoint, 0 turns it off
+    quint16 metricsPort;
+
+    // [sql] statement timing
+    int slowQueryMs;
+    QString slowQueryLogFile;
+
+    // [trace] sampled request tracing
+    int traceSampleEvery;
+    int traceBufferSpans;
+
+private:
+    ServerConfig();
+};
+
+#endif // SERVERCONFIG_H
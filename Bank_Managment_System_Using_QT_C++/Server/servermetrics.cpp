@@ -0,0 +1,260 @@
+#include "servermetrics.h"
+
+#include <QJsonArray>
+#include <QtAlgorithms>
+#include <QStringList>
+#include <chrono>
+
+QAtomicPointer<ServerMetrics::Shard> ServerMetrics::shards;
+
+qint64 ServerMetrics::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ServerMetrics::Shard &ServerMetrics::localShard()
+{
+    static thread_local Shard *shard = nullptr;
+    if (shard == nullptr)
+    {
+        // Once per thread; shards live as long as the process, so a snapshot
+        // keeps the counts of threads that have ended
+        shard = new Shard();
+        Shard *head = shards.loadAcquire();
+        do
+        {
+            shard->next = head;
+        } while (!shards.testAndSetOrdered(head, shard, head));
+    }
+    return *shard;
+}
+
+int ServerMetrics::slotOf(int requestId)
+{
+    return (requestId >= 0 && requestId < BankProtocol::RequestCount) ? requestId : BankProtocol::RequestCount;
+}
+
+int ServerMetrics::bucketOf(quint64 microseconds)
+{
+    if (microseconds < SubBuckets)
+    {
+        return static_cast<int>(microseconds);
+    }
+    const int highestBit = 63 - qCountLeadingZeroBits(microseconds);
+    const int shift = highestBit - SubBucketBits;
+    const int bucket = (shift + 1) * SubBuckets + static_cast<int>((microseconds >> shift) & (SubBuckets - 1));
+    return qMin(bucket, BucketCount - 1);
+}
+
+quint64 ServerMetrics::bucketUpperBound(int bucket)
+{
+    if (bucket < SubBuckets)
+    {
+        return bucket;
+    }
+    const int shift = bucket / SubBuckets - 1;
+    const quint64 subBucket = bucket % SubBuckets;
+    return ((SubBuckets + subBucket + 1) << shift) - 1;
+}
+
+void ServerMetrics::record(int requestId, Phase phase, qint64 nanoseconds)
+{
+    const quint64 microseconds = nanoseconds > 0 ? static_cast<quint64>(nanoseconds) / 1000 : 0;
+    Shard &shard = localShard();
+    const int slot = slotOf(requestId);
+    increment<quint64>(shard.buckets[slot][phase][bucketOf(microseconds)], 1);
+    increment<quint64>(shard.sums[slot][phase], microseconds);
+}
+
+void ServerMetrics::countError(int requestId)
+{
+    increment<quint64>(localShard().errors[slotOf(requestId)], 1);
+}
+
+void ServerMetrics::add(Counter counter, qint64 delta)
+{
+    increment<qint64>(localShard().counters[counter], delta);
+}
+
+ServerMetrics::Snapshot::Snapshot()
+    : buckets(RequestSlots * PhaseCount * BucketCount, 0),
+      sums(RequestSlots * PhaseCount, 0),
+      errorCounts(RequestSlots, 0),
+      counters(CounterCount, 0)
+{}
+
+ServerMetrics::Snapshot ServerMetrics::snapshot()
+{
+    Snapshot merged;
+    for (Shard *shard = shards.loadAcquire(); shard != nullptr; shard = shard->next)
+    {
+        for (int slot = 0; slot < RequestSlots; ++slot)
+        {
+            for (int phase = 0; phase < PhaseCount; ++phase)
+            {
+                const int histogram = slot * PhaseCount + phase;
+                for (int bucket = 0; bucket < BucketCount; ++bucket)
+                {
+                    merged.buckets[histogram * BucketCount + bucket] += shard->buckets[slot][phase][bucket].loadRelaxed();
+                }
+                merged.sums[histogram] += shard->sums[slot][phase].loadRelaxed();
+            }
+            merged.errorCounts[slot] += shard->errors[slot].loadRelaxed();
+        }
+        for (int counter = 0; counter < CounterCount; ++counter)
+        {
+            merged.counters[counter] += shard->counters[counter].loadRelaxed();
+        }
+    }
+    return merged;
+}
+
+quint64 ServerMetrics::Snapshot::count(int slot, Phase phase) const
+{
+    const quint64 *histogram = &buckets[(slot * PhaseCount + phase) * BucketCount];
+    quint64 total = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        total += histogram[bucket];
+    }
+    return total;
+}
+
+quint64 ServerMetrics::Snapshot::sumUs(int slot, Phase phase) const
+{
+    return sums[slot * PhaseCount + phase];
+}
+
+quint64 ServerMetrics::Snapshot::percentileUs(int slot, Phase phase, double quantile) const
+{
+    const quint64 total = count(slot, phase);
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the sample at this quantile, at least the first one
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(quantile * total + 0.5));
+    const quint64 *histogram = &buckets[(slot * PhaseCount + phase) * BucketCount];
+    quint64 seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        seen += histogram[bucket];
+        if (seen >= rank)
+        {
+            return bucketUpperBound(bucket);
+        }
+    }
+    return bucketUpperBound(BucketCount - 1);
+}
+
+quint64 ServerMetrics::Snapshot::errors(int slot) const
+{
+    return errorCounts[slot];
+}
+
+qint64 ServerMetrics::Snapshot::counter(Counter counter) const
+{
+    return counters[counter];
+}
+
+const char *ServerMetrics::phaseName(Phase phase)
+{
+    static const char *const names[PhaseCount] = {"parse", "database", "serialize", "write", "total"};
+    return names[phase];
+}
+
+const char *ServerMetrics::counterName(Counter counter)
+{
+    static const char *const names[CounterCount] =
+    {
+        "connections_opened", "connections_closed", "requests_in_flight",
+        "malformed_requests", "sqlite_busy_retries"
+    };
+    return names[counter];
+}
+
+static const double reportedQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+QJsonObject ServerMetrics::Snapshot::toJson() const
+{
+    QJsonObject countersJson;
+    for (int counter = 0; counter < CounterCount; ++counter)
+    {
+        countersJson[counterName(static_cast<Counter>(counter))] = counters[counter];
+    }
+    countersJson["connections_open"] = counters[ConnectionsOpened] - counters[ConnectionsClosed];
+
+    QJsonArray requestsJson;
+    for (int slot = 0; slot < RequestSlots; ++slot)
+    {
+        const quint64 requests = count(slot, Parse);
+        if (requests == 0)
+        {
+            continue;
+        }
+
+        QJsonObject phasesJson;
+        for (int phase = 0; phase < PhaseCount; ++phase)
+        {
+            const quint64 samples = count(slot, static_cast<Phase>(phase));
+            QJsonObject phaseJson;
+            phaseJson["count"] = static_cast<qint64>(samples);
+            phaseJson["meanUs"] = samples > 0 ? static_cast<double>(sumUs(slot, static_cast<Phase>(phase))) / samples : 0.0;
+            for (double quantile : reportedQuantiles)
+            {
+                phaseJson[QString("p%1").arg(quantile * 100)] =
+                    static_cast<qint64>(percentileUs(slot, static_cast<Phase>(phase), quantile));
+            }
+            phasesJson[phaseName(static_cast<Phase>(phase))] = phaseJson;
+        }
+
+        QJsonObject requestJson;
+        requestJson["requestId"] = slot < BankProtocol::RequestCount ? slot : -1;
+        requestJson["count"] = static_cast<qint64>(requests);
+        requestJson["errors"] = static_cast<qint64>(errorCounts[slot]);
+        requestJson["phases"] = phasesJson;
+        requestsJson.append(requestJson);
+    }
+
+    QJsonObject metricsJson;
+    metricsJson["counters"] = countersJson;
+    metricsJson["requests"] = requestsJson;
+    return metricsJson;
+}
+
+QString ServerMetrics::Snapshot::toText() const
+{
+    QStringList lines;
+    for (int counter = 0; counter < CounterCount; ++counter)
+    {
+        lines.append(QString("bank_%1 %2").arg(counterName(static_cast<Counter>(counter))).arg(counters[counter]));
+    }
+    lines.append(QString("bank_connections_open %1").arg(counters[ConnectionsOpened] - counters[ConnectionsClosed]));
+
+    lines.append("# TYPE bank_request_duration_us summary");
+    for (int slot = 0; slot < RequestSlots; ++slot)
+    {
+        if (count(slot, Parse) == 0)
+        {
+            continue;
+        }
+        const QString request = slot < BankProtocol::RequestCount ? QString::number(slot) : QString("unknown");
+        lines.append(QString("bank_request_errors_total{request=\"%1\"} %2").arg(request).arg(errorCounts[slot]));
+
+        for (int phase = 0; phase < PhaseCount; ++phase)
+        {
+            const QString labels = QString("request=\"%1\",phase=\"%2\"").arg(request, phaseName(static_cast<Phase>(phase)));
+            for (double quantile : reportedQuantiles)
+            {
+                lines.append(QString("bank_request_duration_us{%1,quantile=\"%2\"} %3")
+                                 .arg(labels).arg(quantile)
+                                 .arg(percentileUs(slot, static_cast<Phase>(phase), quantile)));
+            }
+            lines.append(QString("bank_request_duration_us_sum{%1} %2").arg(labels).arg(sumUs(slot, static_cast<Phase>(phase))));
+            lines.append(QString("bank_request_duration_us_count{%1} %2").arg(labels).arg(count(slot, static_cast<Phase>(phase))));
+        }
+    }
+    return lines.join('\n') + '\n';
+}
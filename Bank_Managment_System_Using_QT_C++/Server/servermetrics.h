@@ -0,0 +1,109 @@
+#ifndef SERVERMETRICS_H
+#define SERVERMETRICS_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QJsonObject>
+#include <QString>
+#include <vector>
+
+#include "bankprotocol.h"
+
+// Request latency histograms and server counters.
+// Every thread records into its own shard with plain relaxed stores, so the
+// request path takes no lock and shares no cache line with other threads;
+// a snapshot sums the shards of all threads that ever recorded something.
+class ServerMetrics
+{
+public:
+    // Where a request's time goes; Total runs from the frame arriving to its response written
+    enum Phase
+    {
+        Parse,
+        Database,
+        Serialize,
+        Write,
+        Total,
+        PhaseCount
+    };
+
+    enum Counter
+    {
+        ConnectionsOpened,
+        ConnectionsClosed,
+        InFlight,
+        MalformedRequests,
+        BusyRetries,
+        CounterCount
+    };
+
+    // Request IDs plus one slot for malformed and unknown requests
+    static const int RequestSlots = BankProtocol::RequestCount + 1;
+
+    // Log-linear buckets in microseconds: exact below 8, then 8 per power of two
+    // (12.5% precision) up to 2^31 us; larger values land in the last bucket
+    static const int SubBucketBits = 3;
+    static const int SubBuckets = 1 << SubBucketBits;
+    static const int BucketCount = SubBuckets * (31 - SubBucketBits + 2);
+
+    static qint64 nowNs();
+    static void record(int requestId, Phase phase, qint64 nanoseconds);
+    static void countError(int requestId);
+    static void add(Counter counter, qint64 delta = 1);
+
+    // Merged view of every shard at one moment
+    class Snapshot
+    {
+    public:
+        Snapshot();
+
+        quint64 count(int slot, Phase phase) const;
+        quint64 sumUs(int slot, Phase phase) const;
+        // Upper bound of the bucket holding the given quantile, 0 without samples
+        quint64 percentileUs(int slot, Phase phase, double quantile) const;
+        quint64 errors(int slot) const;
+        qint64 counter(Counter counter) const;
+
+        QJsonObject toJson() const;
+        // Prometheus text exposition format
+        QString toText() const;
+
+    private:
+        friend class ServerMetrics;
+        std::vector<quint64> buckets;
+        std::vector<quint64> sums;
+        std::vector<quint64> errorCounts;
+        std::vector<qint64> counters;
+    };
+
+    static Snapshot snapshot();
+
+    static const char *phaseName(Phase phase);
+    static const char *counterName(Counter counter);
+
+private:
+    struct Shard
+    {
+        QAtomicInteger<quint64> buckets[RequestSlots][PhaseCount][BucketCount];
+        QAtomicInteger<quint64> sums[RequestSlots][PhaseCount];
+        QAtomicInteger<quint64> errors[RequestSlots];
+        QAtomicInteger<qint64> counters[CounterCount];
+        Shard *next = nullptr;
+    };
+
+    static Shard &localShard();
+    static int slotOf(int requestId);
+    static int bucketOf(quint64 microseconds);
+    static quint64 bucketUpperBound(int bucket);
+
+    // Only the owning thread writes a shard, a relaxed store is enough
+    template <typename T>
+    static void increment(QAtomicInteger<T> &value, T delta)
+    {
+        value.storeRelaxed(value.loadRelaxed() + delta);
+    }
+
+    static QAtomicPointer<Shard> shards;
+};
+
+#endif // SERVERMETRICS_H
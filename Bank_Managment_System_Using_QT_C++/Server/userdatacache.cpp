@@ -0,0 +1,142 @@
+#include "userdatacache.h"
+
+UserDataReply::UserDataReply(quint64 requestSequence, MessageCodec::Encoding encoding, QObject *parent)
+    : QObject(parent), requestSequence(requestSequence), payloadEncoding(encoding)
+{}
+
+quint64 UserDataReply::sequence() const
+{
+    return requestSequence;
+}
+
+MessageCodec::Encoding UserDataReply::encoding() const
+{
+    return payloadEncoding;
+}
+
+UserDataCache &UserDataCache::instance()
+{
+    static UserDataCache cache;
+    return cache;
+}
+
+QByteArray UserDataCache::payload(quint64 version, MessageCodec::Encoding encoding,
+                                  const std::function<QJsonObject()> &build,
+                                  const std::function<UserDataReply *()> &wait)
+{
+    QMutexLocker locker(&mutex);
+
+    if (valid && cachedVersion >= version)
+    {
+        hits.fetchAndAddRelaxed(1);
+        return encodedPayload(encoding, locker);
+    }
+
+    // Someone else is already reading data this new, its result answers this request too
+    if (buildsRunning > 0 && buildingVersion >= version)
+    {
+        hits.fetchAndAddRelaxed(1);
+        waiters.append({version, wait()});
+        return QByteArray();
+    }
+
+    ++buildsRunning;
+    buildingVersion = qMax(buildingVersion, version);
+    locker.unlock();
+
+    // The version was read before the query, so the rows are never older than it
+    QJsonObject response = build();
+    response["version"] = static_cast<qint64>(version);
+    builds.fetchAndAddRelaxed(1);
+
+    locker.relock();
+    if (--buildsRunning == 0)
+    {
+        buildingVersion = 0;
+    }
+
+    // Everyone waiting for data no newer than this is answered with it; with
+    // no build left running nobody else would answer the rest
+    QVector<Waiter> answered;
+    for (qsizetype i = 0; i < waiters.size();)
+    {
+        if (waiters[i].version <= version || buildsRunning == 0)
+        {
+            answered.append(waiters.takeAt(i));
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    QVector<QByteArray> payloads;
+    QByteArray ownPayload;
+    if (!response["fetchUserDataSuccess"].toBool())
+    {
+        // Failures aren't cached, the next request tries again
+        locker.unlock();
+        for (const Waiter &waiter : answered)
+        {
+            payloads.append(MessageCodec::encode(response, waiter.reply->encoding()));
+        }
+        ownPayload = MessageCodec::encode(response, encoding);
+    }
+    else
+    {
+        if (!valid || version > cachedVersion)
+        {
+            valid = true;
+            cachedVersion = version;
+            cachedResponse = response;
+            encodedPayloads[0].clear();
+            encodedPayloads[1].clear();
+        }
+        for (const Waiter &waiter : answered)
+        {
+            payloads.append(encodedPayload(waiter.reply->encoding(), locker));
+        }
+        ownPayload = encodedPayload(encoding, locker);
+        locker.unlock();
+    }
+
+    // Queued to each waiter's thread like a LedgerReply
+    for (qsizetype i = 0; i < answered.size(); ++i)
+    {
+        UserDataReply *reply = answered[i].reply;
+        emit reply->finished(reply->sequence(), payloads[i]);
+        reply->deleteLater();
+    }
+    return ownPayload;
+}
+
+QByteArray UserDataCache::encodedPayload(MessageCodec::Encoding encoding, QMutexLocker<QMutex> &locker)
+{
+    const int slot = static_cast<int>(encoding);
+    if (!encodedPayloads[slot].isEmpty())
+    {
+        return encodedPayloads[slot];
+    }
+
+    // First request in this encoding, encode outside the lock
+    const quint64 responseVersion = cachedVersion;
+    const QJsonObject response = cachedResponse;
+    locker.unlock();
+    QByteArray encoded = MessageCodec::encode(response, encoding);
+    locker.relock();
+    if (valid && cachedVersion == responseVersion)
+    {
+        encodedPayloads[slot] = encoded;
+    }
+    return encoded;
+}
+
+quint64 UserDataCache::hitCount() const
+{
+    return hits.loadRelaxed();
+}
+
+quint64 UserDataCache::buildCount() const
+{
+    return builds.loadRelaxed();
+}
@@ -0,0 +1,81 @@
+#ifndef USERDATACACHE_H
+#define USERDATACACHE_H
+
+#include <QObject>
+#include <QMutex>
+#include <QVector>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QAtomicInteger>
+#include <functional>
+
+#include "messagecodec.h"
+
+// Carries the shared payload to a session that asked while another session
+// was building it. Connections to it are dropped automatically if the
+// receiver goes away first.
+class UserDataReply : public QObject
+{
+    Q_OBJECT
+
+public:
+    UserDataReply(quint64 requestSequence, MessageCodec::Encoding encoding, QObject *parent = nullptr);
+    quint64 sequence() const;
+    MessageCodec::Encoding encoding() const;
+
+signals:
+    void finished(quint64 requestSequence, QByteArray payload);
+
+private:
+    quint64 requestSequence;
+    MessageCodec::Encoding payloadEncoding;
+};
+
+// Encoded response of the plain fetchAllUserData request, shared by every
+// session until the LedgerWriter's data version moves on. Only one session
+// runs the query for a version; the others are answered through a reply
+// when it finishes, without blocking their worker.
+class UserDataCache
+{
+public:
+    static UserDataCache &instance();
+
+    // Payload for data at least as new as version; build() runs the query on a miss.
+    // While a build for data that new is running, wait() makes the reply that gets
+    // the payload later and a null payload is returned.
+    QByteArray payload(quint64 version, MessageCodec::Encoding encoding,
+                       const std::function<QJsonObject()> &build,
+                       const std::function<UserDataReply *()> &wait);
+
+    // Metrics
+    quint64 hitCount() const;
+    quint64 buildCount() const;
+
+private:
+    UserDataCache() = default;
+
+    struct Waiter
+    {
+        quint64 version;
+        UserDataReply *reply;
+    };
+
+    QMutex mutex;
+    int buildsRunning = 0;
+    // Newest version a running build reads, waiters never need more than that
+    quint64 buildingVersion = 0;
+    QVector<Waiter> waiters;
+    bool valid = false;
+    quint64 cachedVersion = 0;
+    QJsonObject cachedResponse;
+    // Indexed by MessageCodec::Encoding, empty until first asked for
+    QByteArray encodedPayloads[2];
+
+    QAtomicInteger<quint64> hits;
+    QAtomicInteger<quint64> builds;
+
+    // The cached response in this encoding, encoded outside the lock the first time
+    QByteArray encodedPayload(MessageCodec::Encoding encoding, QMutexLocker<QMutex> &locker);
+};
+
+#endif // USERDATACACHE_H
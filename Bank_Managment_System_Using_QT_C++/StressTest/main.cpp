@@ -0,0 +1,147 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QFile>
+#include <QDir>
+#include "transferstress.h"
+#include "databaseconnectionpool.h"
+#include "ledgerwriter.h"
+#include "notificationhub.h"
+#include "server.h"
+
+// Settings of the stress run, read by ServerConfig from the working directory
+static bool writeServerConfig()
+{
+    QFile file("server.ini");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        return false;
+    }
+    QTextStream(&file) << "[log]\n"
+                          "console=false\n"
+                          "[stats]\n"
+                          "intervalSeconds=0\n"
+                          "metricsPort=0\n";
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("stresstest");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Money conservation stress test. Runs the bank server in process on its "
+                                     "usual port against a temporary database, sends concurrent transfers "
+                                     "between a few accounts and fails if the total balance changed.");
+    parser.addHelpOption();
+
+    const StressOptions defaults;
+    const QCommandLineOption accountsOption("accounts", "Accounts the transfers move money between, at least 2.",
+                                            "count", QString::number(defaults.accounts));
+    const QCommandLineOption connectionsOption({"c", "connections"}, "Concurrent connections.", "count",
+                                               QString::number(defaults.connections));
+    const QCommandLineOption transfersOption({"n", "transfers"}, "Transfers per connection.", "count",
+                                             QString::number(defaults.transfersPerConnection));
+    const QCommandLineOption pipelineOption("pipeline", "Transfers a connection keeps in flight.", "count",
+                                            QString::number(defaults.pipeline));
+    const QCommandLineOption timeoutOption("timeout", "Seconds before the run counts as hung.", "seconds",
+                                           QString::number(defaults.timeoutSeconds));
+    const QCommandLineOption seedOption("seed", "Seed of the transfers.", "seed", QString::number(defaults.seed));
+    parser.addOptions({accountsOption, connectionsOption, transfersOption, pipelineOption, timeoutOption, seedOption});
+    parser.process(a);
+
+    StressOptions options;
+    options.accounts = parser.value(accountsOption).toInt();
+    options.connections = parser.value(connectionsOption).toInt();
+    options.transfersPerConnection = parser.value(transfersOption).toInt();
+    options.pipeline = parser.value(pipelineOption).toInt();
+    options.timeoutSeconds = parser.value(timeoutOption).toInt();
+    options.seed = parser.value(seedOption).toUInt();
+
+    QTextStream out(stdout);
+    QTextStream errors(stderr);
+    if (options.accounts < 2 || options.connections < 1 || options.transfersPerConnection < 1
+        || options.pipeline < 1 || options.timeoutSeconds < 1)
+    {
+        errors << "Invalid options, see --help" << Qt::endl;
+        return 2;
+    }
+
+    // The server keeps its database, log and settings in the working directory
+    QTemporaryDir directory;
+    if (!directory.isValid() || !QDir::setCurrent(directory.path()) || !writeServerConfig())
+    {
+        errors << "Failed to set up the temporary directory" << Qt::endl;
+        return 1;
+    }
+
+    int exitCode = 1;
+    {
+        DatabaseManager databaseManager("StressTest");
+        TransferStress stress(options);
+        double totalBefore = 0.0;
+        double totalAfter = 0.0;
+        double lowest = 0.0;
+        if (!databaseManager.initializeDatabase() || !databaseManager.openConnection()
+            || !stress.seed(databaseManager) || !TransferStress::readBalances(databaseManager, totalBefore, lowest))
+        {
+            errors << "Failed to create the stress test accounts" << Qt::endl;
+            return 1;
+        }
+
+        NotificationHub::instance().start();
+        LedgerWriter::instance().start();
+
+        {
+            Server server;
+            if (server.isListening())
+            {
+                QObject::connect(&stress, &TransferStress::finished, &a, &QCoreApplication::exit,
+                                 Qt::QueuedConnection);
+                stress.start();
+                exitCode = a.exec();
+            }
+            else
+            {
+                errors << "Failed to start the server, is another one using its port?" << Qt::endl;
+            }
+            // Everything answered is committed, the writer has nothing left to lose
+            LedgerWriter::instance().stop();
+        }
+        NotificationHub::instance().stop();
+
+        if (exitCode == 0)
+        {
+            if (!TransferStress::readBalances(databaseManager, totalAfter, lowest))
+            {
+                errors << "Failed to read the balances after the run" << Qt::endl;
+                exitCode = 1;
+            }
+            else
+            {
+                out << stress.succeededCount() << " transfers succeeded, " << stress.refusedCount()
+                    << " refused" << Qt::endl;
+                out << "Total balance " << QString::number(totalBefore, 'f', 2) << " before, "
+                    << QString::number(totalAfter, 'f', 2) << " after, lowest balance "
+                    << QString::number(lowest, 'f', 2) << Qt::endl;
+                if (totalAfter != totalBefore || lowest < 0.0)
+                {
+                    errors << "FAILED: money was created or destroyed" << Qt::endl;
+                    exitCode = 1;
+                }
+                else
+                {
+                    out << "PASSED" << Qt::endl;
+                }
+            }
+        }
+        databaseManager.closeConnection();
+    }
+    DatabaseConnectionPool::instance().releaseThreadConnection();
+
+    // Back out of the directory before it is removed
+    QDir::setCurrent(QCoreApplication::applicationDirPath());
+    return exitCode;
+}
@@ -0,0 +1,59 @@
+QT = core network sql
+
+CONFIG += c++17 cmdline static
+
+# The server's sources are built in, all but its main.cpp, and the load
+# generator's pipelined connection is the client
+INCLUDEPATH += ../Common ../Server ../LoadGenerator
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += \
+        ../Common/messagecodec.cpp \
+        ../Common/messageframing.cpp \
+        ../LoadGenerator/loadconnection.cpp \
+        ../Server/clientrunnable.cpp \
+        ../Server/coarseclock.cpp \
+        ../Server/databaseconnectionpool.cpp \
+        ../Server/databasemanager.cpp \
+        ../Server/ledgerwriter.cpp \
+        ../Server/logger.cpp \
+        ../Server/logwriter.cpp \
+        ../Server/metricsserver.cpp \
+        ../Server/notificationhub.cpp \
+        ../Server/querytimer.cpp \
+        ../Server/requesthandler.cpp \
+        ../Server/requesttracer.cpp \
+        ../Server/resultstream.cpp \
+        ../Server/server.cpp \
+        ../Server/serverconfig.cpp \
+        ../Server/servermetrics.cpp \
+        ../Server/userdatacache.cpp \
+        main.cpp \
+        transferstress.cpp
+
+HEADERS += \
+    ../Common/bankprotocol.h \
+    ../Common/messagecodec.h \
+    ../Common/messageframing.h \
+    ../LoadGenerator/loadconnection.h \
+    ../Server/clientrunnable.h \
+    ../Server/coarseclock.h \
+    ../Server/databaseconnectionpool.h \
+    ../Server/databasemanager.h \
+    ../Server/ledgerwriter.h \
+    ../Server/logger.h \
+    ../Server/logwriter.h \
+    ../Server/metricsserver.h \
+    ../Server/notificationhub.h \
+    ../Server/querytimer.h \
+    ../Server/requesthandler.h \
+    ../Server/requesttracer.h \
+    ../Server/resultstream.h \
+    ../Server/server.h \
+    ../Server/serverconfig.h \
+    ../Server/servermetrics.h \
+    ../Server/userdatacache.h \
+    transferstress.h
@@ -0,0 +1,187 @@
+#include "transferstress.h"
+#include "bankprotocol.h"
+
+#include <QJsonArray>
+#include <QTextStream>
+
+static const double startBalance = 1000.0;
+// Whole amounts keep every balance and the total exact in a double
+static const int largestAmount = 200;
+// One transfer in this many goes to an account that doesn't exist
+static const int missingAccountEvery = 20;
+
+TransferStress::TransferStress(const StressOptions &options, QObject *parent)
+    : QObject(parent), options(options), random(options.seed)
+{
+    timeoutTimer.setSingleShot(true);
+    connect(&timeoutTimer, &QTimer::timeout, this, &TransferStress::timedOut);
+}
+
+bool TransferStress::seed(DatabaseManager &databaseManager)
+{
+    QTextStream out(stdout);
+    if (!databaseManager.beginBatch())
+    {
+        out << "Failed to start the seeding transaction" << Qt::endl;
+        return false;
+    }
+
+    for (int i = 0; i < options.accounts; ++i)
+    {
+        BankProtocol::CreateAccountRequest create;
+        create.username = QString("stress_%1").arg(i);
+        create.password = "stress";
+        create.name = QString("Stress %1").arg(i);
+        create.age = 30;
+        const QJsonObject created = databaseManager.processRequest(BankProtocol::encode(create));
+
+        BankProtocol::MakeTransactionRequest deposit;
+        deposit.accountNumber = created["accountNumber"].toInteger();
+        deposit.amount = startBalance;
+        if (!created["createAccountSuccess"].toBool()
+            || !databaseManager.processRequest(BankProtocol::encode(deposit))["transactionSuccess"].toBool())
+        {
+            out << "Failed to create " << create.username << ": " << created["errorMessage"].toString() << Qt::endl;
+            databaseManager.rollbackBatch();
+            return false;
+        }
+        accountNumbers.append(deposit.accountNumber);
+    }
+
+    if (!databaseManager.commitBatch())
+    {
+        out << "Failed to commit the seeded accounts" << Qt::endl;
+        return false;
+    }
+    databaseManager.takeAccountEvents();
+    return true;
+}
+
+bool TransferStress::readBalances(DatabaseManager &databaseManager, double &total, double &lowest)
+{
+    const QJsonObject response =
+        databaseManager.processRequest(BankProtocol::encode(BankProtocol::FetchAllUserDataRequest()));
+    if (!response["fetchUserDataSuccess"].toBool())
+    {
+        return false;
+    }
+
+    total = 0.0;
+    lowest = 0.0;
+    bool first = true;
+    for (const QJsonValue &row : response["userData"].toArray())
+    {
+        const double balance = row.toObject()["Balance"].toDouble();
+        total += balance;
+        lowest = first ? balance : qMin(lowest, balance);
+        first = false;
+    }
+    return true;
+}
+
+void TransferStress::start()
+{
+    remaining.fill(options.transfersPerConnection, options.connections);
+    for (int i = 0; i < options.connections; ++i)
+    {
+        LoadConnection *connection = new LoadConnection("localhost", 54321, MessageCodec::Encoding::Json, false, this);
+        connect(connection, &LoadConnection::ready, this, &TransferStress::connectionReady);
+        connect(connection, &LoadConnection::failed, this, &TransferStress::connectionFailed);
+        connect(connection, &LoadConnection::responseReceived, this, &TransferStress::responseReceived);
+        connections.append(connection);
+        connection->open();
+    }
+    openConnections = options.connections;
+    timeoutTimer.start(options.timeoutSeconds * 1000);
+}
+
+quint64 TransferStress::succeededCount() const
+{
+    return succeeded;
+}
+
+quint64 TransferStress::refusedCount() const
+{
+    return refused;
+}
+
+void TransferStress::connectionReady()
+{
+    const int connection = connections.indexOf(qobject_cast<LoadConnection *>(sender()));
+    for (int i = 0; i < options.pipeline && remaining[connection] > 0; ++i)
+    {
+        sendTransfer(connection);
+    }
+}
+
+void TransferStress::connectionFailed(QString errorMessage)
+{
+    QTextStream(stderr) << "Connection failed: " << errorMessage << Qt::endl;
+    finish(1);
+}
+
+void TransferStress::responseReceived(int requestId, QJsonObject response, qint64 scheduledNs, qint64 sentNs,
+                                      qint64 receivedNs)
+{
+    Q_UNUSED(scheduledNs);
+    Q_UNUSED(sentNs);
+    Q_UNUSED(receivedNs);
+
+    if (requestId != static_cast<int>(BankProtocol::RequestId::MakeTransfer))
+    {
+        return;
+    }
+    if (response["transferSuccess"].toBool())
+    {
+        succeeded++;
+    }
+    else
+    {
+        refused++;
+    }
+
+    LoadConnection *answered = qobject_cast<LoadConnection *>(sender());
+    const int connection = connections.indexOf(answered);
+    if (remaining[connection] > 0)
+    {
+        sendTransfer(connection);
+    }
+    else if (answered->outstanding() == 0 && --openConnections == 0)
+    {
+        finish(0);
+    }
+}
+
+void TransferStress::timedOut()
+{
+    QTextStream(stderr) << "Timed out after " << options.timeoutSeconds << " s with "
+                        << succeeded + refused << " transfers answered" << Qt::endl;
+    finish(1);
+}
+
+void TransferStress::sendTransfer(int connection)
+{
+    const int from = random.bounded(accountNumbers.size());
+    // Any other account, never the sender itself
+    const int to = (from + 1 + random.bounded(accountNumbers.size() - 1)) % accountNumbers.size();
+
+    BankProtocol::MakeTransferRequest request;
+    request.fromAccountNumber = accountNumbers[from];
+    request.toAccountNumber = random.bounded(missingAccountEvery) == 0 ? accountNumbers.last() + 1000
+                                                                      : accountNumbers[to];
+    request.amount = 1 + random.bounded(largestAmount);
+
+    remaining[connection]--;
+    connections[connection]->send(BankProtocol::encode(request), LoadConnection::nowNs());
+}
+
+void TransferStress::finish(int exitCode)
+{
+    if (done)
+    {
+        return;
+    }
+    done = true;
+    timeoutTimer.stop();
+    emit finished(exitCode);
+}
@@ -0,0 +1,71 @@
+#ifndef TRANSFERSTRESS_H
+#define TRANSFERSTRESS_H
+
+#include <QObject>
+#include <QVector>
+#include <QTimer>
+#include <QRandomGenerator>
+
+#include "loadconnection.h"
+#include "databasemanager.h"
+
+struct StressOptions
+{
+    int accounts = 20;
+    int connections = 16;
+    int transfersPerConnection = 2000;
+    // Transfers a connection keeps in flight, so the ledger writer commits them in groups
+    int pipeline = 8;
+    int timeoutSeconds = 120;
+    quint32 seed = 1;
+};
+
+// Concurrent transfers between a few accounts over many connections. Some
+// can't be covered and some go to an account that doesn't exist, so the
+// debit has to be rolled back; whatever the outcome, money only moves
+// between accounts and the total balance must not change.
+class TransferStress : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransferStress(const StressOptions &options, QObject *parent = nullptr);
+
+    // Creates and funds the accounts through the caller's DatabaseManager
+    bool seed(DatabaseManager &databaseManager);
+    // Connects to the server on the local port and sends every transfer
+    void start();
+
+    // Sum and lowest of all balances, false if they can't be read
+    static bool readBalances(DatabaseManager &databaseManager, double &total, double &lowest);
+
+    quint64 succeededCount() const;
+    quint64 refusedCount() const;
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void connectionReady();
+    void connectionFailed(QString errorMessage);
+    void responseReceived(int requestId, QJsonObject response, qint64 scheduledNs, qint64 sentNs, qint64 receivedNs);
+    void timedOut();
+
+private:
+    StressOptions options;
+    QVector<qint64> accountNumbers;
+    QVector<LoadConnection *> connections;
+    // Transfers each connection still has to send
+    QVector<int> remaining;
+    int openConnections = 0;
+    quint64 succeeded = 0;
+    quint64 refused = 0;
+    QRandomGenerator random;
+    QTimer timeoutTimer;
+    bool done = false;
+
+    void sendTransfer(int connection);
+    void finish(int exitCode);
+};
+
+#endif // TRANSFERSTRESS_H